@@ -0,0 +1,260 @@
+/*
+ * echobench.c - A load generator for the echo servers
+ *
+ *     usage: echobench [-c conns] [-d secs] [-l linelen] [-P depth]
+ *                      [-p serverpid] <host> <port>
+ *
+ *     Each of the conns connections is driven by its own thread for
+ *     secs seconds, keeping depth lines of linelen bytes in flight and
+ *     sending a new line for every echo it reads back.
+ *
+ *     Reports lines and megabytes per second. If the server's pid is
+ *     given with -p, also reports its CPU time and the system calls it
+ *     made per line. Syscalls are counted with the raw_syscalls:sys_enter
+ *     tracepoint, so tracefs must be mounted (as root:
+ *     "mount -t tracefs nodev /sys/kernel/tracing").
+ */
+#include "csapp.h"
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define MAXDEPTH   256   /* Most lines in flight per connection */
+#define MAXTHREADS 1024  /* Most server threads whose syscalls we count */
+
+typedef struct {         /* Per-connection (per-thread) results */
+    long lines;          /* Echoes read back */
+    long errors;         /* Failed connects, short or mismatched echoes */
+} worker_t;
+
+static char *host, *port;
+static char *line;       /* The line every connection sends */
+static int linelen = 64, depth = 1;
+static uint64_t deadline;
+
+void *worker(void *vargp);
+uint64_t now_ns(void);
+long proc_cputicks(pid_t pid);
+int syscount_open(pid_t pid, int *fds);
+long long syscount_read(int *fds, int n);
+
+int main(int argc, char **argv)
+{
+    int c, i, conns = 16, secs = 5, nfds = 0, fds[MAXTHREADS];
+    long lines = 0, errors = 0, ticks0 = 0, ticks1 = 0;
+    long long calls = -1;
+    pid_t serverpid = 0;
+    pthread_t *tids;
+    worker_t *workers;
+    double elapsed;
+    uint64_t start;
+
+    while ((c = getopt(argc, argv, "c:d:l:P:p:")) != -1) {
+	switch (c) {
+	case 'c':
+	    conns = atoi(optarg);
+	    break;
+	case 'd':
+	    secs = atoi(optarg);
+	    break;
+	case 'l':
+	    linelen = atoi(optarg);
+	    break;
+	case 'P':
+	    depth = atoi(optarg);
+	    break;
+	case 'p':
+	    serverpid = atoi(optarg);
+	    break;
+	default:
+	    goto usage;
+	}
+    }
+    if (argc - optind != 2) {
+    usage:
+	fprintf(stderr, "usage: %s [-c conns] [-d secs] [-l linelen] "
+		"[-P depth] [-p serverpid] <host> <port>\n", argv[0]);
+	exit(1);
+    }
+    host = argv[optind];
+    port = argv[optind + 1];
+    if (conns < 1 || secs < 1 || linelen < 2 || linelen > MAXLINE - 1 ||
+	depth < 1 || depth > MAXDEPTH)
+	app_error("echobench: bad option value");
+
+    line = Malloc(linelen);
+    for (i = 0; i < linelen - 1; i++)
+	line[i] = 'a' + i % 26;
+    line[linelen - 1] = '\n';
+
+    tids = Malloc(conns * sizeof(pthread_t));
+    workers = Calloc(conns, sizeof(worker_t));
+    if (serverpid) {
+	if ((nfds = syscount_open(serverpid, fds)) < 0)
+	    fprintf(stderr, "echobench: can't count syscalls: %s\n",
+		    strerror(errno));
+	ticks0 = proc_cputicks(serverpid);
+    }
+    start = now_ns();
+    deadline = start + secs * 1000000000ULL;
+    for (i = 0; i < conns; i++)
+	Pthread_create(&tids[i], NULL, worker, &workers[i]);
+    for (i = 0; i < conns; i++) {
+	Pthread_join(tids[i], NULL);
+	lines += workers[i].lines;
+	errors += workers[i].errors;
+    }
+    elapsed = (now_ns() - start) / 1e9;
+    if (serverpid) {
+	ticks1 = proc_cputicks(serverpid);
+	if (nfds > 0)
+	    calls = syscount_read(fds, nfds);
+    }
+
+    printf("Lines:      %ld in %.2f s, %.0f lines/s, %.1f MB/s, errors %ld\n",
+	   lines, elapsed, lines / elapsed, lines * linelen / elapsed / 1e6,
+	   errors);
+    if (serverpid && lines > 0) {
+	printf("Server CPU: %.2f us/line",
+	       (ticks1 - ticks0) * 1e6 / sysconf(_SC_CLK_TCK) / lines);
+	if (calls >= 0)
+	    printf(", %.3f syscalls/line", (double)calls / lines);
+	printf("\n");
+    }
+    exit(0);
+}
+
+/*
+ * worker - one connection: keep depth lines in flight until the
+ *     deadline, then read back the echoes still outstanding
+ */
+void *worker(void *vargp)
+{
+    worker_t *w = vargp;
+    rio_t rio;
+    char *echo;
+    ssize_t n;
+    int fd, i, inflight;
+
+    if ((fd = open_clientfd(host, port)) < 0) {
+	w->errors++;
+	return NULL;
+    }
+    Rio_readinitb(&rio, fd);
+    for (i = 0; i < depth; i++)
+	if (rio_writen(fd, line, linelen) != linelen)
+	    goto fail;
+    for (inflight = depth; inflight > 0; inflight--) {
+	if ((n = rio_readlinep(&rio, &echo)) != linelen ||
+	    memcmp(echo, line, linelen))
+	    goto fail;
+	w->lines++;
+	if (now_ns() < deadline) {
+	    if (rio_writen(fd, line, linelen) != linelen)
+		goto fail;
+	    inflight++;
+	}
+    }
+    Close(fd);
+    return NULL;
+
+ fail:
+    w->errors++;
+    Close(fd);
+    return NULL;
+}
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * proc_cputicks - user+system time consumed so far by process pid,
+ *     in clock ticks
+ */
+long proc_cputicks(pid_t pid)
+{
+    char path[MAXLINE], buf[MAXLINE], *p;
+    long utime, stime;
+    FILE *fp;
+
+    snprintf(path, MAXLINE, "/proc/%d/stat", (int)pid);
+    fp = Fopen(path, "r");
+    Fgets(buf, MAXLINE, fp);
+    Fclose(fp);
+
+    /* Skip "pid (comm) state"; comm may contain blanks */
+    if (!(p = strrchr(buf, ')')) ||
+	sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld",
+	       &utime, &stime) != 2)
+	app_error("echobench: bad /proc stat line");
+    return utime + stime;
+}
+
+/*
+ * syscount_open - start counting the system calls made by every
+ *     thread of process pid, with one tracepoint counter per thread
+ *     in fds; returns the number of counters, or -1
+ */
+int syscount_open(pid_t pid, int *fds)
+{
+    struct perf_event_attr attr;
+    char path[MAXLINE];
+    struct dirent *de;
+    FILE *fp;
+    DIR *dir;
+    int id, n = 0;
+
+    if ((fp = fopen("/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		    "r")) == NULL &&
+	(fp = fopen("/sys/kernel/debug/tracing/events/raw_syscalls/"
+		    "sys_enter/id", "r")) == NULL)
+	return -1;
+    if (fscanf(fp, "%d", &id) != 1) {
+	fclose(fp);
+	errno = EINVAL;
+	return -1;
+    }
+    fclose(fp);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    snprintf(path, MAXLINE, "/proc/%d/task", (int)pid);
+    if ((dir = opendir(path)) == NULL)
+	return -1;
+    while ((de = readdir(dir)) != NULL && n < MAXTHREADS) {
+	if (de->d_name[0] == '.')
+	    continue;
+	if ((fds[n] = syscall(__NR_perf_event_open, &attr,
+			      atoi(de->d_name), -1, -1, 0)) < 0) {
+	    closedir(dir);
+	    while (n > 0)
+		close(fds[--n]);
+	    return -1;
+	}
+	n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/*
+ * syscount_read - total of the n counters in fds
+ */
+long long syscount_read(int *fds, int n)
+{
+    long long total = 0, count;
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (read(fds[i], &count, sizeof(count)) == sizeof(count))
+	    total += count;
+    return total;
+}
@@ -0,0 +1,331 @@
+/*
+ * echoservere.c - A concurrent echo server based on an edge-triggered
+ *     reactor and non-blocking Rio. Unlike echoservers.c, a client that
+ *     sends half a line, or stops reading its replies, never stalls the
+ *     others: partial input waits in the client's rio_t and unsent
+ *     output in its rio_writer_t until the descriptor is ready again.
+ *
+ *     Built with "make URING=1", it runs on io_uring instead when the
+ *     kernel supports it: one multishot accept, one multishot receive
+ *     per client into a ring of provided buffers, and writes straight
+ *     out of those (registered) buffers, all submitted in batches.
+ */
+#include "csapp.h"
+#ifdef USE_URING
+#include "uring.h"
+#endif
+
+typedef struct {          /* Represents one connected client */
+    rio_t rio;            /* Partial input line */
+    rio_writer_t out;     /* Echoed bytes not yet sent */
+    int eof;              /* Client has closed its end */
+} client_t;
+
+void accept_clients(reactor_t *r, reactor_ev_t *ev, unsigned events);
+void echo_client(reactor_t *r, reactor_ev_t *ev, unsigned events);
+void close_client(reactor_t *r, reactor_ev_t *ev);
+#ifdef USE_URING
+int uring_echo(int listenfd);
+#endif
+
+int byte_cnt = 0; /* Counts total bytes received by server */
+
+int main(int argc, char **argv)
+{
+    int listenfd;
+    reactor_t reactor;
+
+    if (argc != 2) {
+	fprintf(stderr, "usage: %s <port>\n", argv[0]);
+	exit(0);
+    }
+    Signal(SIGPIPE, SIG_IGN);
+    listenfd = Open_listenfd(argv[1]);
+#ifdef USE_URING
+    uring_echo(listenfd); /* Returns only if io_uring can't be used */
+#endif
+    Reactor_init(&reactor);
+    Reactor_add(&reactor, listenfd, EPOLLIN, accept_clients, NULL);
+    Reactor_run(&reactor);
+    exit(0);
+}
+
+/*
+ * accept_clients - Accept every pending connection; with edge-triggered
+ *     readiness we get one event for however many are queued
+ */
+void accept_clients(reactor_t *r, reactor_ev_t *ev, unsigned events)
+{
+    int connfd;
+    client_t *c;
+
+    while ((connfd = accept(ev->fd, NULL, NULL)) >= 0) {
+	c = Malloc(sizeof(client_t));
+	Rio_readinitb(&c->rio, connfd);
+	Rio_writeinitb(&c->out, connfd);
+	c->eof = 0;
+	Reactor_add(r, connfd, EPOLLIN | EPOLLOUT,
+		    echo_client, c);
+    }
+    if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED)
+	unix_error("accept error");
+}
+
+/*
+ * echo_client - Echo whole lines for as long as the client has input
+ *     and our output buffer has room, then send what we have
+ */
+void echo_client(reactor_t *r, reactor_ev_t *ev, unsigned events)
+{
+    client_t *c = ev->arg;
+    char buf[MAXLINE];
+    size_t room;
+    ssize_t n;
+    int drained = 0;
+
+    for (;;) {
+	while (!c->eof && !drained &&
+	       (room = sizeof(c->out.rio_buf) - c->out.rio_cnt) > 1) {
+	    if ((n = rio_readlineb_nb(&c->rio, buf, room)) > 0) {
+		byte_cnt += n;
+		printf("Server received %d (%d total) bytes on fd %d\n",
+		       (int)n, byte_cnt, ev->fd);
+		Rio_writenb(&c->out, buf, n);  /* Fits, so no write yet */
+	    }
+	    else if (n == 0)
+		c->eof = 1;
+	    else if (errno == EAGAIN)
+		drained = 1;      /* Rest of the line hasn't arrived */
+	    else {
+		close_client(r, ev);
+		return;
+	    }
+	}
+
+	/* Send the echoed lines; if the client isn't reading, wait for
+	   the EPOLLOUT edge to bring us back here */
+	if (rio_flushb_nb(&c->out) < 0) {
+	    if (errno != EAGAIN)
+		close_client(r, ev);
+	    return;
+	}
+	if (c->eof) {
+	    close_client(r, ev);
+	    return;
+	}
+	if (drained)
+	    return;               /* Input drained, output sent */
+    }
+}
+
+void close_client(reactor_t *r, reactor_ev_t *ev)
+{
+    int connfd = ev->fd;
+
+    Free(ev->arg);
+    Reactor_del(r, ev);
+    Close(connfd);
+}
+
+#ifdef USE_URING
+#define URING_ENTRIES 256  /* Submission queue size */
+#define NBUFS   1024       /* Provided receive buffers (a power of 2) */
+#define BUFSIZE 4096       /* Bytes per receive buffer */
+
+/* What a completion is for, in the low bits of its user data; the
+   rest is the uclient_t, if any */
+#define OP_ACCEPT 0
+#define OP_RECV   1
+#define OP_WRITE  2
+#define OP_MASK   3
+
+typedef struct uclient {  /* One connected client on the io_uring path */
+    int fd;
+    int recving;          /* Multishot receive is armed */
+    int writing;          /* A write is in flight */
+    int closing;          /* Peer closed or failed: free once idle */
+    unsigned head, tail;  /* Received buffers not yet echoed, by ID */
+    unsigned short queue[NBUFS];
+    struct uclient *next; /* On the stalled list */
+} uclient_t;
+
+static uring_t ring;
+static uring_bufring_t bufs;
+static unsigned buflen[NBUFS], bufoff[NBUFS]; /* Per buffer ID */
+static uclient_t *stalled;  /* Clients whose receive ran out of buffers */
+
+static void uring_recv(uclient_t *c);
+static void uring_write(uclient_t *c);
+static void uring_done(uclient_t *c);
+static struct io_uring_sqe *get_sqe(void);
+
+/*
+ * uring_echo - Serve forever on io_uring, or return -1 right away if
+ *     this kernel can't do what we need
+ */
+int uring_echo(int listenfd)
+{
+    struct io_uring_cqe *cqe;
+    struct iovec iov;
+    uclient_t *c;
+    __u64 data;
+    unsigned flags, bid;
+    int res;
+
+    /* SEND_ZC arrived in 6.0 along with multishot receive, after
+       multishot accept and provided-buffer rings */
+    if (uring_init(&ring, URING_ENTRIES) < 0) {
+	fprintf(stderr, "io_uring unavailable (%s), using epoll\n",
+		strerror(errno));
+	return -1;
+    }
+    if (!uring_has_op(&ring, IORING_OP_SEND_ZC) ||
+	uring_bufring_init(&ring, &bufs, 0, NBUFS, BUFSIZE) < 0) {
+	fprintf(stderr, "io_uring too old, using epoll\n");
+	uring_free(&ring);
+	return -1;
+    }
+    iov.iov_base = bufs.bufs;
+    iov.iov_len = NBUFS * BUFSIZE;
+    if (uring_register_buffers(&ring, &iov, 1) < 0) {
+	fprintf(stderr, "io_uring can't register buffers (%s), using epoll\n",
+		strerror(errno));
+	uring_bufring_free(&ring, &bufs);
+	uring_free(&ring);
+	return -1;
+    }
+    uring_prep_accept(get_sqe(), listenfd, 1, OP_ACCEPT);
+
+    while (1) {
+	/* Submit everything queued by the last batch and wait */
+	if (uring_submit(&ring, 1, -1) < 0)
+	    unix_error("io_uring_enter error");
+
+	while ((cqe = uring_peek_cqe(&ring)) != NULL) {
+	    data = cqe->user_data;
+	    res = cqe->res;
+	    flags = cqe->flags;
+	    uring_cqe_seen(&ring);
+	    c = (uclient_t *)(unsigned long)(data & ~(__u64)OP_MASK);
+
+	    switch (data & OP_MASK) {
+	    case OP_ACCEPT:
+		if (res >= 0) {
+		    c = Malloc(sizeof(uclient_t));
+		    c->fd = res;
+		    c->recving = c->writing = c->closing = 0;
+		    c->head = c->tail = 0;
+		    uring_recv(c);
+		}
+		if (!(flags & IORING_CQE_F_MORE))
+		    uring_prep_accept(get_sqe(), listenfd, 1, OP_ACCEPT);
+		break;
+
+	    case OP_RECV:
+		if (res > 0) {
+		    bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		    buflen[bid] = res;
+		    bufoff[bid] = 0;
+		    c->queue[c->tail++ % NBUFS] = bid;
+		    byte_cnt += res;
+		    printf("Server received %d (%d total) bytes on fd %d\n",
+			   res, byte_cnt, c->fd);
+		    uring_write(c);
+		}
+		if (!(flags & IORING_CQE_F_MORE)) {
+		    c->recving = 0;
+		    if (res == -ENOBUFS) {  /* Retry once a write frees one */
+			c->next = stalled;
+			stalled = c;
+		    }
+		    else if (res > 0)
+			uring_recv(c);
+		    else
+			c->closing = 1;     /* EOF or error */
+		}
+		uring_done(c);
+		break;
+
+	    case OP_WRITE:
+		c->writing = 0;
+		bid = c->queue[c->head % NBUFS];
+		if (res <= 0) {
+		    /* Can't echo any more: stop receiving and drop the rest */
+		    shutdown(c->fd, SHUT_RDWR);
+		    c->closing = 1;
+		    for (; c->head != c->tail; c->head++)
+			uring_buf_recycle(&bufs, c->queue[c->head % NBUFS]);
+		}
+		else if ((bufoff[bid] += res) == buflen[bid]) {
+		    c->head++;
+		    uring_buf_recycle(&bufs, bid);
+		}
+		uring_write(c);
+
+		/* Buffers are back, so stalled receives can go again */
+		while (stalled) {
+		    uring_recv(stalled);
+		    stalled = stalled->next;
+		}
+		uring_done(c);
+		break;
+	    }
+	}
+    }
+}
+
+/*
+ * uring_recv - Arm c's multishot receive
+ */
+static void uring_recv(uclient_t *c)
+{
+    uring_prep_recv(get_sqe(), c->fd, bufs.bgid, 1,
+		    (unsigned long)c | OP_RECV);
+    c->recving = 1;
+}
+
+/*
+ * uring_write - Echo the oldest received buffer, unless a write is
+ *     already in flight; one at a time keeps the bytes in order
+ */
+static void uring_write(uclient_t *c)
+{
+    unsigned bid;
+
+    if (c->writing || c->head == c->tail)
+	return;
+    bid = c->queue[c->head % NBUFS];
+    uring_prep_write_fixed(get_sqe(), c->fd, uring_buf(&bufs, bid) + bufoff[bid],
+			   buflen[bid] - bufoff[bid], 0,
+			   (unsigned long)c | OP_WRITE);
+    c->writing = 1;
+}
+
+/*
+ * uring_done - Close and free c once it is closing and nothing of its
+ *     is in flight
+ */
+static void uring_done(uclient_t *c)
+{
+    uclient_t **pp;
+
+    if (!c->closing || c->recving || c->writing || c->head != c->tail)
+	return;
+    for (pp = &stalled; *pp; pp = &(*pp)->next)
+	if (*pp == c) {
+	    *pp = c->next;
+	    break;
+	}
+    Close(c->fd);
+    Free(c);
+}
+
+static struct io_uring_sqe *get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = uring_get_sqe(&ring)) == NULL)
+	unix_error("io_uring_enter error");
+    return sqe;
+}
+#endif /* USE_URING */
@@ -0,0 +1,56 @@
+/*
+ * cpool.h - Pools of persistent client connections with pipelined,
+ *     in-order requests, and an open_clientfd that remembers which
+ *     address worked for each host:port
+ */
+#ifndef __CPOOL_H__
+#define __CPOOL_H__
+
+#include "csapp.h"
+
+#define CPOOL_MAXPIPE   64   /* Most requests in flight per connection */
+#define CPOOL_ADDRCACHE 16   /* host:port pairs whose address we keep */
+#define CPOOL_ADDRTTL   60   /* Seconds before a kept address is looked up again */
+
+typedef struct cpool_conn cpool_conn_t;
+
+/* Completes one request by reading its response from rp, which is
+   NULL if the connection failed first; returns 0, or -1 if the
+   response is bad (the connection is then not reused) */
+typedef int (*cpool_done_fn)(cpool_conn_t *c, rio_t *rp, void *arg);
+
+/* A persistent connection, owned by one thread between get and put */
+struct cpool_conn {
+    int fd;
+    int broken;                  /* Failed: close it instead of reusing it */
+    rio_t in;                    /* Responses */
+    rio_writer_t out;            /* Requests not yet sent */
+    unsigned head, tail;         /* Requests sent but not yet completed */
+    struct {
+	cpool_done_fn fn;
+	void *arg;
+    } pending[CPOOL_MAXPIPE];
+    cpool_conn_t *next;          /* On the pool's idle list */
+};
+
+/* The connections to one server */
+typedef struct {
+    char *host, *port;
+    sem_t slots;                 /* Connections that may still be handed out */
+    sem_t mutex;                 /* Protects idle and nconnects */
+    cpool_conn_t *idle;          /* Open connections nobody is using */
+    unsigned long nconnects;     /* Connections opened so far */
+} cpool_t;
+
+int open_clientfd_cached(char *hostname, char *port);
+int Open_clientfd_cached(char *hostname, char *port);
+
+void cpool_init(cpool_t *p, char *host, char *port, int maxconns);
+void cpool_free(cpool_t *p);
+cpool_conn_t *cpool_get(cpool_t *p);
+void cpool_put(cpool_t *p, cpool_conn_t *c);
+int cpool_send(cpool_conn_t *c, void *req, size_t n,
+	       cpool_done_fn fn, void *arg);
+int cpool_wait(cpool_conn_t *c, int n);
+
+#endif /* __CPOOL_H__ */
@@ -0,0 +1,63 @@
+/*
+ * uring.h - A minimal io_uring interface built directly on the
+ *     io_uring_setup/enter/register system calls (no liburing)
+ */
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "csapp.h"
+#include <linux/io_uring.h>
+
+/* A submission/completion ring pair */
+typedef struct {
+    int fd;                      /* io_uring instance */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries;
+    unsigned sqe_tail;           /* Next SQE to hand out */
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;     /* For munmap() */
+    size_t sq_ring_sz, cq_ring_sz;
+    unsigned features;           /* IORING_FEAT_* from the kernel */
+    unsigned long nenter;        /* io_uring_enter() calls made */
+} uring_t;
+
+/* A ring of provided buffers that receives pick from (buffer select) */
+typedef struct {
+    struct io_uring_buf_ring *ring;
+    char *bufs;                  /* nbufs buffers of bufsize bytes */
+    unsigned nbufs, bufsize;
+    unsigned short bgid;         /* Buffer group ID */
+    unsigned short tail;         /* Next ring slot to refill */
+} uring_bufring_t;
+
+int uring_init(uring_t *u, unsigned entries);
+void uring_free(uring_t *u);
+int uring_has_op(uring_t *u, int op);
+struct io_uring_sqe *uring_get_sqe(uring_t *u);
+int uring_submit(uring_t *u, unsigned wait_nr, int timeout_ms);
+struct io_uring_cqe *uring_peek_cqe(uring_t *u);
+void uring_cqe_seen(uring_t *u);
+
+/* Registered buffers and provided-buffer rings */
+int uring_register_buffers(uring_t *u, struct iovec *iov, unsigned n);
+int uring_bufring_init(uring_t *u, uring_bufring_t *br, unsigned short bgid,
+		       unsigned nbufs, unsigned bufsize);
+void uring_bufring_free(uring_t *u, uring_bufring_t *br);
+char *uring_buf(uring_bufring_t *br, unsigned bid);
+void uring_buf_recycle(uring_bufring_t *br, unsigned bid);
+
+/* Filling in submission entries */
+void uring_prep_accept(struct io_uring_sqe *sqe, int fd, int multishot,
+		       __u64 data);
+void uring_prep_recv(struct io_uring_sqe *sqe, int fd, unsigned short bgid,
+		     int multishot, __u64 data);
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int fd, void *buf,
+			    unsigned len, unsigned short bufindex, __u64 data);
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events,
+		     int multishot, __u64 data);
+void uring_prep_poll_remove(struct io_uring_sqe *sqe, __u64 target,
+			    __u64 data);
+
+#endif /* __URING_H__ */
@@ -0,0 +1,155 @@
+/*
+ * rioperf.c - Measure line-reading throughput of the Rio package
+ *
+ *     usage: rioperf [-m megabytes] [-l linelen]
+ *
+ *     Writes a scratch file of text lines averaging linelen bytes,
+ *     then reads it back (from the page cache) three ways: with the
+ *     textbook byte-at-a-time rio_readlineb, with the current one that
+ *     scans the buffer with memchr, and with the zero-copy
+ *     rio_readlinep. Prints MB/s and ns/line for each.
+ */
+#include "csapp.h"
+
+typedef ssize_t (*readline_fn)(rio_t *rp, char *buf);
+
+static ssize_t book_read(rio_t *rp, char *usrbuf, size_t n);
+static ssize_t old_readline(rio_t *rp, char *buf);
+static ssize_t new_readline(rio_t *rp, char *buf);
+static ssize_t zc_readline(rio_t *rp, char *buf);
+static void run(const char *name, int fd, size_t size, readline_fn fn);
+
+int main(int argc, char **argv)
+{
+    int c, fd, mbytes = 64, linelen = 64;
+    size_t size = 0, n, i;
+    char path[] = "/tmp/rioperfXXXXXX", line[MAXLINE];
+
+    while ((c = getopt(argc, argv, "m:l:")) != -1) {
+	if (c == 'm')
+	    mbytes = atoi(optarg);
+	else if (c == 'l')
+	    linelen = atoi(optarg);
+	else {
+	    fprintf(stderr, "usage: %s [-m megabytes] [-l linelen]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (mbytes < 1 || linelen < 2 || linelen > MAXLINE / 2)
+	app_error("rioperf: bad size");
+
+    /* Lines of varying length around linelen */
+    if ((fd = mkstemp(path)) < 0)
+	unix_error("mkstemp error");
+    unlink(path);
+    srandom(1);
+    while (size < (size_t)mbytes << 20) {
+	n = linelen / 2 + random() % linelen;
+	for (i = 0; i < n - 1; i++)
+	    line[i] = 'a' + random() % 26;
+	line[n - 1] = '\n';
+	Rio_writen(fd, line, n);
+	size += n;
+    }
+
+    run("byte-at-a-time", fd, size, old_readline);
+    run("memchr", fd, size, new_readline);
+    run("zero-copy", fd, size, zc_readline);
+    Close(fd);
+    exit(0);
+}
+
+static void run(const char *name, int fd, size_t size, readline_fn fn)
+{
+    rio_t rio;
+    char buf[MAXLINE];
+    size_t total = 0, lines = 0;
+    ssize_t n;
+    struct timeval start, end;
+    double secs;
+
+    Lseek(fd, 0, SEEK_SET);
+    Rio_readinitb(&rio, fd);
+    gettimeofday(&start, NULL);
+    while ((n = fn(&rio, buf)) > 0) {
+	total += n;
+	lines++;
+    }
+    gettimeofday(&end, NULL);
+    if (n < 0 || total != size)
+	app_error("rioperf: short read");
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("%-15s %8.0f MB/s %7.1f ns/line\n", name,
+	   total / secs / (1 << 20), secs * 1e9 / lines);
+}
+
+/*
+ * book_read - rio_read as it appears in the book (csapp.c keeps its
+ *     own copy private): refill the internal buffer when it is empty,
+ *     then copy min(n, rio_cnt) bytes out of it
+ */
+static ssize_t book_read(rio_t *rp, char *usrbuf, size_t n)
+{
+    int cnt;
+
+    while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
+	rp->rio_cnt = read(rp->rio_fd, rp->rio_base, rp->rio_bufsize);
+	if (rp->rio_cnt < 0) {
+	    if (errno != EINTR) /* Interrupted by sig handler return */
+		return -1;
+	}
+	else if (rp->rio_cnt == 0)  /* EOF */
+	    return 0;
+	else
+	    rp->rio_bufptr = rp->rio_base; /* Reset buffer ptr */
+    }
+
+    /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
+    cnt = n;
+    if (rp->rio_cnt < n)
+	cnt = rp->rio_cnt;
+    memcpy(usrbuf, rp->rio_bufptr, cnt);
+    rp->rio_bufptr += cnt;
+    rp->rio_cnt -= cnt;
+    return cnt;
+}
+
+/*
+ * old_readline - rio_readlineb as it appears in the book, calling
+ *     book_read() once per byte
+ */
+static ssize_t old_readline(rio_t *rp, char *buf)
+{
+    int n, rc;
+    char c, *bufp = buf;
+
+    for (n = 1; n < MAXLINE; n++) {
+	if ((rc = book_read(rp, &c, 1)) == 1) {
+	    *bufp++ = c;
+	    if (c == '\n') {
+		n++;
+		break;
+	    }
+	} else if (rc == 0) {
+	    if (n == 1)
+		return 0;
+	    else
+		break;
+	} else
+	    return -1;
+    }
+    *bufp = 0;
+    return n - 1;
+}
+
+static ssize_t new_readline(rio_t *rp, char *buf)
+{
+    return rio_readlineb(rp, buf, MAXLINE);
+}
+
+static ssize_t zc_readline(rio_t *rp, char *buf)
+{
+    char *line;
+
+    return rio_readlinep(rp, &line);
+}
@@ -0,0 +1,469 @@
+/*
+ * httpbench.c - A multi-threaded HTTP load generator and latency
+ *     benchmark for Tiny (or any HTTP/1.1 server)
+ *
+ *     usage: httpbench [-c conns] [-d secs] [-P depth] [-k] [-p serverpid]
+ *                      <host> <port> [weight:]<uri> ...
+ *
+ *     Each of the conns connections is driven by its own thread in a
+ *     closed loop for secs seconds: send depth pipelined requests,
+ *     wait for all of their responses, repeat. Without -k every batch
+ *     uses a fresh connection (and depth is 1). Requests cycle through
+ *     the URIs in proportion to their weights (default 1), so e.g.
+ *     "9:/home.html 1:/cgi-bin/adder?1&2" is a 90/10 static/CGI mix.
+ *
+ *     Reports throughput, response classes and latency percentiles,
+ *     overall and per URI, plus the server's CPU time and system calls
+ *     per request if its pid is given with -p. Syscalls are counted
+ *     with the raw_syscalls:sys_enter tracepoint, so tracefs must be
+ *     mounted (as root: "mount -t tracefs nodev /sys/kernel/tracing").
+ */
+/* $begin httpbench */
+#include "csapp.h"
+#include <stdint.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define MAXURIS  16      /* Most distinct URIs in a mix */
+#define MAXDEPTH 64      /* Deepest pipeline */
+#define MAXTHREADS 1024  /* Most server threads whose syscalls we count */
+
+/* One completed request */
+typedef struct {
+    uint64_t ns;         /* Latency: batch sent to response complete */
+    int uri;             /* Index into uris[] */
+} sample_t;
+
+/* Per-connection (per-thread) results */
+typedef struct {
+    int id;
+    long status[6];      /* Responses by class, status[2] = 2xx etc. */
+    long errors;         /* Failed connects, writes and bad responses */
+    double bytes;        /* Response body bytes */
+    sample_t *samples;   /* Completed requests, in order */
+    size_t nsamples, maxsamples;
+} worker_t;
+
+/* The test, shared read-only by all threads */
+static char *host, *port;
+static char *uris[MAXURIS];        /* URIs in the mix */
+static char *reqs[MAXURIS];        /* Prebuilt request for each */
+static size_t reqlens[MAXURIS];
+static int nuris;
+static int *sched, nsched;         /* Weighted order of URIs to request */
+static int depth = 1, keepalive = 0;
+static uint64_t deadline;          /* When to stop, in now_ns() time */
+
+void build_schedule(int *weights);
+void *worker(void *vargp);
+ssize_t read_response(rio_t *rp, int *status, int *closed);
+void add_sample(worker_t *w, uint64_t ns, int uri);
+int cmp_samples(const void *a, const void *b);
+void print_latency(char *label, sample_t *s, size_t n);
+uint64_t now_ns(void);
+long proc_cputicks(pid_t pid);
+int syscount_open(pid_t pid, int *fds);
+long long syscount_read(int *fds, int n);
+
+int main(int argc, char **argv)
+{
+    int c, i, j, conns = 16, secs = 5, weight, weights[MAXURIS];
+    long nreqs = 0, ticks0 = 0, ticks1 = 0;
+    long long calls = -1;
+    int nfds = 0, fds[MAXTHREADS];
+    pid_t serverpid = 0;
+    pthread_t *tids;
+    worker_t *workers;
+    sample_t *all, *sub;
+    size_t nall = 0, nsub;
+    double bytes = 0, elapsed;
+    long status[6] = {0}, errors = 0;
+    uint64_t start;
+    char *p, label[MAXLINE];
+
+    while ((c = getopt(argc, argv, "c:d:P:kp:")) != -1) {
+	switch (c) {
+	case 'c':
+	    conns = atoi(optarg);
+	    break;
+	case 'd':
+	    secs = atoi(optarg);
+	    break;
+	case 'P':
+	    depth = atoi(optarg);
+	    keepalive = 1;
+	    break;
+	case 'k':
+	    keepalive = 1;
+	    break;
+	case 'p':
+	    serverpid = atoi(optarg);
+	    break;
+	default:
+	    optind = argc; /* force the usage message */
+	}
+    }
+    if (argc - optind < 3 || argc - optind - 2 > MAXURIS ||
+	conns < 1 || secs < 1 || depth < 1 || depth > MAXDEPTH) {
+	fprintf(stderr, "usage: %s [-c conns] [-d secs] [-P depth] [-k] "
+		"[-p serverpid] <host> <port> [weight:]<uri> ...\n", argv[0]);
+	exit(1);
+    }
+    if (!keepalive)
+	depth = 1;
+    host = argv[optind];
+    port = argv[optind+1];
+
+    /* Parse the mix and prebuild each request */
+    for (i = optind + 2; i < argc; i++) {
+	weight = 1;
+	p = argv[i];
+	if (isdigit(*p) && (p = strchr(p, ':')) && p[1] == '/') {
+	    weight = atoi(argv[i]);
+	    p++;
+	}
+	else
+	    p = argv[i];
+	uris[nuris] = p;
+	weights[nuris] = weight > 0 ? weight : 1;
+	reqs[nuris] = Malloc(MAXLINE);
+	reqlens[nuris] = snprintf(reqs[nuris], MAXLINE,
+				  "GET %s HTTP/1.1\r\nHost: %s:%s\r\n%s\r\n",
+				  p, host, port,
+				  keepalive ? "" : "Connection: close\r\n");
+	nsched += weights[nuris];
+	nuris++;
+    }
+
+    build_schedule(weights);
+
+    printf("%d s test of http://%s:%s, %d connections, %s",
+	   secs, host, port, conns, keepalive ? "keep-alive" : "close");
+    if (depth > 1)
+	printf(", pipeline depth %d", depth);
+    printf("\n");
+
+    Signal(SIGPIPE, SIG_IGN);   /* A server that hangs up is an error, not a crash */
+    if (serverpid > 0) {
+	if ((nfds = syscount_open(serverpid, fds)) < 0)
+	    fprintf(stderr, "httpbench: can't count syscalls: %s\n",
+		    strerror(errno));
+	ticks0 = proc_cputicks(serverpid);
+    }
+    start = now_ns();
+    deadline = start + (uint64_t)secs * 1000000000;
+    tids = Malloc(conns * sizeof(pthread_t));
+    workers = Calloc(conns, sizeof(worker_t));
+    for (i = 0; i < conns; i++) {
+	workers[i].id = i;
+	Pthread_create(&tids[i], NULL, worker, &workers[i]);
+    }
+    for (i = 0; i < conns; i++)
+	Pthread_join(tids[i], NULL);
+    elapsed = (now_ns() - start) / 1e9;
+    if (serverpid > 0) {
+	ticks1 = proc_cputicks(serverpid);
+	if (nfds > 0)
+	    calls = syscount_read(fds, nfds);
+    }
+
+    /* Merge the workers' results */
+    for (i = 0; i < conns; i++) {
+	for (j = 0; j < 6; j++)
+	    status[j] += workers[i].status[j];
+	errors += workers[i].errors;
+	bytes += workers[i].bytes;
+	nall += workers[i].nsamples;
+    }
+    all = Malloc((nall + 1) * sizeof(sample_t));
+    sub = Malloc((nall + 1) * sizeof(sample_t));
+    for (nall = 0, i = 0; i < conns; i++) {
+	memcpy(all + nall, workers[i].samples,
+	       workers[i].nsamples * sizeof(sample_t));
+	nall += workers[i].nsamples;
+	free(workers[i].samples);
+    }
+    nreqs = nall;
+
+    printf("Requests:   %ld in %.2f s, %.0f req/s, %.1f MB/s\n",
+	   nreqs, elapsed, nreqs / elapsed, bytes / elapsed / 1e6);
+    printf("Responses:  2xx %ld, 3xx %ld, 4xx %ld, 5xx %ld, errors %ld\n",
+	   status[2], status[3], status[4], status[5], errors);
+    qsort(all, nall, sizeof(sample_t), cmp_samples);
+    print_latency("Latency us:", all, nall);
+    if (nuris > 1) {
+	for (i = 0; i < nuris; i++) {
+	    for (nsub = 0, j = 0; j < nall; j++)
+		if (all[j].uri == i)
+		    sub[nsub++] = all[j];
+	    snprintf(label, MAXLINE, "  %s (%zu):", uris[i], nsub);
+	    print_latency(label, sub, nsub);
+	}
+    }
+    if (serverpid > 0 && nreqs > 0) {
+	printf("Server CPU: %.1f us/req",
+	       (ticks1 - ticks0) * 1e6 / sysconf(_SC_CLK_TCK) / nreqs);
+	if (calls >= 0)
+	    printf(", %.2f syscalls/req", (double)calls / nreqs);
+	printf("\n");
+    }
+    exit(0);
+}
+/* $end httpbench */
+
+/*
+ * build_schedule - fill sched[] with URI indices in proportion to
+ *     their weights, interleaved rather than each weight's worth in a
+ *     row: each slot goes to the URI whose share is furthest behind
+ */
+void build_schedule(int *weights)
+{
+    int i, j, best, sent[MAXURIS] = {0};
+
+    sched = Malloc(nsched * sizeof(int));
+    for (j = 0; j < nsched; j++) {
+	for (best = 0, i = 1; i < nuris; i++)
+	    if (sent[i] * weights[best] < sent[best] * weights[i])
+		best = i;
+	sched[j] = best;
+	sent[best]++;
+    }
+}
+
+/*
+ * worker - drive one connection until the deadline
+ */
+void *worker(void *vargp)
+{
+    worker_t *w = vargp;
+    int fd = -1, i, n, status, closed, batch[MAXDEPTH];
+    int next = (w->id * 7) % nsched;   /* Don't start every thread alike */
+    char *buf = Malloc(MAXDEPTH * MAXLINE);
+    size_t len;
+    ssize_t rc;
+    uint64_t t0;
+    rio_t rio;
+
+    while (now_ns() < deadline) {
+	if (fd < 0) {
+	    if ((fd = open_clientfd(host, port)) < 0) {
+		w->errors++;
+		usleep(1000);
+		continue;
+	    }
+	    rio_readinitb(&rio, fd);
+	}
+
+	/* Send the next batch in one write */
+	for (len = 0, n = 0; n < depth; n++) {
+	    batch[n] = sched[next];
+	    next = (next + 1) % nsched;
+	    memcpy(buf + len, reqs[batch[n]], reqlens[batch[n]]);
+	    len += reqlens[batch[n]];
+	}
+	t0 = now_ns();
+	if (rio_writen(fd, buf, len) < 0) {
+	    w->errors++;
+	    Close(fd);
+	    fd = -1;
+	    continue;
+	}
+
+	/* Collect the responses in order */
+	for (i = 0; i < n; i++) {
+	    if ((rc = read_response(&rio, &status, &closed)) < 0) {
+		w->errors++;
+		closed = 1;
+		break;
+	    }
+	    add_sample(w, now_ns() - t0, batch[i]);
+	    w->status[status / 100 < 6 ? status / 100 : 0]++;
+	    w->bytes += rc;
+	    if (closed)  /* The rest of the batch is lost; not an error */
+		break;
+	}
+	if (closed || !keepalive) {
+	    Close(fd);
+	    fd = -1;
+	}
+    }
+    if (fd >= 0)
+	Close(fd);
+    Free(buf);
+    return NULL;
+}
+
+/*
+ * read_response - read one response from rp; return its body length,
+ *     or -1 if it is malformed or the connection fails. *closed is set
+ *     if the server ends the connection after it.
+ */
+ssize_t read_response(rio_t *rp, int *status, int *closed)
+{
+    char buf[MAXLINE];
+    ssize_t len = -1, n = 0, rc;
+
+    *closed = 0;
+    if (rio_readlineb(rp, buf, MAXLINE) <= 0 ||
+	sscanf(buf, "HTTP/1.%*d %d", status) != 1)
+	return -1;
+    while (1) {
+	if (rio_readlineb(rp, buf, MAXLINE) <= 0)
+	    return -1;
+	if (!strcmp(buf, "\r\n"))
+	    break;
+	if (!strncasecmp(buf, "Content-length:", 15))
+	    len = atol(buf + 15);
+	else if (!strncasecmp(buf, "Connection:", 11) && strstr(buf, "close"))
+	    *closed = 1;
+    }
+
+    /* Without a length the body runs until the server closes */
+    if (len < 0)
+	*closed = 1;
+    while (len < 0 || n < len) {
+	rc = rio_readnb(rp, buf, (len < 0 || len - n > MAXLINE) ?
+			MAXLINE : len - n);
+	if (rc < 0 || (rc == 0 && len >= 0))
+	    return -1;
+	if (rc == 0)
+	    break;
+	n += rc;
+    }
+    return n;
+}
+
+/*
+ * add_sample - record a request's latency, growing w's array as needed
+ */
+void add_sample(worker_t *w, uint64_t ns, int uri)
+{
+    if (w->nsamples == w->maxsamples) {
+	w->maxsamples = w->maxsamples ? 2 * w->maxsamples : 4096;
+	w->samples = Realloc(w->samples, w->maxsamples * sizeof(sample_t));
+    }
+    w->samples[w->nsamples].ns = ns;
+    w->samples[w->nsamples].uri = uri;
+    w->nsamples++;
+}
+
+int cmp_samples(const void *a, const void *b)
+{
+    uint64_t x = ((sample_t *)a)->ns, y = ((sample_t *)b)->ns;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * print_latency - print percentiles of the n sorted samples in s
+ */
+void print_latency(char *label, sample_t *s, size_t n)
+{
+    static const double pct[] = { 50, 90, 99, 99.9 };
+    int i;
+
+    printf("%s", label);
+    if (n == 0) {
+	printf(" no requests\n");
+	return;
+    }
+    printf(" min %.0f", s[0].ns / 1e3);
+    for (i = 0; i < 4; i++)
+	printf("  p%g %.0f", pct[i], s[(size_t)(n * pct[i] / 100)].ns / 1e3);
+    printf("  max %.0f\n", s[n-1].ns / 1e3);
+}
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * proc_cputicks - user+system time consumed so far by process pid
+ *     and its reaped children (e.g. CGI programs), in clock ticks
+ */
+long proc_cputicks(pid_t pid)
+{
+    char path[MAXLINE], buf[MAXLINE], *p;
+    long utime, stime, cutime, cstime;
+    FILE *fp;
+
+    snprintf(path, MAXLINE, "/proc/%d/stat", (int)pid);
+    fp = Fopen(path, "r");
+    Fgets(buf, MAXLINE, fp);
+    Fclose(fp);
+
+    /* Skip "pid (comm) state"; comm may contain blanks */
+    if (!(p = strrchr(buf, ')')) ||
+	sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+	       "%ld %ld %ld %ld", &utime, &stime, &cutime, &cstime) != 4)
+	app_error("httpbench: bad /proc stat line");
+    return utime + stime + cutime + cstime;
+}
+
+/*
+ * syscount_open - start counting the system calls made by every
+ *     thread of process pid, with one tracepoint counter per thread
+ *     in fds; returns the number of counters, or -1
+ */
+int syscount_open(pid_t pid, int *fds)
+{
+    struct perf_event_attr attr;
+    char path[MAXLINE];
+    struct dirent *de;
+    FILE *fp;
+    DIR *dir;
+    int id, n = 0;
+
+    if ((fp = fopen("/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		    "r")) == NULL &&
+	(fp = fopen("/sys/kernel/debug/tracing/events/raw_syscalls/"
+		    "sys_enter/id", "r")) == NULL)
+	return -1;
+    if (fscanf(fp, "%d", &id) != 1) {
+	fclose(fp);
+	errno = EINVAL;
+	return -1;
+    }
+    fclose(fp);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    snprintf(path, MAXLINE, "/proc/%d/task", (int)pid);
+    if ((dir = opendir(path)) == NULL)
+	return -1;
+    while ((de = readdir(dir)) != NULL && n < MAXTHREADS) {
+	if (de->d_name[0] == '.')
+	    continue;
+	if ((fds[n] = syscall(__NR_perf_event_open, &attr,
+			      atoi(de->d_name), -1, -1, 0)) < 0) {
+	    closedir(dir);
+	    while (n > 0)
+		close(fds[--n]);
+	    return -1;
+	}
+	n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/*
+ * syscount_read - total of the n counters in fds
+ */
+long long syscount_read(int *fds, int n)
+{
+    long long total = 0, count;
+    int i;
+
+    for (i = 0; i < n; i++)
+	if (read(fds[i], &count, sizeof(count)) == sizeof(count))
+	    total += count;
+    return total;
+}
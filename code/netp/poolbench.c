@@ -0,0 +1,173 @@
+/*
+ * poolbench.c - Compare ways for a client to talk to an echo server
+ *
+ *     usage: poolbench [-t threads] [-d secs] [-P depth] <host> <port>
+ *
+ *     Each of the threads sends 32-byte lines for secs seconds, one
+ *     mode after another:
+ *
+ *       connect    open_clientfd, one line, close (a lookup and a
+ *                  handshake per request)
+ *       cached     the same with open_clientfd_cached
+ *       pooled     one line per round trip on a pooled connection
+ *       pipelined  depth lines per round trip on a pooled connection
+ *
+ *     and reports requests per second and connections opened for each.
+ *     Meant to run against conc/echoservere ("make bench-pool").
+ */
+#include "csapp.h"
+#include "cpool.h"
+#include <time.h>
+
+#define LINELEN 32
+
+enum { CONNECT, CACHED, POOLED, PIPELINED, NMODES };
+static const char *modenames[NMODES] =
+    { "connect", "cached", "pooled", "pipelined" };
+
+static char *host, *port;
+static char line[LINELEN];
+static int mode, depth = 16;
+static volatile int stop;
+static cpool_t pool;
+static unsigned long connects;   /* Opened by the unpooled modes */
+static sem_t mutex;              /* Protects connects */
+
+void *worker(void *vargp);
+static int check_echo(cpool_conn_t *c, rio_t *rp, void *arg);
+static int echo_once(int pooled);
+static double now(void);
+
+int main(int argc, char **argv)
+{
+    int c, i, threads = 16, secs = 2;
+    long total, *counts;
+    pthread_t *tids;
+    double start, elapsed;
+
+    while ((c = getopt(argc, argv, "t:d:P:")) != -1) {
+	if (c == 't')
+	    threads = atoi(optarg);
+	else if (c == 'd')
+	    secs = atoi(optarg);
+	else if (c == 'P')
+	    depth = atoi(optarg);
+	else
+	    goto usage;
+    }
+    if (argc - optind != 2) {
+    usage:
+	fprintf(stderr, "usage: %s [-t threads] [-d secs] [-P depth] "
+		"<host> <port>\n", argv[0]);
+	exit(1);
+    }
+    host = argv[optind];
+    port = argv[optind + 1];
+    if (threads < 1 || secs < 1 || depth < 1 || depth > CPOOL_MAXPIPE)
+	app_error("poolbench: bad option value");
+
+    for (i = 0; i < LINELEN - 1; i++)
+	line[i] = 'a' + i % 26;
+    line[LINELEN - 1] = '\n';
+    Sem_init(&mutex, 0, 1);
+    tids = Malloc(threads * sizeof(pthread_t));
+    counts = Calloc(threads, sizeof(long));
+
+    for (mode = 0; mode < NMODES; mode++) {
+	cpool_init(&pool, host, port, threads);
+	connects = 0;
+	stop = 0;
+	start = now();
+	for (i = 0; i < threads; i++) {
+	    counts[i] = 0;
+	    Pthread_create(&tids[i], NULL, worker, &counts[i]);
+	}
+	sleep(secs);
+	stop = 1;
+	for (total = 0, i = 0; i < threads; i++) {
+	    Pthread_join(tids[i], NULL);
+	    if (counts[i] < 0)
+		app_error("poolbench: bad echo");
+	    total += counts[i];
+	}
+	elapsed = now() - start;
+	printf("%-10s %9.0f req/s %8lu connections\n", modenames[mode],
+	       total / elapsed, connects + pool.nconnects);
+	cpool_free(&pool);
+    }
+    exit(0);
+}
+
+/*
+ * worker - Count the requests echoed back until told to stop; the count
+ *     is -1 if an echo came back wrong
+ */
+void *worker(void *vargp)
+{
+    long *count = vargp;
+    cpool_conn_t *c;
+    int i, rc;
+
+    while (!stop) {
+	if (mode == CONNECT || mode == CACHED) {
+	    if (echo_once(mode == CACHED) < 0)
+		goto fail;
+	    (*count)++;
+	    continue;
+	}
+	if ((c = cpool_get(&pool)) == NULL)
+	    goto fail;
+	for (i = 0; i < (mode == PIPELINED ? depth : 1); i++)
+	    cpool_send(c, line, LINELEN, check_echo, NULL);
+	rc = cpool_wait(c, -1);
+	cpool_put(&pool, c);
+	if (rc < 0)
+	    goto fail;
+	*count += rc;
+    }
+    return NULL;
+
+ fail:
+    *count = -1;
+    return NULL;
+}
+
+/* Completion callback: the response must be the line we sent */
+static int check_echo(cpool_conn_t *c, rio_t *rp, void *arg)
+{
+    char *echo;
+
+    if (rp == NULL || rio_readlinep(rp, &echo) != LINELEN ||
+	memcmp(echo, line, LINELEN))
+	return -1;
+    return 0;
+}
+
+/* One request on a connection of its own */
+static int echo_once(int cached)
+{
+    rio_t rio;
+    int fd, rc = 0;
+    char *echo;
+
+    if ((fd = cached ? open_clientfd_cached(host, port)
+	            : open_clientfd(host, port)) < 0)
+	return -1;
+    P(&mutex);
+    connects++;
+    V(&mutex);
+    Rio_readinitb(&rio, fd);
+    if (rio_writen(fd, line, LINELEN) != LINELEN ||
+	rio_readlinep(&rio, &echo) != LINELEN || memcmp(echo, line, LINELEN))
+	rc = -1;
+    Close(fd);
+    return rc;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,408 @@
+/*
+ * cache.c - Open-file cache for Tiny's static content
+ *
+ * Files are kept open, keyed by the path that parse_uri() produced,
+ * together with their size, mtime, MIME type, entity tag and prebuilt
+ * response headers, so a hit costs no stat(), open() or path lookup at
+ * all. The table holds at most CACHE_MAXENTRIES files and evicts with
+ * the CLOCK algorithm.
+ *
+ * Rather than checking mtimes on every hit, each cached file carries
+ * an inotify watch, and the event loops call cache_invalidate() when
+ * cache_notifyfd() becomes readable. Files that can't be watched are
+ * simply not cached. Entries are also hashed by watch descriptor, so
+ * an event finds the entries it concerns directly.
+ *
+ * The cache also remembers files that don't exist, by watching the
+ * directory they would be created in, and can link an entry to one
+ * variant of it (Tiny's precompressed <file>.gz, or its absence), so
+ * that finding the variant takes no lookup of its own.
+ *
+ * Several event loops may be sending the same file at once, so
+ * entries are reference counted: an entry that is evicted or
+ * invalidated while in use leaves the table right away and is closed
+ * by the last cache_release().
+ */
+#include "cache.h"
+#include <sys/inotify.h>
+
+#define NBUCKETS (2 * CACHE_MAXENTRIES) /* Must be a power of 2 */
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | \
+		    IN_CREATE | IN_MOVED_TO) /* The last two for directories */
+
+static struct cache_entry *buckets[NBUCKETS];      /* Hash table */
+static struct cache_entry *watches[NBUCKETS];      /* Same, by watch */
+static struct cache_entry *slots[CACHE_MAXENTRIES]; /* CLOCK ring */
+static int hand;                                    /* CLOCK hand */
+static int notifyfd = -1;                           /* inotify instance */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned hash_path(const char *path);
+static struct cache_entry *find_entry(const char *path);
+static struct cache_entry *find_watch(int wd);
+static int same_version(struct stat *a, struct stat *b);
+static int unchanged(const char *path, int fd, struct stat *sbuf);
+static int missing(const char *path);
+static struct cache_entry *new_entry(const char *path, int fd);
+static void add_entry(struct cache_entry *e, const char *watchpath,
+		      struct stat *sbuf);
+static int find_slot(void);
+static void unlink_entry(struct cache_entry *e);
+static void put_entry(struct cache_entry *e);
+
+/*
+ * cache_init - set up an empty cache. If inotify is unavailable,
+ *     nothing is ever cached.
+ */
+void cache_init(void)
+{
+    if ((notifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+	fprintf(stderr, "inotify_init1 error: %s (file cache disabled)\n",
+		strerror(errno));
+}
+
+/*
+ * cache_notifyfd - descriptor that is readable when cache_invalidate()
+ *     has work to do, or -1
+ */
+int cache_notifyfd(void)
+{
+    return notifyfd;
+}
+
+/*
+ * cache_lookup - return the entry for path, or NULL on a miss. The
+ *     caller must hand a hit back with cache_release().
+ */
+struct cache_entry *cache_lookup(const char *path)
+{
+    struct cache_entry *e;
+
+    pthread_mutex_lock(&lock);
+    if ((e = find_entry(path)) != NULL) {
+	e->refbit = 1;
+	e->refcnt++;
+    }
+    pthread_mutex_unlock(&lock);
+    return e;
+}
+
+/*
+ * cache_insert - wrap the open file fd, which the entry takes over,
+ *     in an entry for path and try to add it to the cache. The entry
+ *     is returned either way and must be handed back with
+ *     cache_release(); if it couldn't be cached, that closes fd.
+ */
+struct cache_entry *cache_insert(const char *path, int fd, struct stat *sbuf,
+				 const char *filetype, const char *etag,
+				 char *hdrs, size_t hdrlen)
+{
+    struct cache_entry *e = new_entry(path, fd);
+
+    e->size = sbuf->st_size;
+    e->mtime = sbuf->st_mtime;
+    e->filetype = filetype;
+    snprintf(e->etag, CACHE_MAXETAG, "%s", etag);
+    e->hdrs = Malloc(hdrlen);
+    memcpy(e->hdrs, hdrs, hdrlen);
+    e->hdrlen = hdrlen;
+    add_entry(e, path, sbuf);
+    return e;
+}
+
+/*
+ * cache_insert_missing - make an entry saying that there is no file
+ *     path and try to add it to the cache, watching the directory it
+ *     would be in. Hand it back with cache_release().
+ */
+struct cache_entry *cache_insert_missing(const char *path)
+{
+    struct cache_entry *e = new_entry(path, -1);
+    char dir[MAXLINE];
+    const char *slash = strrchr(path, '/');
+
+    if (!slash)
+	strcpy(dir, ".");
+    else if (slash - path < MAXLINE)
+	snprintf(dir, MAXLINE, "%.*s", (int)(slash - path + 1), path);
+    else
+	return e;
+    add_entry(e, dir, NULL);
+    return e;
+}
+
+/*
+ * cache_variant - return the entry that cache_set_variant() linked
+ *     to e, or NULL if there is none (or no longer one). The caller
+ *     must hand a hit back with cache_release().
+ */
+struct cache_entry *cache_variant(struct cache_entry *e)
+{
+    struct cache_entry *v;
+
+    pthread_mutex_lock(&lock);
+    if ((v = e->variant) != NULL) {
+	v->refbit = 1;
+	v->refcnt++;
+    }
+    pthread_mutex_unlock(&lock);
+    return v;
+}
+
+/*
+ * cache_set_variant - link v to e, if both are cached and neither is
+ *     linked yet. The link lasts until either leaves the cache.
+ */
+void cache_set_variant(struct cache_entry *e, struct cache_entry *v)
+{
+    pthread_mutex_lock(&lock);
+    if (e->slot >= 0 && v->slot >= 0 && !e->variant && !v->owner) {
+	e->variant = v;
+	v->owner = e;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * cache_release - give back an entry from cache_lookup() or
+ *     cache_insert()
+ */
+void cache_release(struct cache_entry *e)
+{
+    pthread_mutex_lock(&lock);
+    put_entry(e);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * cache_invalidate - drop every entry whose file has changed since it
+ *     was cached, or every entry if events were lost
+ */
+void cache_invalidate(void)
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    struct cache_entry *e;
+    ssize_t n;
+    char *p;
+    int i;
+
+    while ((n = read(notifyfd, buf, sizeof(buf))) > 0) {
+	pthread_mutex_lock(&lock);
+	for (p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+	    ev = (struct inotify_event *)p;
+	    if (ev->mask & IN_Q_OVERFLOW) {  /* Any file may have changed */
+		for (i = 0; i < CACHE_MAXENTRIES; i++)
+		    if (slots[i])
+			unlink_entry(slots[i]);
+		continue;
+	    }
+	    /* Two paths that name the same file share one watch */
+	    while ((e = find_watch(ev->wd)) != NULL)
+		unlink_entry(e);
+	}
+	pthread_mutex_unlock(&lock);
+    }
+}
+
+/*
+ * hash_path - FNV-1a hash of path, reduced to a bucket index
+ */
+static unsigned hash_path(const char *path)
+{
+    unsigned h = 2166136261u;
+
+    while (*path)
+	h = (h ^ (unsigned char)*path++) * 16777619u;
+    return h & (NBUCKETS - 1);
+}
+
+/*
+ * find_entry - return the cached entry for path, or NULL. Caller
+ *     holds the lock.
+ */
+static struct cache_entry *find_entry(const char *path)
+{
+    struct cache_entry *e;
+
+    for (e = buckets[hash_path(path)]; e; e = e->next)
+	if (!strcmp(e->path, path))
+	    return e;
+    return NULL;
+}
+
+/*
+ * find_watch - return a cached entry with watch descriptor wd, or
+ *     NULL. Caller holds the lock.
+ */
+static struct cache_entry *find_watch(int wd)
+{
+    struct cache_entry *e;
+
+    for (e = watches[wd & (NBUCKETS - 1)]; e; e = e->wdnext)
+	if (e->wd == wd)
+	    return e;
+    return NULL;
+}
+
+/*
+ * same_version - do a and b describe the same version of one file?
+ */
+static int same_version(struct stat *a, struct stat *b)
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+	a->st_size == b->st_size &&
+	a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+	a->st_mtim.tv_nsec == b->st_mtim.tv_nsec &&
+	a->st_ctim.tv_sec == b->st_ctim.tv_sec &&
+	a->st_ctim.tv_nsec == b->st_ctim.tv_nsec;
+}
+
+/*
+ * unchanged - are path and the open file fd still the file that
+ *     sbuf describes?
+ */
+static int unchanged(const char *path, int fd, struct stat *sbuf)
+{
+    struct stat now;
+
+    return stat(path, &now) == 0 && same_version(&now, sbuf) &&
+	fstat(fd, &now) == 0 && same_version(&now, sbuf);
+}
+
+/*
+ * missing - is there still no file path?
+ */
+static int missing(const char *path)
+{
+    struct stat now;
+
+    return stat(path, &now) < 0 && errno == ENOENT;
+}
+
+/*
+ * new_entry - return a new entry for path and fd, not in the cache
+ */
+static struct cache_entry *new_entry(const char *path, int fd)
+{
+    struct cache_entry *e = Malloc(sizeof(struct cache_entry));
+
+    memset(e, 0, sizeof(struct cache_entry));
+    e->fd = fd;
+    e->path = strdup(path);
+    e->refcnt = 1;
+    e->wd = -1;
+    e->slot = -1;
+    return e;
+}
+
+/*
+ * add_entry - try to add e to the cache, with a watch on watchpath:
+ *     e's file, which sbuf describes, or for an entry with no file
+ *     (sbuf NULL), the directory it would be created in
+ */
+static void add_entry(struct cache_entry *e, const char *watchpath,
+		      struct stat *sbuf)
+{
+    unsigned h;
+    int slot;
+
+    /* Only files we will hear about if they change can be cached */
+    if (notifyfd < 0)
+	return;
+
+    /* Two paths that name the same file share one watch, so it is
+       added under the lock, where unlink_entry() can't remove it for
+       the other path meanwhile; and after find_slot(), which may be
+       what evicts that path. The file may have changed after sbuf was
+       taken and before the watch was in place, with nobody to hear of
+       it. Once it is in place, any change after the check below has an
+       event that cache_invalidate() can only handle after us. */
+    pthread_mutex_lock(&lock);
+    if (find_entry(e->path) || (slot = find_slot()) < 0 ||
+	(e->wd = inotify_add_watch(notifyfd, watchpath, WATCH_MASK)) < 0) {
+	pthread_mutex_unlock(&lock);
+	return;
+    }
+    if (sbuf ? unchanged(e->path, e->fd, sbuf) : missing(e->path)) {
+	e->slot = slot;
+	h = hash_path(e->path);
+	e->next = buckets[h];
+	buckets[h] = e;
+	h = e->wd & (NBUCKETS - 1);
+	e->wdnext = watches[h];
+	watches[h] = e;
+	slots[e->slot] = e;
+	e->refcnt++; /* The table's reference */
+    }
+    else if (!find_watch(e->wd))
+	inotify_rm_watch(notifyfd, e->wd);
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * find_slot - return a free CLOCK slot, evicting the first entry
+ *     that is neither recently used nor in use, or -1 if two sweeps
+ *     find nothing. Caller holds the lock.
+ */
+static int find_slot(void)
+{
+    int i, slot;
+
+    for (i = 0; i < 2 * CACHE_MAXENTRIES; i++) {
+	slot = hand;
+	hand = (hand + 1) % CACHE_MAXENTRIES;
+	if (!slots[slot])
+	    return slot;
+	if (slots[slot]->refbit)
+	    slots[slot]->refbit = 0;    /* Second chance */
+	else if (slots[slot]->refcnt == 1) {
+	    unlink_entry(slots[slot]);
+	    return slot;
+	}
+    }
+    return -1;
+}
+
+/*
+ * unlink_entry - take e out of the table and drop the table's
+ *     reference. Caller holds the lock.
+ */
+static void unlink_entry(struct cache_entry *e)
+{
+    struct cache_entry **pp;
+
+    for (pp = &buckets[hash_path(e->path)]; *pp != e; pp = &(*pp)->next)
+	;
+    *pp = e->next;
+    for (pp = &watches[e->wd & (NBUCKETS - 1)]; *pp != e; pp = &(*pp)->wdnext)
+	;
+    *pp = e->wdnext;
+    slots[e->slot] = NULL;
+    e->slot = -1;
+    if (e->variant)         /* Variant links only join cached entries */
+	e->variant->owner = NULL;
+    if (e->owner)
+	e->owner->variant = NULL;
+    e->variant = e->owner = NULL;
+
+    /* Stop watching the file once no entry refers to it */
+    if (!find_watch(e->wd))
+	inotify_rm_watch(notifyfd, e->wd);
+    put_entry(e);
+}
+
+/*
+ * put_entry - drop one reference to e, freeing it with the last.
+ *     Caller holds the lock.
+ */
+static void put_entry(struct cache_entry *e)
+{
+    if (--e->refcnt > 0)
+	return;
+    if (e->fd >= 0)
+	close(e->fd);
+    free(e->path);
+    free(e->hdrs);
+    free(e);
+}
@@ -0,0 +1,48 @@
+/*
+ * cache.h - Open-file cache for Tiny's static content
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "csapp.h"
+
+#define CACHE_MAXENTRIES 1024 /* Files (and descriptors) kept open */
+#define CACHE_MAXETAG 48      /* Longest entity tag, with its quotes */
+
+/* A cached file. Everything here is read-only once the entry is
+   returned by cache_lookup() or cache_insert(). An entry from
+   cache_insert_missing() has fd -1 and nothing else but its path. */
+struct cache_entry {
+    int fd;                   /* Open, read-only descriptor, or -1 */
+    off_t size;               /* File size */
+    time_t mtime;             /* Last modification time */
+    const char *filetype;     /* MIME type */
+    char etag[CACHE_MAXETAG]; /* Entity tag (validator) */
+    char *hdrs;               /* Prebuilt response headers, see tiny.c */
+    size_t hdrlen;            /* Length of hdrs */
+
+    /* Private to cache.c */
+    char *path;               /* Key */
+    int refcnt;               /* Users, plus one while in the table */
+    int refbit;               /* CLOCK reference bit */
+    int wd;                   /* inotify watch descriptor */
+    int slot;                 /* Index in the CLOCK, or -1 if uncached */
+    struct cache_entry *next; /* Hash chain */
+    struct cache_entry *wdnext; /* Chain of entries by watch descriptor */
+    struct cache_entry *variant; /* See cache_set_variant() */
+    struct cache_entry *owner;  /* Entry this is the variant of */
+};
+
+void cache_init(void);
+int cache_notifyfd(void);
+struct cache_entry *cache_lookup(const char *path);
+struct cache_entry *cache_insert(const char *path, int fd, struct stat *sbuf,
+				 const char *filetype, const char *etag,
+				 char *hdrs, size_t hdrlen);
+struct cache_entry *cache_insert_missing(const char *path);
+struct cache_entry *cache_variant(struct cache_entry *e);
+void cache_set_variant(struct cache_entry *e, struct cache_entry *v);
+void cache_release(struct cache_entry *e);
+void cache_invalidate(void);
+
+#endif /* __CACHE_H__ */
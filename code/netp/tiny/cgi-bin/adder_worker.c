@@ -0,0 +1,39 @@
+/*
+ * adder_worker.c - adder as a long-lived worker: the same two-number
+ *     addition portal, but serving one request after another from
+ *     Tiny's worker pool instead of being exec'd for each one
+ */
+#include "csapp.h"
+#include "cgipool.h"
+
+int main(void) {
+    char query[MAXLINE], buf[MAXBUF], content[MAXLINE], *p;
+    int connfd, n, n1, n2;
+
+    Signal(SIGPIPE, SIG_IGN); /* A client that hangs up is not our problem */
+
+    while (cgipool_accept(&connfd, query, MAXLINE) == 0) {
+	/* Extract the two arguments */
+	n1 = n2 = 0;
+	if ((p = strchr(query, '&')) != NULL) {
+	    *p = '\0';
+	    n1 = atoi(query);
+	    n2 = atoi(p+1);
+	}
+
+	/* Make the response body */
+	snprintf(content, MAXLINE, "Welcome to add.com: "
+		 "THE Internet addition portal.\r\n<p>"
+		 "The answer is: %d + %d = %d\r\n<p>"
+		 "Thanks for visiting!\r\n", n1, n2, n1 + n2);
+
+	/* Generate the HTTP response */
+	n = snprintf(buf, MAXBUF, "Connection: close\r\n"
+		     "Content-length: %d\r\n"
+		     "Content-type: text/html\r\n\r\n%s",
+		     (int)strlen(content), content);
+	rio_writen(connfd, buf, n);
+	close(connfd);
+    }
+    exit(0);
+}
@@ -0,0 +1,233 @@
+/*
+ * cgipool.c - Pools of long-lived CGI worker processes
+ *
+ * Forking and exec'ing a CGI program per request costs far more than
+ * the program itself usually does. For every cgi-bin program that has
+ * a companion <prog>.worker executable, Tiny instead starts a few
+ * copies of the worker when it boots and hands them requests.
+ *
+ * All workers of a pool share one end of a SOCK_SEQPACKET socket pair
+ * as their stdin; Tiny keeps the other end. Each request is a single
+ * message (struct cgipool_frame plus QUERY_STRING) that carries the
+ * client socket with it, and the kernel delivers every message to
+ * exactly one of the workers blocked in recvmsg(), so idle workers
+ * pick up work without any bookkeeping on Tiny's side. The worker
+ * writes the response directly to the client and closes it.
+ *
+ * The workers are not Tiny's own children: each pool has a small,
+ * single-threaded supervisor process that forks them and starts a new
+ * one whenever one exits. Tiny's SIGCHLD handler reaps every child it
+ * has, so it could not tell a dead worker from a finished CGI program,
+ * and nothing would replace the worker.
+ */
+#include "cgipool.h"
+
+/* A worker program and the socket its workers read requests from */
+static struct {
+    char prog[MAXLINE];   /* CGI path as produced by parse_uri() */
+    int fd;               /* Our end of the socket pair */
+} pools[CGIPOOL_MAXPOOLS];
+static int npools;
+
+static void start_pool(char *prog, char *workerprog, int nworkers);
+static void supervise(char *workerprog, int fd, int nworkers);
+static void spawn_worker(char *workerprog, int fd);
+
+/*
+ * cgipool_init - start nworkers workers for every <prog>.worker in
+ *     cgidir; return the number of pools started
+ */
+int cgipool_init(char *cgidir, int nworkers)
+{
+    DIR *dir;
+    struct dirent *de;
+    char prog[MAXLINE], workerprog[MAXLINE];
+    size_t len, slen = strlen(CGIPOOL_SUFFIX);
+
+    if (nworkers <= 0 || !(dir = opendir(cgidir)))
+	return 0;
+    while ((de = readdir(dir)) && npools < CGIPOOL_MAXPOOLS) {
+	len = strlen(de->d_name);
+	if (len <= slen || strcmp(de->d_name + len - slen, CGIPOOL_SUFFIX))
+	    continue;
+	snprintf(workerprog, MAXLINE, "%s/%s", cgidir, de->d_name);
+	snprintf(prog, MAXLINE, "%s/%.*s", cgidir, (int)(len - slen), de->d_name);
+	if (access(workerprog, X_OK) == 0)
+	    start_pool(prog, workerprog, nworkers);
+    }
+    closedir(dir);
+    return npools;
+}
+
+/*
+ * cgipool_dispatch - queue a request for prog with its client socket
+ *     connfd. Return 0 on success, or -1 if prog has no pool or the
+ *     pool is backed up, in which case the caller should fork the CGI
+ *     program as usual. Either way the caller still owns connfd.
+ */
+int cgipool_dispatch(char *prog, int connfd, char *cgiargs)
+{
+    struct cgipool_frame frame;
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    int i;
+
+    for (i = 0; i < npools; i++)
+	if (!strcmp(pools[i].prog, prog))
+	    break;
+    if (i == npools)
+	return -1;
+
+    frame.magic = CGIPOOL_MAGIC;
+    frame.len = strlen(cgiargs);
+    iov[0].iov_base = &frame;
+    iov[0].iov_len = sizeof(frame);
+    iov[1].iov_base = cgiargs;
+    iov[1].iov_len = frame.len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &connfd, sizeof(int));
+
+    /* Never block an event loop: a full queue means fall back */
+    if (sendmsg(pools[i].fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+	return -1;
+    return 0;
+}
+
+/*
+ * cgipool_accept - wait for the next request on stdin. On success,
+ *     return 0 with the client socket in *connfd (ready for blocking
+ *     writes) and QUERY_STRING in cgiargs. Return -1 once Tiny has
+ *     gone away.
+ */
+int cgipool_accept(int *connfd, char *cgiargs, size_t maxlen)
+{
+    struct cgipool_frame frame;
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    ssize_t n;
+
+    while (1) {
+	iov[0].iov_base = &frame;
+	iov[0].iov_len = sizeof(frame);
+	iov[1].iov_base = cgiargs;
+	iov[1].iov_len = maxlen - 1;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if ((n = recvmsg(STDIN_FILENO, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (n == 0)
+	    return -1;  /* Tiny closed its end */
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+	    continue;   /* No client to answer */
+	memcpy(connfd, CMSG_DATA(cmsg), sizeof(int));
+
+	/* Drop malformed or truncated requests */
+	if (n < sizeof(frame) || frame.magic != CGIPOOL_MAGIC ||
+	    frame.len != n - sizeof(frame) || (msg.msg_flags & MSG_TRUNC)) {
+	    close(*connfd);
+	    continue;
+	}
+	cgiargs[frame.len] = '\0';
+
+	/* The socket comes from an event loop and is non-blocking */
+	fcntl(*connfd, F_SETFL, 0);
+	return 0;
+    }
+}
+
+/*
+ * start_pool - start a supervisor that keeps nworkers copies of
+ *     workerprog serving prog
+ */
+static void start_pool(char *prog, char *workerprog, int nworkers)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+	fprintf(stderr, "socketpair error: %s\n", strerror(errno));
+	return;
+    }
+    if (Fork() == 0) /* Child */
+	supervise(workerprog, sv[1], nworkers);
+    Close(sv[1]); /* If the supervisor dies, dispatch fails and we fork */
+
+    strcpy(pools[npools].prog, prog);
+    pools[npools].fd = sv[0];
+    npools++;
+    printf("Started %d workers for %s\n", nworkers, prog);
+}
+
+/*
+ * supervise - body of a pool's supervisor process: start nworkers
+ *     copies of workerprog reading requests from fd, and start another
+ *     whenever one exits, until Tiny is gone. Never returns.
+ */
+static void supervise(char *workerprog, int fd, int nworkers)
+{
+    pid_t tiny = getppid();
+    time_t last = 0;
+    long i, maxfd = sysconf(_SC_OPEN_MAX);
+
+    /* Reap the workers below, not with Tiny's handler */
+    Signal(SIGCHLD, SIG_DFL);
+
+    /* Drop everything else inherited from Tiny, above all our end of
+       the other pools and the listening socket, so Tiny closing them
+       really closes them */
+    for (i = 3; i < maxfd; i++)
+	if (i != fd)
+	    close(i);
+
+    for (i = 0; i < nworkers; i++)
+	spawn_worker(workerprog, fd);
+    last = time(NULL);
+    while (wait(NULL) > 0) {
+	/* Once Tiny is gone the workers see end-of-file and exit */
+	if (getppid() != tiny)
+	    continue;
+	/* Don't spin on a worker that dies as soon as it starts */
+	if (time(NULL) - last < 1)
+	    sleep(1);
+	spawn_worker(workerprog, fd);
+	last = time(NULL);
+    }
+    exit(0);
+}
+
+/*
+ * spawn_worker - fork a copy of workerprog that reads requests from fd
+ */
+static void spawn_worker(char *workerprog, int fd)
+{
+    char *argv[] = { workerprog, NULL };
+    pid_t pid;
+
+    if ((pid = fork()) == 0) { /* Child */
+	Dup2(fd, STDIN_FILENO);
+	Execve(workerprog, argv, environ);
+    }
+    if (pid < 0)
+	fprintf(stderr, "fork error: %s\n", strerror(errno));
+}
@@ -0,0 +1,29 @@
+/*
+ * cgipool.h - Pools of long-lived CGI worker processes
+ */
+#ifndef __CGIPOOL_H__
+#define __CGIPOOL_H__
+
+#include "csapp.h"
+
+#define CGIPOOL_MAXPOOLS 16          /* Most worker programs we run */
+#define CGIPOOL_SUFFIX   ".worker"   /* cgi-bin/adder.worker serves cgi-bin/adder */
+#define CGIPOOL_MAGIC    0x54494e59  /* "TINY" */
+
+/* One request, as a single SOCK_SEQPACKET message: this header, then
+   len bytes of QUERY_STRING, with the client socket attached as
+   SCM_RIGHTS. The worker writes the rest of the HTTP response
+   straight to that socket and closes it. */
+struct cgipool_frame {
+    uint32_t magic;   /* CGIPOOL_MAGIC */
+    uint32_t len;     /* Bytes of QUERY_STRING that follow */
+};
+
+/* Server side */
+int cgipool_init(char *cgidir, int nworkers);
+int cgipool_dispatch(char *prog, int connfd, char *cgiargs);
+
+/* Worker side */
+int cgipool_accept(int *connfd, char *cgiargs, size_t maxlen);
+
+#endif /* __CGIPOOL_H__ */
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
@@ -20,6 +21,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
@@ -28,6 +32,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 /* $begin createmasks */
@@ -47,10 +52,37 @@ typedef struct {
     int rio_fd;                /* Descriptor for this internal buf */
     int rio_cnt;               /* Unread bytes in internal buf */
     char *rio_bufptr;          /* Next unread byte in internal buf */
-    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+    char *rio_base;            /* Internal buf: rio_buf or the caller's */
+    size_t rio_bufsize;        /* Size of internal buf */
+    char rio_buf[RIO_BUFSIZE]; /* Default internal buffer */
 } rio_t;
 /* $end rio_t */
 
+/* Persistent state for buffered Rio output */
+typedef struct {
+    int rio_fd;                /* Descriptor for this internal buf */
+    int rio_corked;            /* TCP_CORK is set on rio_fd */
+    size_t rio_cnt;            /* Unwritten bytes in internal buf */
+    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+} rio_writer_t;
+
+/* Edge-triggered event loop (see reactor_add) */
+#define REACTOR_MAXEVENTS 64
+typedef struct reactor reactor_t;
+typedef struct reactor_ev reactor_ev_t;
+typedef void (*reactor_fn)(reactor_t *r, reactor_ev_t *ev, unsigned events);
+struct reactor_ev {
+    int fd;                    /* Watched descriptor, -1 once deleted */
+    reactor_fn fn;             /* Called when fd becomes ready */
+    void *arg;                 /* For fn */
+    reactor_ev_t *next;        /* Deleted events awaiting free */
+};
+struct reactor {
+    int epfd;                  /* epoll instance */
+    int stop;                  /* Set by a handler to end reactor_run */
+    reactor_ev_t *dead;        /* Deleted during the current batch */
+};
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -176,15 +208,42 @@ void V(sem_t *sem);
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
+int rio_readinitbuf(rio_t *rp, int fd, void *buf, size_t bufsize);
+int rio_fadvise(rio_t *rp, int advice);
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t	rio_readlinep(rio_t *rp, char **linep);
+ssize_t rio_sendn(int fd, void *usrbuf, size_t n, int flags);
+ssize_t rio_sendfile(int outfd, int infd, off_t offset, size_t n);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
+void rio_writeinitb(rio_writer_t *wp, int fd);
+ssize_t	rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t	rio_printfb(rio_writer_t *wp, const char *fmt, ...);
+int rio_flushb(rio_writer_t *wp);
+int rio_corkb(rio_writer_t *wp, int on);
+
+/* Non-blocking Rio (fail with EAGAIN rather than wait) */
+ssize_t rio_readb_nb(rio_t *rp, void *usrbuf, size_t n);
+ssize_t rio_readlineb_nb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_writen_nb(int fd, void *usrbuf, size_t n);
+int rio_flushb_nb(rio_writer_t *wp);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
 void Rio_writen(int fd, void *usrbuf, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
+void Rio_readinitbuf(rio_t *rp, int fd, void *buf, size_t bufsize);
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t Rio_readlinep(rio_t *rp, char **linep);
+void Rio_sendn(int fd, void *usrbuf, size_t n, int flags);
+void Rio_sendfile(int outfd, int infd, off_t offset, size_t n);
+void Rio_writev(int fd, struct iovec *iov, int iovcnt);
+void Rio_writeinitb(rio_writer_t *wp, int fd);
+void Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t Rio_printfb(rio_writer_t *wp, const char *fmt, ...);
+void Rio_flushb(rio_writer_t *wp);
+void Rio_corkb(rio_writer_t *wp, int on);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
@@ -194,6 +253,23 @@ int open_listenfd(char *port);
 int Open_clientfd(char *hostname, char *port);
 int Open_listenfd(char *port);
 
+/* Reactor */
+int reactor_init(reactor_t *r);
+reactor_ev_t *reactor_add(reactor_t *r, int fd, unsigned events,
+			  reactor_fn fn, void *arg);
+int reactor_mod(reactor_t *r, reactor_ev_t *ev, unsigned events);
+int reactor_del(reactor_t *r, reactor_ev_t *ev);
+int reactor_run(reactor_t *r);
+void reactor_free(reactor_t *r);
+
+/* Wrappers for the reactor */
+void Reactor_init(reactor_t *r);
+reactor_ev_t *Reactor_add(reactor_t *r, int fd, unsigned events,
+			  reactor_fn fn, void *arg);
+void Reactor_mod(reactor_t *r, reactor_ev_t *ev, unsigned events);
+void Reactor_del(reactor_t *r, reactor_ev_t *ev);
+void Reactor_run(reactor_t *r);
+
 
 #endif /* __CSAPP_H__ */
 /* $end csapp.h */
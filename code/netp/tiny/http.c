@@ -0,0 +1,431 @@
+/*
+ * http.c - HTTP request parsing for Tiny
+ *
+ * The parser works on whatever part of a request has arrived so far,
+ * so an event-driven server can call it each time more bytes are read
+ * into a connection's buffer. Nothing is copied: the request line and
+ * headers come back as slices of that buffer.
+ *
+ * Until the blank line that ends the head shows up, a call only scans
+ * the bytes that are new since the last one. The head is then parsed
+ * and checked in a single pass, line by line with memchr().
+ */
+#include "http.h"
+#include <time.h>
+
+static const char *find_blankline(const char *buf, size_t len,
+				  size_t *scanned);
+static int parse_head(const char *buf, struct http_request *req);
+static int is_tchar(int c);
+static void apply_header(struct http_request *req, struct http_header *h);
+static int has_word(struct http_slice s, const char *word);
+static long parse_length(struct http_slice s);
+static void parse_range(struct http_slice s, struct http_request *req);
+static const char *parse_offset(const char *p, const char *end,
+				long long *n);
+static int accepts_gzip(struct http_slice s);
+
+/*
+ * http_init_request - get req ready to parse a new request. Call it
+ *     once per connection and again after each complete request.
+ */
+void http_init_request(struct http_request *req)
+{
+    req->hdrlen = 0;
+    req->scanned = 0;
+}
+
+/*
+ * http_parse_request - parse the request at the front of buf[0..len)
+ *
+ *     Returns the number of bytes the request occupies, including any
+ *     request body, once all of it is in buf. Returns 0 if more bytes
+ *     are needed and -1 if the request is malformed or over a limit.
+ *     After a 0, call again with the same req once buf holds more.
+ *
+ *     A body sent with Transfer-Encoding is not decoded: such a request
+ *     comes back with req->transfer_encoding set and must be refused
+ *     (501) and the connection closed, since where its body ends is
+ *     unknown. With a Content-length as well, it is malformed.
+ */
+ssize_t http_parse_request(const char *buf, size_t len,
+			   struct http_request *req)
+{
+    const char *end;
+
+    if (req->hdrlen == 0) {
+	/* Wait until the blank line that ends the headers has arrived */
+	if (!(end = find_blankline(buf, len, &req->scanned)))
+	    return 0;
+	req->hdrlen = end + 4 - buf;
+	if (parse_head(buf, req) < 0)
+	    return -1;
+    }
+    if (len - req->hdrlen < req->bodylen)
+	return 0;
+    return req->hdrlen + req->bodylen;
+}
+
+/*
+ * http_slice_is - does s equal str, ignoring case?
+ */
+int http_slice_is(struct http_slice s, const char *str)
+{
+    return strlen(str) == s.len && !strncasecmp(s.p, str, s.len);
+}
+
+/*
+ * http_slice_eq - does s equal str exactly?
+ */
+int http_slice_eq(struct http_slice s, const char *str)
+{
+    return strlen(str) == s.len && !memcmp(s.p, str, s.len);
+}
+
+/*
+ * http_slice_has - does s contain str (case matters)?
+ */
+int http_slice_has(struct http_slice s, const char *str)
+{
+    size_t n = strlen(str);
+    const char *p = s.p, *end = s.p + s.len;
+
+    while (end - p >= n && (p = memchr(p, str[0], end - p - n + 1))) {
+	if (!memcmp(p, str, n))
+	    return 1;
+	p++;
+    }
+    return 0;
+}
+
+/*
+ * http_slice_copy - copy s into dst as a string, truncating it to
+ *     dstlen-1 bytes if need be; return dst
+ */
+char *http_slice_copy(char *dst, size_t dstlen, struct http_slice s)
+{
+    size_t n = (s.len < dstlen) ? s.len : dstlen - 1;
+
+    memcpy(dst, s.p, n);
+    dst[n] = '\0';
+    return dst;
+}
+
+/*
+ * http_parse_date - parse the len-byte HTTP date at s in the preferred
+ *     IMF-fixdate format, e.g. "Sun, 06 Nov 1994 08:49:37 GMT";
+ *     return -1 if it isn't one
+ */
+time_t http_parse_date(const char *s, size_t len)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    static const char layout[] = "www, 99 mmm 9999 99:99:99 GMT";
+    long year, mon, day, hour, min, sec, era, yoe, doy;
+    const char *m;
+    int i;
+
+    /* Every field has a fixed width, so check it against a template
+       (9 is a digit, w and m are checked elsewhere) rather than going
+       through sscanf() and timegm() */
+    if (len != sizeof(layout) - 1)
+	return -1;
+    for (i = 0; i < len; i++)
+	if (layout[i] == '9' ? !isdigit((unsigned char)s[i]) :
+	    layout[i] != 'w' && layout[i] != 'm' && s[i] != layout[i])
+	    return -1;
+    for (m = months; m < months + 36; m += 3)
+	if (!memcmp(s + 8, m, 3))
+	    break;
+    if (m == months + 36)
+	return -1;
+
+#define NUM2(p) (((p)[0] - '0') * 10 + ((p)[1] - '0'))
+    day = NUM2(s + 5);
+    mon = (m - months) / 3 + 1;
+    year = NUM2(s + 12) * 100 + NUM2(s + 14);
+    hour = NUM2(s + 17);
+    min = NUM2(s + 20);
+    sec = NUM2(s + 23);
+#undef NUM2
+
+    /* Days since 1970-01-01 in the proleptic Gregorian calendar, with
+       the year starting in March so that leap days come last */
+    if (mon <= 2)
+	year--;
+    era = year / 400;
+    yoe = year - era * 400;
+    doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + day - 1;
+    return (time_t)(era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy
+		    - 719468) * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+/*
+ * http_format_date - write t into buf as an IMF-fixdate
+ */
+void http_format_date(char *buf, size_t len, time_t t)
+{
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+/*
+ * find_blankline - return a pointer to the first "\r\n\r\n" in buf,
+ *     or NULL if there is none. *scanned is how much of buf earlier
+ *     calls have already searched.
+ */
+static const char *find_blankline(const char *buf, size_t len,
+				  size_t *scanned)
+{
+    const char *p, *end = buf + len;
+
+    /* A match may straddle the old end, so back up three bytes */
+    p = buf + (*scanned > 3 ? *scanned - 3 : 0);
+    *scanned = len;
+    while (end - p >= 4 && (p = memchr(p, '\r', end - p - 3)))
+	if (!memcmp(p, "\r\n\r\n", 4))
+	    return p;
+	else
+	    p++;
+    return NULL;
+}
+
+/*
+ * parse_head - split the head buf[0..req->hdrlen) into the request
+ *     line and headers; return -1 if it is malformed or over a limit
+ */
+static int parse_head(const char *buf, struct http_request *req)
+{
+    const char *p = buf, *end = buf + req->hdrlen - 2, *eol, *sp, *q;
+    struct http_header *h;
+
+    /* Request line: <method> SP <uri> SP HTTP/1.<minor> CRLF */
+    eol = memchr(p, '\r', end - p);
+    if (eol[1] != '\n')
+	return -1;
+    for (q = p; q < eol && is_tchar((unsigned char)*q); q++)
+	;
+    if (q == p || q - p >= HTTP_MAXTOKEN || *q != ' ')
+	return -1;
+    req->method.p = p;
+    req->method.len = q - p;
+    p = q + 1;
+    if (!(sp = memchr(p, ' ', eol - p)) || sp == p || sp - p >= HTTP_MAXURI)
+	return -1;
+    req->uri.p = p;
+    req->uri.len = sp - p;
+    p = sp + 1;
+    if (eol - p != 8 || memcmp(p, "HTTP/1.", 7) ||
+	(p[7] != '0' && p[7] != '1'))
+	return -1;
+    req->version.p = p;
+    req->version.len = 8;
+
+    /* HTTP/1.1 connections persist unless the client says otherwise;
+       HTTP/1.0 clients have to ask for it */
+    req->keepalive = (p[7] == '1');
+    req->bodylen = 0;
+    req->has_length = 0;
+    req->transfer_encoding.p = NULL;
+    req->transfer_encoding.len = 0;
+    req->nheaders = 0;
+    req->range_first = req->range_last = -1;
+    req->if_range.len = req->if_none_match.len = 0;
+    req->if_modified_since = -1;
+    req->accept_gzip = 0;
+
+    /* Headers: <name>:<OWS><value><OWS> CRLF, up to the blank line */
+    for (p = eol + 2; p < end; p = eol + 2) {
+	eol = memchr(p, '\r', end + 2 - p);
+	if (eol[1] != '\n' || req->nheaders == HTTP_MAXHEADERS)
+	    return -1;
+	for (q = p; q < eol && is_tchar((unsigned char)*q); q++)
+	    ;
+	if (q == p || *q != ':')  /* Also rejects obsolete line folding */
+	    return -1;
+	h = &req->headers[req->nheaders++];
+	h->name.p = p;
+	h->name.len = q - p;
+	for (q++; q < eol && (*q == ' ' || *q == '\t'); q++)
+	    ;
+	for (sp = eol; sp > q && (sp[-1] == ' ' || sp[-1] == '\t'); sp--)
+	    ;
+	h->value.p = q;
+	h->value.len = sp - q;
+	apply_header(req, h);
+	if (req->bodylen < 0)
+	    return -1;
+    }
+
+    /* A body framed both ways is how requests get smuggled past a
+       proxy (RFC 7230 3.3.3). Transfer-Encoding alone is left to the
+       caller to refuse, since the head itself is fine. */
+    if (req->transfer_encoding.p && req->has_length)
+	return -1;
+    return 0;
+}
+
+/*
+ * is_tchar - may c appear in a method or header name (RFC 7230)? That
+ *     is any visible ASCII character but the delimiters "(),/:;<=>?@[\]{}
+ */
+static int is_tchar(int c)
+{
+    static const unsigned long long mask[2] = {
+	0x03ff6cfa00000000ULL, 0x57ffffffc7fffffeULL
+    };
+
+    return c < 128 && (mask[c >> 6] >> (c & 63)) & 1;
+}
+
+/*
+ * apply_header - note what header h means for the request, if it is
+ *     one Tiny cares about
+ */
+static void apply_header(struct http_request *req, struct http_header *h)
+{
+/* Lengths differ far more often than names do, so compare them first */
+#define NAME_IS(s, lit) \
+    ((s).len == sizeof(lit) - 1 && !strncasecmp((s).p, lit, sizeof(lit) - 1))
+
+    switch (tolower(h->name.p[0])) {
+    case 'a':
+	if (NAME_IS(h->name, "Accept-Encoding"))
+	    req->accept_gzip = accepts_gzip(h->value);
+	break;
+    case 'c':
+	if (NAME_IS(h->name, "Connection")) {
+	    if (has_word(h->value, "close"))
+		req->keepalive = 0;
+	    else if (has_word(h->value, "keep-alive"))
+		req->keepalive = 1;
+	}
+	else if (NAME_IS(h->name, "Content-length")) {
+	    req->bodylen = parse_length(h->value);
+	    req->has_length = 1;
+	}
+	break;
+    case 'i':
+	if (NAME_IS(h->name, "If-Range"))
+	    req->if_range = h->value;
+	else if (NAME_IS(h->name, "If-None-Match"))
+	    req->if_none_match = h->value;
+	else if (NAME_IS(h->name, "If-Modified-Since"))
+	    req->if_modified_since = http_parse_date(h->value.p, h->value.len);
+	break;
+    case 'r':
+	if (NAME_IS(h->name, "Range"))
+	    parse_range(h->value, req);
+	break;
+    case 't':
+	if (NAME_IS(h->name, "Transfer-Encoding"))
+	    req->transfer_encoding = h->value;
+	break;
+    }
+#undef NAME_IS
+}
+
+/*
+ * has_word - does s contain the lowercase word, ignoring case?
+ */
+static int has_word(struct http_slice s, const char *word)
+{
+    size_t n = strlen(word);
+    const char *p;
+
+    for (p = s.p; s.p + s.len - p >= n; p++)
+	if ((*p | 0x20) == word[0] && !strncasecmp(p, word, n))
+	    return 1;
+    return 0;
+}
+
+/*
+ * parse_length - return the Content-length value s, or -1 if it is
+ *     not a number or over HTTP_MAXBODY
+ */
+static long parse_length(struct http_slice s)
+{
+    const char *p;
+    long n = 0;
+
+    if (s.len == 0)
+	return -1;
+    for (p = s.p; p < s.p + s.len; p++)
+	if (!isdigit((unsigned char)*p) ||
+	    (n = n * 10 + (*p - '0')) > HTTP_MAXBODY)
+	    return -1;
+    return n;
+}
+
+/*
+ * parse_range - record a single "bytes=first-last" range from the Range
+ *     header value s. Anything else, including a list of ranges, is
+ *     ignored, which just means the whole file is sent.
+ */
+static void parse_range(struct http_slice s, struct http_request *req)
+{
+    long long first = -1, last = -1;
+    const char *p, *end = s.p + s.len;
+
+    if (s.len < 6 || strncasecmp(s.p, "bytes=", 6))
+	return;
+    p = parse_offset(s.p + 6, end, &first);
+    if (p == end || *p++ != '-')
+	return;
+    p = parse_offset(p, end, &last);
+    if (p != end || (first < 0 && last < 0) || (last >= 0 && last < first))
+	return;
+    req->range_first = first;
+    req->range_last = last;
+}
+
+/*
+ * parse_offset - read the digits of a range bound starting at p into *n,
+ *     which stays -1 if there are none; return the first non-digit.
+ *     A bound too big for a long long becomes LLONG_MAX, which is past
+ *     the end of any file: as first byte it gets a 416, as last byte
+ *     it means the end of the file.
+ */
+static const char *parse_offset(const char *p, const char *end,
+				long long *n)
+{
+    int d;
+
+    for (; p < end && isdigit((unsigned char)*p); p++) {
+	d = *p - '0';
+	if (*n < 0)
+	    *n = 0;
+	*n = (*n > (LLONG_MAX - d) / 10) ? LLONG_MAX : *n * 10 + d;
+    }
+    return p;
+}
+
+/*
+ * accepts_gzip - does the Accept-Encoding list s allow gzip, i.e.
+ *     name gzip (or *) without q=0?
+ */
+static int accepts_gzip(struct http_slice s)
+{
+    const char *p = s.p, *end = s.p + s.len, *tok, *q;
+    size_t n;
+
+    while (p < end) {
+	while (p < end && (*p == ' ' || *p == ','))
+	    p++;
+	for (tok = p; p < end && *p != ',' && *p != ';' && *p != ' '; p++)
+	    ;
+	n = p - tok;
+	for (q = p; p < end && *p != ','; p++)  /* Parameters */
+	    ;
+	if ((n == 4 && !strncasecmp(tok, "gzip", 4)) ||
+	    (n == 6 && !strncasecmp(tok, "x-gzip", 6)) ||
+	    (n == 1 && *tok == '*')) {
+	    for (; q < p - 1; q++)
+		if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=')
+		    return strtod(q + 2, NULL) > 0;
+	    return 1;
+	}
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * http.h - HTTP request parsing for Tiny
+ */
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include "csapp.h"
+
+/* Limits on what a request may contain */
+#define HTTP_MAXTOKEN   16        /* Longest method */
+#define HTTP_MAXURI     (MAXLINE - 16) /* Longest request target plus a NUL,
+                                     leaving room to make a file name */
+#define HTTP_MAXHEADERS 64        /* Most header lines */
+#define HTTP_MAXBODY    MAXBUF    /* Largest request body */
+
+/* A piece of the caller's buffer; not NUL-terminated */
+struct http_slice {
+    const char *p;
+    size_t len;
+};
+
+struct http_header {
+    struct http_slice name;      /* Without the colon */
+    struct http_slice value;     /* Without surrounding whitespace */
+};
+
+/* A parsed request head. All slices point into the buffer that was
+   parsed and are valid until the caller moves or reuses it. */
+struct http_request {
+    struct http_slice method;    /* e.g. "GET" */
+    struct http_slice uri;       /* Request target, as sent */
+    struct http_slice version;   /* e.g. "HTTP/1.1" */
+    struct http_header headers[HTTP_MAXHEADERS];
+    int nheaders;
+    int keepalive;               /* Client wants the connection kept open */
+    long bodylen;                /* Content-length of the request body */
+    size_t hdrlen;               /* Bytes in request line + headers */
+    struct http_slice transfer_encoding; /* Transfer-Encoding, which we
+                                    can't decode; p is NULL if absent */
+
+    /* Conditional and partial GET (RFC 7232, 7233) */
+    long long range_first;       /* Range: bytes=first-last, where either */
+    long long range_last;        /*   may be -1 if absent; both -1 if no */
+                                 /*   (single) byte range was asked for */
+    struct http_slice if_range;  /* If-Range validator, or empty */
+    struct http_slice if_none_match; /* If-None-Match list, or empty */
+    time_t if_modified_since;    /* If-Modified-Since, or -1 */
+    int accept_gzip;             /* Accept-Encoding allows gzip */
+
+    /* Private to http.c: how far the search for the end of the head
+       got, so that each call only looks at newly arrived bytes, and
+       whether there was a Content-length header */
+    size_t scanned;
+    int has_length;
+};
+
+void http_init_request(struct http_request *req);
+ssize_t http_parse_request(const char *buf, size_t len,
+			   struct http_request *req);
+int http_slice_is(struct http_slice s, const char *str);
+int http_slice_eq(struct http_slice s, const char *str);
+int http_slice_has(struct http_slice s, const char *str);
+char *http_slice_copy(char *dst, size_t dstlen, struct http_slice s);
+time_t http_parse_date(const char *s, size_t len);
+void http_format_date(char *buf, size_t len, time_t t);
+
+#endif /* __HTTP_H__ */
@@ -0,0 +1,234 @@
+/*
+ * objcache.c - Sharded, size-bounded object cache for the Tiny proxy
+ *
+ * Responses are split by key hash over OBJCACHE_SHARDS shards, each
+ * holding at most 1/OBJCACHE_SHARDS of the total byte budget behind
+ * its own reader-writer lock, so lookups from different threads only
+ * meet when they hit the same shard, and even then share the lock.
+ * Within a shard, objects are found through a hash index that doubles
+ * as the shard fills up.
+ *
+ * Hits must not take the write lock, so a hit doesn't move its object
+ * in the shard's LRU list: it stamps the object with the shard's
+ * clock, which it bumps atomically. The list is put in order lazily
+ * by evict(), which takes objects off its tail and moves those hit
+ * since they were last put at the front back there, so each eviction
+ * costs O(1) plus one move per earlier hit. Objects are reference
+ * counted so a thread can send one after dropping the lock, even if
+ * it is evicted.
+ */
+#include "objcache.h"
+
+#define MINBUCKETS 64         /* Initial size of a shard's index */
+
+static struct shard {
+    pthread_rwlock_t lock;
+    struct object **buckets;  /* Hash index, chained through hnext */
+    size_t nbuckets;          /* Power of 2, or 0 while still empty */
+    size_t nobjs;             /* Objects cached */
+    struct object lru;        /* Sentinel; front is most recently used */
+    size_t bytes;             /* Sum of objs' sizes */
+    unsigned long clock;      /* Bumped on every hit and insert */
+} shards[OBJCACHE_SHARDS];
+static size_t shardmax;       /* Byte budget of one shard */
+
+static unsigned hash_key(const char *key);
+static struct object *find_object(struct shard *sp, const char *key,
+				  unsigned h);
+static void grow_index(struct shard *sp);
+static void list_front(struct shard *sp, struct object *obj);
+static void evict(struct shard *sp);
+
+/*
+ * objcache_init - set up an empty cache of at most maxbytes
+ */
+void objcache_init(size_t maxbytes)
+{
+    int i, rc;
+
+    for (i = 0; i < OBJCACHE_SHARDS; i++) {
+	if ((rc = pthread_rwlock_init(&shards[i].lock, NULL)) != 0)
+	    posix_error(rc, "pthread_rwlock_init error");
+	shards[i].lru.prev = shards[i].lru.next = &shards[i].lru;
+    }
+    shardmax = maxbytes / OBJCACHE_SHARDS;
+}
+
+/*
+ * objcache_new - make an uncached object for key that takes over
+ *     the malloc'ed data. Hand it back with objcache_release().
+ */
+struct object *objcache_new(const char *key, char *data, size_t hdrlen,
+			    size_t size)
+{
+    struct object *obj = Malloc(sizeof(struct object));
+
+    obj->key = strdup(key);
+    obj->data = data;
+    obj->hdrlen = hdrlen;
+    obj->size = size;
+    obj->hash = hash_key(key);
+    obj->refcnt = 1;
+    obj->lastuse = obj->listed = 0;
+    obj->hnext = obj->prev = obj->next = NULL;
+    return obj;
+}
+
+/*
+ * objcache_lookup - return the object cached for key, or NULL. The
+ *     caller must hand a hit back with objcache_release().
+ */
+struct object *objcache_lookup(const char *key)
+{
+    unsigned h = hash_key(key);
+    struct shard *sp = &shards[h % OBJCACHE_SHARDS];
+    struct object *obj;
+
+    pthread_rwlock_rdlock(&sp->lock);
+    if ((obj = find_object(sp, key, h)) != NULL) {
+	__atomic_add_fetch(&obj->refcnt, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&obj->lastuse,
+			 __atomic_add_fetch(&sp->clock, 1, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&sp->lock);
+    return obj;
+}
+
+/*
+ * objcache_insert - cache obj, evicting the least recently used
+ *     objects of its shard to make room. Does nothing if obj is too
+ *     big or its key is already cached. The caller keeps its reference.
+ */
+void objcache_insert(struct object *obj)
+{
+    struct shard *sp = &shards[obj->hash % OBJCACHE_SHARDS];
+    struct object **bucket;
+
+    if (obj->size > OBJCACHE_MAXOBJECT || obj->size > shardmax)
+	return;
+
+    pthread_rwlock_wrlock(&sp->lock);
+    if (!find_object(sp, obj->key, obj->hash)) {
+	while (sp->bytes + obj->size > shardmax)
+	    evict(sp);
+	if (sp->nobjs >= sp->nbuckets)
+	    grow_index(sp);
+	bucket = &sp->buckets[(obj->hash / OBJCACHE_SHARDS) &
+			      (sp->nbuckets - 1)];
+	obj->hnext = *bucket;
+	*bucket = obj;
+	obj->lastuse = __atomic_add_fetch(&sp->clock, 1, __ATOMIC_RELAXED);
+	list_front(sp, obj);
+	sp->nobjs++;
+	sp->bytes += obj->size;
+	__atomic_add_fetch(&obj->refcnt, 1, __ATOMIC_RELAXED); /* The cache's */
+    }
+    pthread_rwlock_unlock(&sp->lock);
+}
+
+/*
+ * objcache_release - give back an object from objcache_new() or
+ *     objcache_lookup(), freeing it with the last reference
+ */
+void objcache_release(struct object *obj)
+{
+    if (__atomic_sub_fetch(&obj->refcnt, 1, __ATOMIC_ACQ_REL) > 0)
+	return;
+    free(obj->key);
+    free(obj->data);
+    free(obj);
+}
+
+/*
+ * hash_key - FNV-1a hash of key
+ */
+static unsigned hash_key(const char *key)
+{
+    unsigned h = 2166136261u;
+
+    while (*key)
+	h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+/*
+ * find_object - return sp's object for key, or NULL. Caller holds
+ *     sp's lock. The low bits of h picked the shard, so the bucket
+ *     comes from the bits above them.
+ */
+static struct object *find_object(struct shard *sp, const char *key,
+				  unsigned h)
+{
+    struct object *obj;
+
+    if (sp->nbuckets == 0)
+	return NULL;
+    for (obj = sp->buckets[(h / OBJCACHE_SHARDS) & (sp->nbuckets - 1)];
+	 obj; obj = obj->hnext)
+	if (obj->hash == h && !strcmp(obj->key, key))
+	    return obj;
+    return NULL;
+}
+
+/*
+ * grow_index - double sp's hash index, rehashing every object. Caller
+ *     holds sp's write lock.
+ */
+static void grow_index(struct shard *sp)
+{
+    size_t n = sp->nbuckets ? 2 * sp->nbuckets : MINBUCKETS;
+    struct object **buckets = Calloc(n, sizeof(struct object *));
+    struct object *obj, **bucket;
+
+    for (obj = sp->lru.next; obj != &sp->lru; obj = obj->next) {
+	bucket = &buckets[(obj->hash / OBJCACHE_SHARDS) & (n - 1)];
+	obj->hnext = *bucket;
+	*bucket = obj;
+    }
+    free(sp->buckets);
+    sp->buckets = buckets;
+    sp->nbuckets = n;
+}
+
+/*
+ * list_front - put obj at the front of sp's LRU list, noting when.
+ *     Caller holds sp's write lock.
+ */
+static void list_front(struct shard *sp, struct object *obj)
+{
+    obj->listed = obj->lastuse;
+    obj->prev = &sp->lru;
+    obj->next = sp->lru.next;
+    sp->lru.next->prev = obj;
+    sp->lru.next = obj;
+}
+
+/*
+ * evict - drop sp's least recently used object. Caller holds sp's
+ *     write lock, and sp is not empty.
+ *
+ *     No hits happen while the write lock is held, so an object moved
+ *     to the front here is not moved again by the same call.
+ */
+static void evict(struct shard *sp)
+{
+    struct object *obj, **pp;
+
+    while (1) {
+	obj = sp->lru.prev;
+	obj->prev->next = &sp->lru;
+	sp->lru.prev = obj->prev;
+	if (obj->lastuse == obj->listed)
+	    break;
+	list_front(sp, obj);  /* Hit since it was last put there */
+    }
+
+    for (pp = &sp->buckets[(obj->hash / OBJCACHE_SHARDS) &
+			   (sp->nbuckets - 1)]; *pp != obj; pp = &(*pp)->hnext)
+	;
+    *pp = obj->hnext;
+    sp->nobjs--;
+    sp->bytes -= obj->size;
+    objcache_release(obj);
+}
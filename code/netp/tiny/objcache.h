@@ -0,0 +1,37 @@
+/*
+ * objcache.h - Sharded, size-bounded object cache for the Tiny proxy
+ */
+#ifndef __OBJCACHE_H__
+#define __OBJCACHE_H__
+
+#include "csapp.h"
+
+#define OBJCACHE_SHARDS    16        /* Independently locked parts */
+#define OBJCACHE_MAXOBJECT (1 << 20) /* Largest response we keep */
+
+/* A cached response. data holds the status line and headers, each
+   ending in CRLF but without the blank line, followed by the body.
+   Everything but the private fields is read-only once created. */
+struct object {
+    char *key;                /* Absolute URI of the request */
+    char *data;               /* Headers, then body */
+    size_t hdrlen;            /* Bytes of headers in data */
+    size_t size;              /* Bytes in data */
+
+    /* Private to objcache.c */
+    unsigned hash;            /* Hash of key */
+    int refcnt;               /* Users, plus one while cached */
+    unsigned long lastuse;    /* Shard clock at the last hit */
+    unsigned long listed;     /* Shard clock when put at the LRU front */
+    struct object *hnext;     /* Shard's hash chain */
+    struct object *prev, *next; /* Shard's LRU list */
+};
+
+void objcache_init(size_t maxbytes);
+struct object *objcache_new(const char *key, char *data, size_t hdrlen,
+			    size_t size);
+struct object *objcache_lookup(const char *key);
+void objcache_insert(struct object *obj);
+void objcache_release(struct object *obj);
+
+#endif /* __OBJCACHE_H__ */
@@ -0,0 +1,310 @@
+/*
+ * parsebench.c - Measure the cost of parsing one HTTP request head
+ *
+ *     usage: parsebench [-n iters]
+ *
+ *     Parses a typical browser request iters times, first with the
+ *     whole head in the buffer and then arriving in small pieces the
+ *     way it might off a slow non-blocking socket, and prints the
+ *     average time per request for each.
+ *
+ *     For comparison it also times the two parsers http.c replaced on
+ *     the same request: the previous http.c, which copied the request
+ *     line and the headers it cared about into fixed arrays and started
+ *     over on every call, and the textbook's Rio_readlineb() + sscanf()
+ *     loop. The textbook one reads the request from a socket, one
+ *     line at a time, so its time includes that I/O.
+ */
+#include "csapp.h"
+#include "http.h"
+
+#define PIECE 64  /* Bytes per simulated read in the incremental run */
+
+static const char request[] =
+    "GET /images/godzilla.gif?size=large HTTP/1.1\r\n"
+    "Host: localhost:8000\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+    "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+    "Referer: http://localhost:8000/home.html\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "If-None-Match: \"5f2b3c1a-2d4f\"\r\n"
+    "If-Modified-Since: Wed, 21 Oct 2026 07:28:00 GMT\r\n"
+    "\r\n";
+
+static double elapsed_ns(struct timeval *start, struct timeval *end);
+
+/*
+ * The previous http.c parser, trimmed to what it did for this request
+ */
+#define OLD_MAXVALUE 256
+
+struct old_request {
+    char method[HTTP_MAXTOKEN];
+    char uri[MAXLINE];
+    char version[HTTP_MAXTOKEN];
+    int keepalive;
+    long bodylen;
+    size_t hdrlen;
+    long long range_first, range_last;
+    char if_range[OLD_MAXVALUE];
+    char if_none_match[OLD_MAXVALUE];
+    time_t if_modified_since;
+    int accept_gzip;
+};
+
+static ssize_t old_parse_request(const char *buf, size_t len,
+				 struct old_request *req);
+static const char *old_find_blankline(const char *buf, size_t len);
+static int old_copy_token(char *dst, size_t dstlen, const char *src,
+			  size_t n);
+static int old_is_header(const char *line, const char *value,
+			 const char *name);
+static int old_accepts_gzip(const char *value, const char *eol);
+static time_t old_parse_date(const char *s);
+
+/* The textbook's doit() and read_requesthdrs(), minus the printing */
+static void textbook_read_request(rio_t *rp, char *method, char *uri,
+				  char *version);
+
+int main(int argc, char **argv)
+{
+    int c, i, iters = 1000000;
+    size_t len = sizeof(request) - 1, n;
+    struct http_request req;
+    struct old_request oldreq;
+    char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    struct timeval start, end;
+    ssize_t rc = 0;
+    int sv[2];
+    rio_t rio;
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+	if (c != 'n') {
+	    fprintf(stderr, "usage: %s [-n iters]\n", argv[0]);
+	    exit(1);
+	}
+	iters = atoi(optarg);
+    }
+
+    /* Whole head at once */
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iters; i++) {
+	http_init_request(&req);
+	rc += http_parse_request(request, len, &req);
+    }
+    gettimeofday(&end, NULL);
+    if (rc != (ssize_t)len * iters)
+	app_error("parsebench: parse failed");
+    printf("whole:       %zu-byte head, %d headers, %.0f ns/request\n",
+	   len, req.nheaders, elapsed_ns(&start, &end) / iters);
+
+    /* PIECE bytes at a time */
+    rc = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iters; i++) {
+	http_init_request(&req);
+	for (n = PIECE; n < len; n += PIECE)
+	    rc += http_parse_request(request, n, &req);
+	rc += http_parse_request(request, len, &req);
+    }
+    gettimeofday(&end, NULL);
+    if (rc != (ssize_t)len * iters)
+	app_error("parsebench: incremental parse failed");
+    printf("incremental: %zu calls per request, %.0f ns/request\n",
+	   (len + PIECE - 1) / PIECE, elapsed_ns(&start, &end) / iters);
+
+    /* The previous parser, whole and in pieces */
+    rc = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iters; i++)
+	rc += old_parse_request(request, len, &oldreq);
+    gettimeofday(&end, NULL);
+    if (rc != (ssize_t)len * iters || oldreq.if_modified_since < 0)
+	app_error("parsebench: previous parser failed");
+    printf("previous:    whole head, %.0f ns/request\n",
+	   elapsed_ns(&start, &end) / iters);
+    rc = 0;
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iters; i++) {
+	for (n = PIECE; n < len; n += PIECE)
+	    rc += old_parse_request(request, n, &oldreq);
+	rc += old_parse_request(request, len, &oldreq);
+    }
+    gettimeofday(&end, NULL);
+    if (rc != (ssize_t)len * iters)
+	app_error("parsebench: previous parser failed");
+    printf("previous:    %zu calls per request, %.0f ns/request\n",
+	   (len + PIECE - 1) / PIECE, elapsed_ns(&start, &end) / iters);
+
+    /* The textbook loop, reading the request off a socket */
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+	unix_error("socketpair error");
+    gettimeofday(&start, NULL);
+    for (i = 0; i < iters; i++) {
+	Rio_writen(sv[0], (void *)request, len);
+	Rio_readinitb(&rio, sv[1]);
+	textbook_read_request(&rio, method, uri, version);
+    }
+    gettimeofday(&end, NULL);
+    if (strcmp(method, "GET") || strcmp(version, "HTTP/1.1"))
+	app_error("parsebench: textbook parser failed");
+    printf("textbook:    Rio_readlineb + sscanf, %.0f ns/request\n",
+	   elapsed_ns(&start, &end) / iters);
+    exit(0);
+}
+
+static double elapsed_ns(struct timeval *start, struct timeval *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9 +
+	(end->tv_usec - start->tv_usec) * 1e3;
+}
+
+/*
+ * old_parse_request - the previous http_parse_request(): copy out the
+ *     request line and the values of the headers Tiny used, rescanning
+ *     the whole buffer on every call
+ */
+static ssize_t old_parse_request(const char *buf, size_t len,
+				 struct old_request *req)
+{
+    const char *end, *line, *eol, *sp1, *sp2, *value;
+    char date[OLD_MAXVALUE];
+
+    if (!(end = old_find_blankline(buf, len)))
+	return 0;
+    req->hdrlen = end + 4 - buf;
+
+    eol = memchr(buf, '\r', req->hdrlen);
+    if (!(sp1 = memchr(buf, ' ', eol - buf)) ||
+	!(sp2 = memchr(sp1 + 1, ' ', eol - sp1 - 1)))
+	return -1;
+    if (old_copy_token(req->method, HTTP_MAXTOKEN, buf, sp1 - buf) < 0 ||
+	old_copy_token(req->uri, MAXLINE, sp1 + 1, sp2 - sp1 - 1) < 0 ||
+	old_copy_token(req->version, HTTP_MAXTOKEN, sp2 + 1,
+		       eol - sp2 - 1) < 0)
+	return -1;
+
+    req->keepalive = !strcmp(req->version, "HTTP/1.1");
+    req->bodylen = 0;
+    req->range_first = req->range_last = -1;
+    req->if_range[0] = req->if_none_match[0] = '\0';
+    req->if_modified_since = -1;
+    req->accept_gzip = 0;
+
+    for (line = eol + 2; line < end + 2; line = eol + 2) {
+	eol = memchr(line, '\r', end + 2 - line);
+	if (!(value = memchr(line, ':', eol - line)))
+	    continue;
+	for (value++; value < eol && (*value == ' ' || *value == '\t'); value++)
+	    ;
+	if (old_is_header(line, value, "Connection:"))
+	    req->keepalive = (eol - value >= 10 &&
+			      !strncasecmp(value, "keep-alive", 10));
+	else if (old_is_header(line, value, "Content-length:")) {
+	    req->bodylen = atol(value);
+	    if (req->bodylen < 0)
+		return -1;
+	}
+	else if (old_is_header(line, value, "If-Range:"))
+	    old_copy_token(req->if_range, OLD_MAXVALUE, value, eol - value);
+	else if (old_is_header(line, value, "If-None-Match:"))
+	    old_copy_token(req->if_none_match, OLD_MAXVALUE, value,
+			   eol - value);
+	else if (old_is_header(line, value, "If-Modified-Since:") &&
+		 old_copy_token(date, OLD_MAXVALUE, value, eol - value) == 0)
+	    req->if_modified_since = old_parse_date(date);
+	else if (old_is_header(line, value, "Accept-Encoding:"))
+	    req->accept_gzip = old_accepts_gzip(value, eol);
+    }
+
+    if (len - req->hdrlen < req->bodylen)
+	return 0;
+    return req->hdrlen + req->bodylen;
+}
+
+static const char *old_find_blankline(const char *buf, size_t len)
+{
+    const char *p = buf, *end = buf + len;
+
+    while (end - p >= 4 && (p = memchr(p, '\r', end - p - 3)))
+	if (!memcmp(p, "\r\n\r\n", 4))
+	    return p;
+	else
+	    p++;
+    return NULL;
+}
+
+static int old_copy_token(char *dst, size_t dstlen, const char *src,
+			  size_t n)
+{
+    if (n == 0 || n >= dstlen)
+	return -1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+    return 0;
+}
+
+static int old_is_header(const char *line, const char *value,
+			 const char *name)
+{
+    size_t n = strlen(name);
+
+    return value - line >= n && !strncasecmp(line, name, n);
+}
+
+static int old_accepts_gzip(const char *value, const char *eol)
+{
+    const char *p = value, *tok, *q;
+    size_t n;
+
+    while (p < eol) {
+	while (p < eol && (*p == ' ' || *p == ','))
+	    p++;
+	for (tok = p; p < eol && *p != ',' && *p != ';' && *p != ' '; p++)
+	    ;
+	n = p - tok;
+	for (q = p; p < eol && *p != ','; p++)
+	    ;
+	if ((n == 4 && !strncasecmp(tok, "gzip", 4)) ||
+	    (n == 6 && !strncasecmp(tok, "x-gzip", 6)) ||
+	    (n == 1 && *tok == '*')) {
+	    for (; q < p - 1; q++)
+		if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=')
+		    return strtod(q + 2, NULL) > 0;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static time_t old_parse_date(const char *s)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    struct tm tm;
+    char mon[4];
+    const char *m;
+
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &tm.tm_mday, mon,
+	       &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6 ||
+	strlen(mon) != 3 || !(m = strstr(months, mon)) || (m - months) % 3)
+	return -1;
+    tm.tm_mon = (m - months) / 3;
+    tm.tm_year -= 1900;
+    return timegm(&tm);
+}
+
+static void textbook_read_request(rio_t *rp, char *method, char *uri,
+				  char *version)
+{
+    char buf[MAXLINE];
+
+    Rio_readlineb(rp, buf, MAXLINE);
+    sscanf(buf, "%s %s %s", method, uri, version);
+    Rio_readlineb(rp, buf, MAXLINE);
+    while (strcmp(buf, "\r\n"))
+	Rio_readlineb(rp, buf, MAXLINE);
+}
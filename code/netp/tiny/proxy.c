@@ -0,0 +1,508 @@
+/*
+ * proxy.c - A concurrent, caching HTTP forward proxy built on Tiny's
+ *     request path
+ *
+ * Clients send absolute-form requests ("GET http://host:port/path
+ * HTTP/1.1"), which are parsed with Tiny's http_parse_request() and
+ * answered by doit() much as Tiny does, except that the content comes
+ * from an origin server: the request is forwarded over a fresh
+ * open_clientfd() connection as HTTP/1.0 with "Connection: close",
+ * and the response is read until the origin closes.
+ *
+ * Successful responses of up to OBJCACHE_MAXOBJECT bytes are kept in
+ * a sharded object cache (objcache.c) and later requests for the same
+ * URI are answered without contacting the origin. A response that
+ * varies by Accept-Encoding (and by nothing else) is kept under the
+ * URI plus the request's Accept-Encoding value; one that varies by
+ * other headers, or is encoded without saying Vary, isn't kept. Each
+ * client gets its own thread and may send any number of keep-alive
+ * requests.
+ */
+#include "csapp.h"
+#include "http.h"
+#include "objcache.h"
+
+#define DEFAULT_CACHE_MB 64  /* Cache size if not given */
+
+void *thread(void *vargp);
+void serve_client(int fd);
+int doit(int fd, struct http_request *req);
+int parse_uri(char *uri, char *host, char *port, char *path);
+void vary_key(char *key, char *uri, struct http_request *req);
+size_t build_request(char *out, struct http_request *req,
+		     char *host, char *port, char *path);
+int has_header(struct http_request *req, const char *name);
+struct object *fetch(int fd, char *host, char *port, char *originreq,
+		     size_t reqlen, char *uri, char *varykey, int auth,
+		     int *status, int *cacheable, int *complete);
+size_t filter_headers(char *dst, const char *src, size_t len, int auth,
+		      int *cacheable, int *vary, long *length);
+int only_accept_encoding(const char *value, const char *eol);
+int is_hop_header(const char *name, size_t len);
+int has_word(const char *line, const char *eol, const char *word);
+int send_object(int fd, struct object *obj, int keepalive);
+int clienterror(int fd, char *cause, char *errnum,
+		char *shortmsg, char *longmsg);
+
+int main(int argc, char **argv)
+{
+    int listenfd, *connfdp;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+    pthread_t tid;
+    size_t cachemb = DEFAULT_CACHE_MB;
+
+    if (argc < 2 || argc > 3) {
+	fprintf(stderr, "usage: %s <port> [cachemb]\n", argv[0]);
+	exit(1);
+    }
+    if (argc == 3)
+	cachemb = atoi(argv[2]);
+
+    Signal(SIGPIPE, SIG_IGN);  /* Dead clients and origins show up as EPIPE */
+    objcache_init(cachemb << 20);
+    listenfd = Open_listenfd(argv[1]);
+
+    while (1) {
+	clientlen = sizeof(struct sockaddr_storage);
+	connfdp = Malloc(sizeof(int));
+	*connfdp = Accept(listenfd, (SA *)&clientaddr, &clientlen);
+	Pthread_create(&tid, NULL, thread, connfdp);
+    }
+}
+
+/* Thread routine */
+void *thread(void *vargp)
+{
+    int connfd = *((int *)vargp);
+
+    Pthread_detach(pthread_self());
+    Free(vargp);
+    serve_client(connfd);
+    Close(connfd);
+    return NULL;
+}
+
+/*
+ * serve_client - answer requests on fd until the client or a response
+ *     ends the connection
+ */
+void serve_client(int fd)
+{
+    char buf[MAXBUF];
+    size_t len = 0;
+    ssize_t n, rc;
+    struct http_request req;
+
+    http_init_request(&req);
+    while (1) {
+	while ((n = http_parse_request(buf, len, &req)) == 0) {
+	    if (len == MAXBUF) {
+		clienterror(fd, "", "400", "Bad Request",
+			    "Request header too long");
+		return;
+	    }
+	    if ((rc = read(fd, buf + len, MAXBUF - len)) < 0 && errno == EINTR)
+		continue;
+	    if (rc <= 0)
+		return;
+	    len += rc;
+	}
+	if (n < 0) {
+	    clienterror(fd, "", "400", "Bad Request",
+			"Proxy couldn't parse the request");
+	    return;
+	}
+	if (!doit(fd, &req))
+	    return;
+	len -= n;
+	memmove(buf, buf + n, len);
+	http_init_request(&req);
+    }
+}
+
+/*
+ * doit - answer the request at the front of buf from the cache or the
+ *     origin; return nonzero if the connection may be reused
+ */
+/* $begin proxydoit */
+int doit(int fd, struct http_request *req)
+{
+    char method[HTTP_MAXTOKEN], uri[HTTP_MAXURI];
+    char host[MAXLINE], port[MAXLINE], path[MAXLINE], originreq[MAXBUF];
+    char varykey[MAXBUF];
+    size_t reqlen;
+    struct object *obj;
+    int status, cacheable, complete, keep;
+
+    if (!http_slice_is(req->method, "GET"))
+	return clienterror(fd, http_slice_copy(method, HTTP_MAXTOKEN,
+					       req->method),
+			   "501", "Not Implemented",
+			   "Proxy does not implement this method");
+    if (req->transfer_encoding.p)
+	return clienterror(fd, "", "501", "Not Implemented",
+			   "Proxy does not implement Transfer-Encoding");
+    http_slice_copy(uri, HTTP_MAXURI, req->uri);
+    if (parse_uri(uri, host, port, path) < 0)
+	return clienterror(fd, uri, "400", "Bad Request",
+			   "Proxy needs an absolute http:// URI");
+
+    /* A response that doesn't vary is cached under the URI alone */
+    vary_key(varykey, uri, req);
+    if ((obj = objcache_lookup(uri)) != NULL ||        /* Hit */
+	(varykey[0] && (obj = objcache_lookup(varykey)) != NULL)) {
+	keep = send_object(fd, obj, req->keepalive);
+	objcache_release(obj);
+	return keep;
+    }
+
+    /* Miss: fetch() answers the client itself if the response is too
+       big to buffer, and returns NULL */
+    reqlen = build_request(originreq, req, host, port, path);
+    if (!(obj = fetch(fd, host, port, originreq, reqlen, uri, varykey,
+		      has_header(req, "Authorization"),
+		      &status, &cacheable, &complete))) {
+	if (status < 0)
+	    return clienterror(fd, host, "502", "Bad Gateway",
+			       "Proxy couldn't reach the origin server");
+	return 0;
+    }
+    /* What a client got with its cookies is its own */
+    if (status == 200 && cacheable && !has_header(req, "Cookie"))
+	objcache_insert(obj);
+    /* A short body can only be told from the next response by the
+       connection closing */
+    keep = send_object(fd, obj, req->keepalive && complete);
+    objcache_release(obj);
+    return keep;
+}
+/* $end proxydoit */
+
+/*
+ * parse_uri - split an absolute http:// URI into host, port and path;
+ *     return -1 if it isn't one
+ */
+int parse_uri(char *uri, char *host, char *port, char *path)
+{
+    char *hostp, *portp, *pathp;
+    size_t hostlen;
+
+    if (strncasecmp(uri, "http://", 7))
+	return -1;
+    hostp = uri + 7;
+    if (!(pathp = strchr(hostp, '/')))
+	pathp = hostp + strlen(hostp);
+    portp = memchr(hostp, ':', pathp - hostp);
+    hostlen = (portp ? portp : pathp) - hostp;
+    if (hostlen == 0)
+	return -1;
+
+    memcpy(host, hostp, hostlen);
+    host[hostlen] = '\0';
+    if (portp && pathp - portp > 1) {
+	memcpy(port, portp + 1, pathp - portp - 1);
+	port[pathp - portp - 1] = '\0';
+    }
+    else
+	strcpy(port, "80");
+    strcpy(path, *pathp ? pathp : "/");
+    return 0;
+}
+
+/*
+ * vary_key - write into key the cache key of uri's variant for the
+ *     Accept-Encoding that req sent: uri, a CR (which neither can
+ *     contain), then the header value. key is empty if it won't fit.
+ */
+void vary_key(char *key, char *uri, struct http_request *req)
+{
+    struct http_slice value = { "", 0 };
+    int i;
+
+    for (i = 0; i < req->nheaders; i++)
+	if (http_slice_is(req->headers[i].name, "Accept-Encoding"))
+	    value = req->headers[i].value;
+    if (snprintf(key, MAXBUF, "%s\r%.*s", uri, (int)value.len,
+		 value.p) >= MAXBUF)
+	key[0] = '\0';
+}
+
+/*
+ * has_header - did req come with a header called name?
+ */
+int has_header(struct http_request *req, const char *name)
+{
+    int i;
+
+    for (i = 0; i < req->nheaders; i++)
+	if (http_slice_is(req->headers[i].name, name))
+	    return 1;
+    return 0;
+}
+
+/*
+ * build_request - write the request to send to the origin into out
+ *     and return its length: the client's headers, minus hop-by-hop
+ *     ones, for path over a connection that closes after one response
+ */
+size_t build_request(char *out, struct http_request *req,
+		     char *host, char *port, char *path)
+{
+    struct http_header *h;
+    size_t len, room;
+    int i, hashost = 0;
+
+    /* What we add below: a Host header and the end of the request */
+    room = strlen(host) + strlen(port) +
+	sizeof("Host: :\r\nConnection: close\r\n\r\n");
+    len = snprintf(out, MAXBUF, "GET %s HTTP/1.0\r\n", path);
+    for (i = 0; i < req->nheaders; i++) {
+	h = &req->headers[i];
+	if (is_hop_header(h->name.p, h->name.len))
+	    continue;
+	if (len + h->name.len + h->value.len + 4 + room > MAXBUF)
+	    break;            /* Keep room for what we add below */
+	if (http_slice_is(h->name, "Host"))
+	    hashost = 1;
+	len += sprintf(out + len, "%.*s: %.*s\r\n", (int)h->name.len,
+		       h->name.p, (int)h->value.len, h->value.p);
+    }
+    if (!hashost)
+	len += snprintf(out + len, MAXBUF - len, "Host: %s:%s\r\n", host, port);
+    len += snprintf(out + len, MAXBUF - len, "Connection: close\r\n\r\n");
+    return len;
+}
+
+/*
+ * fetch - send originreq to host:port and read the response for uri
+ *     into a new object, with the origin's hop-by-hop headers dropped
+ *     and a Content-length added. *status is the response status, or
+ *     -1 if the origin couldn't be reached or sent garbage. A response
+ *     too big for the cache is streamed to the client fd as it arrives
+ *     instead, and NULL returned.
+ *
+ *     The object is keyed by varykey if the response varies by
+ *     Accept-Encoding. auth says the request carried Authorization.
+ *     *cacheable says whether the response may be cached at all,
+ *     and *complete whether the body is all there: when the origin
+ *     closes before sending the Content-length it promised, the object
+ *     keeps that length, so the client can tell it was cut short.
+ */
+struct object *fetch(int fd, char *host, char *port, char *originreq,
+		     size_t reqlen, char *uri, char *varykey, int auth,
+		     int *status, int *cacheable, int *complete)
+{
+    char *resp, *data, *blank;
+    size_t len = 0, cap = OBJCACHE_MAXOBJECT + MAXBUF, hdrlen, bodylen;
+    int originfd, vary;
+    long length;
+    ssize_t n;
+    rio_t rio;
+
+    *status = -1;
+    if ((originfd = open_clientfd(host, port)) < 0)
+	return NULL;
+    if (rio_writen(originfd, originreq, reqlen) < 0) {
+	Close(originfd);
+	return NULL;
+    }
+
+    /* Buffer the whole response if it fits */
+    resp = Malloc(cap + 1);
+    rio_readinitb(&rio, originfd);
+    while (len < cap && (n = rio_readnb(&rio, resp + len, cap - len)) > 0)
+	len += n;
+    resp[len] = '\0';  /* Headers are text; stop strstr() at the end */
+    if (!(blank = strstr(resp, "\r\n\r\n")) ||
+	sscanf(resp, "HTTP/%*s %d", status) != 1) {
+	*status = -1;
+	Close(originfd);
+	Free(resp);
+	return NULL;
+    }
+
+    if (len == cap) {
+	/* Too big: pass it through as is and end the client connection */
+	rio_writen(fd, resp, len);
+	while ((n = rio_readnb(&rio, resp, cap)) > 0)
+	    if (rio_writen(fd, resp, n) < 0)
+		break;
+	Close(originfd);
+	Free(resp);
+	return NULL;
+    }
+    Close(originfd);
+
+    /* Rebuild the headers; the body follows the blank line */
+    hdrlen = blank + 2 - resp;
+    bodylen = len - (hdrlen + 2);
+    data = Malloc(hdrlen + MAXLINE + bodylen);
+    hdrlen = filter_headers(data, resp, hdrlen, auth, cacheable, &vary,
+			    &length);
+    *complete = 1;
+    if (length >= 0 && *status >= 200 && *status != 204 && *status != 304) {
+	if (bodylen > length)          /* Ignore anything past it */
+	    bodylen = length;
+	else if (bodylen < length) {   /* Origin hung up early */
+	    *complete = 0;
+	    *cacheable = 0;
+	}
+    }
+    if (vary && !varykey[0])
+	*cacheable = 0;
+    hdrlen += sprintf(data + hdrlen, "Content-length: %ld\r\n",
+		      *complete ? (long)bodylen : length);
+    memcpy(data + hdrlen, blank + 4, bodylen);
+    Free(resp);
+    return objcache_new(vary ? varykey : uri, data, hdrlen, hdrlen + bodylen);
+}
+
+/*
+ * filter_headers - copy the status line and headers in src[0..len),
+ *     minus hop-by-hop ones and Content-length, into dst. Set *length
+ *     to the Content-length (or -1) and *vary if the response varies
+ *     by Accept-Encoding, and clear *cacheable if Cache-Control forbids
+ *     keeping the response, it varies by anything else, it is encoded
+ *     without saying that it varies, or it sets a cookie. With auth
+ *     (the request carried Authorization), it is only cacheable if
+ *     Cache-Control says a shared cache may keep it (RFC 9111 3.5).
+ */
+size_t filter_headers(char *dst, const char *src, size_t len, int auth,
+		      int *cacheable, int *vary, long *length)
+{
+    const char *line, *eol, *colon, *end = src + len;
+    size_t n = 0;
+    int encoded = 0, shared = 0;
+
+    *cacheable = 1;
+    *vary = 0;
+    *length = -1;
+    for (line = src; line < end; line = eol + 2) {
+	eol = strstr(line, "\r\n");
+	if (line > src && (!(colon = memchr(line, ':', eol - line)) ||
+			   is_hop_header(line, colon - line)))
+	    continue;
+	if (!strncasecmp(line, "Content-length:", 15)) {
+	    *length = isdigit((unsigned char)line[15 + strspn(line + 15, " \t")])
+		? strtol(line + 15, NULL, 10) : -1;
+	    continue;
+	}
+	if (!strncasecmp(line, "Cache-Control:", 14) &&
+	    (has_word(line, eol, "no-store") || has_word(line, eol, "private")))
+	    *cacheable = 0;
+	if (!strncasecmp(line, "Cache-Control:", 14) &&
+	    (has_word(line, eol, "public") || has_word(line, eol, "s-maxage") ||
+	     has_word(line, eol, "must-revalidate")))
+	    shared = 1;
+	if (!strncasecmp(line, "Set-Cookie:", 11))
+	    *cacheable = 0;
+	if (!strncasecmp(line, "Content-Encoding:", 17))
+	    encoded = 1;
+	if (!strncasecmp(line, "Vary:", 5)) {
+	    *vary = 1;
+	    if (!only_accept_encoding(line + 5, eol))
+		*cacheable = 0;
+	}
+	memcpy(dst + n, line, eol + 2 - line);
+	n += eol + 2 - line;
+    }
+    if ((encoded && !*vary) || (auth && !shared))
+	*cacheable = 0;
+    return n;
+}
+
+/*
+ * only_accept_encoding - is every name in the Vary list value[0..eol)
+ *     Accept-Encoding?
+ */
+int only_accept_encoding(const char *value, const char *eol)
+{
+    const char *p = value, *tok;
+
+    while (p < eol) {
+	while (p < eol && (*p == ' ' || *p == '\t' || *p == ','))
+	    p++;
+	for (tok = p; p < eol && *p != ' ' && *p != '\t' && *p != ','; p++)
+	    ;
+	if (p > tok && (p - tok != 15 || strncasecmp(tok, "Accept-Encoding", 15)))
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * is_hop_header - is the len-byte header name one that only applies
+ *     to a single connection?
+ */
+int is_hop_header(const char *name, size_t len)
+{
+    static const char *hop[] = {
+	"Connection", "Proxy-Connection", "Keep-Alive", "Proxy-Authorization",
+	"Transfer-Encoding", "TE", "Trailer", "Upgrade", NULL
+    };
+    int i;
+
+    for (i = 0; hop[i]; i++)
+	if (len == strlen(hop[i]) && !strncasecmp(name, hop[i], len))
+	    return 1;
+    return 0;
+}
+
+/*
+ * has_word - does line[0..eol) contain word, ignoring case?
+ */
+int has_word(const char *line, const char *eol, const char *word)
+{
+    size_t n = strlen(word);
+
+    for (; eol - line >= n; line++)
+	if (!strncasecmp(line, word, n))
+	    return 1;
+    return 0;
+}
+
+/*
+ * send_object - send obj to the client, ending the headers with our
+ *     own Connection header, in a single writev(); return nonzero if
+ *     the connection may be reused
+ */
+int send_object(int fd, struct object *obj, int keepalive)
+{
+    char conn[MAXLINE];
+    struct iovec iov[3];
+
+    iov[0].iov_base = obj->data;
+    iov[0].iov_len = obj->hdrlen;
+    iov[1].iov_base = conn;
+    iov[1].iov_len = sprintf(conn, "Connection: %s\r\n\r\n",
+			     keepalive ? "keep-alive" : "close");
+    iov[2].iov_base = obj->data + obj->hdrlen;
+    iov[2].iov_len = obj->size - obj->hdrlen;
+    if (rio_writev(fd, iov, 3) < 0)
+	return 0;
+    return keepalive;
+}
+
+/*
+ * clienterror - returns an error message to the client; always
+ *     returns 0 since the connection is closed afterwards
+ */
+int clienterror(int fd, char *cause, char *errnum,
+		char *shortmsg, char *longmsg)
+{
+    char buf[MAXBUF], body[MAXBUF];
+    int len;
+
+    snprintf(body, MAXBUF, "<html><title>Proxy Error</title>"
+	     "<body bgcolor=\"ffffff\">\r\n%s: %s\r\n<p>%s: %s\r\n"
+	     "<hr><em>The Tiny Web proxy</em>\r\n",
+	     errnum, shortmsg, longmsg, cause);
+    len = snprintf(buf, MAXBUF, "HTTP/1.1 %s %s\r\n"
+		   "Content-type: text/html\r\n"
+		   "Content-length: %d\r\n"
+		   "Connection: close\r\n\r\n%s",
+		   errnum, shortmsg, (int)strlen(body), body);
+    rio_writen(fd, buf, len < MAXBUF ? len : MAXBUF - 1);
+    return 0;
+}
@@ -1,118 +1,624 @@
 /* $begin tinymain */
 /*
- * tiny.c - A simple, iterative HTTP/1.0 Web server that uses the 
+ * tiny.c - A simple, event-driven HTTP/1.1 Web server that uses the 
  *     GET method to serve static and dynamic content.
  *
  * Updated 11/2019 droh 
  *   - Fixed sprintf() aliasing issue in serve_static(), and clienterror().
+ *
+ * Updated 10/2026:
+ *   - serve_static() sends its headers in a single MSG_MORE segment and
+ *     the body with sendfile() instead of mmap() + Rio_writen().
+ *   - Persistent (keep-alive) connections with pipelining. Requests that
+ *     are already buffered are answered under TCP_CORK so that a
+ *     pipelined burst goes out in as few segments as possible.
+ *   - Tiny is no longer iterative. A few event loops, one per thread,
+ *     each run epoll over their own set of non-blocking connections,
+ *     and every connection is a small state machine (read request,
+ *     send headers, stream body). CGI children are reaped by a SIGCHLD
+ *     handler instead of a blocking Wait().
+ *   - Static files are served out of an open-file cache (cache.c), so a
+ *     hot file costs no stat(), open() or MIME lookup.
+ *   - CGI programs with a cgi-bin/<prog>.worker companion are served by
+ *     a pool of pre-forked workers (cgipool.c) instead of fork+execve.
+ *   - Static responses carry Last-Modified and ETag validators and
+ *     answer Range, If-Range, If-Modified-Since and If-None-Match with
+ *     206, 304 or 416. Clients that accept gzip get <file>.gz instead
+ *     of a compressible file when such a sibling exists.
+ *   - Built with "make URING=1", each loop waits on an io_uring instead
+ *     of epoll when the kernel allows: a multishot accept and one
+ *     multishot poll per connection, submitted in batches, replace
+ *     accept4() and epoll_ctl() calls.
  */
 #include "csapp.h"
+#include "http.h"
+#include "cache.h"
+#include "cgipool.h"
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+#ifdef USE_URING
+#include "uring.h"
+#endif
+
+/* glibc only declares accept4() under _GNU_SOURCE, which clashes with
+   csapp.h's own gai_error() */
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+#define IDLE_TIMEOUT 5   /* Seconds a connection may make no progress */
+#define DEFAULT_LOOPS 4  /* Event loops (threads) if not given */
+#define DEFAULT_WORKERS 0 /* Pooled CGI workers per program if not given */
+#define MAXEVENTS 256    /* Events handled per epoll_wait() */
+
+/* What a connection is waiting to do next */
+typedef enum {
+    CONN_READ,      /* Read (the rest of) a request */
+    CONN_SEND_HDRS, /* Send the response headers in out[] */
+    CONN_SEND_BODY  /* Stream the response body from file */
+} conn_state_t;
+
+/* Per-connection state, owned by exactly one event loop */
+typedef struct conn {
+    int fd;                     /* Connected socket */
+    conn_state_t state;         /* Current state */
+    int keepalive;              /* Read another request after this one */
+    int corked;                 /* TCP_CORK is on */
+    char in[MAXBUF];            /* Request bytes read so far */
+    size_t inlen;               /* Number of valid bytes in in[] */
+    char out[MAXBUF];           /* Response headers (or whole error page) */
+    size_t outlen, outpos;      /* Bytes in out[] and bytes sent so far */
+    struct cache_entry *file;   /* Body source, or NULL */
+    off_t fileoff, fileend;     /* Next body byte to send, and end */
+    char *cgiprog, *cgiargs;    /* CGI program to hand the socket to */
+    struct http_request req;    /* Request being parsed from in[] */
+    time_t active;              /* Last time the connection made progress */
+    struct conn *prev, *next;   /* Loop's list, least recently active first */
+#ifdef USE_URING
+    int closed;                 /* Closed, waiting for its poll to end */
+#endif
+} conn_t;
+
+/* An event loop and the connections it owns */
+typedef struct {
+    int epfd;                   /* epoll instance */
+    int listenfd;               /* Shared listening socket */
+    conn_t conns;               /* Sentinel of the activity list */
+#ifdef USE_URING
+    int uring;                  /* Waits on ring rather than epfd */
+    uring_t ring;
+#endif
+} loop_t;
 
-void doit(int fd);
-void read_requesthdrs(rio_t *rp);
+void *loop_run(void *vargp);
+void accept_conns(loop_t *lp);
+void add_conn(loop_t *lp, int connfd, struct sockaddr_storage *addr,
+	      socklen_t addrlen);
+void expire_conns(loop_t *lp);
+void handle_conn(loop_t *lp, conn_t *c);
+void close_conn(loop_t *lp, conn_t *c);
+void touch_conn(loop_t *lp, conn_t *c);
+void set_cork(conn_t *c, int on);
+void doit(conn_t *c, struct http_request *req);
 int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize);
-void get_filetype(char *filename, char *filetype);
-void serve_dynamic(int fd, char *filename, char *cgiargs);
-void clienterror(int fd, char *cause, char *errnum, 
+struct cache_entry *open_static(char *filename, struct stat *sbuf,
+				const char *filetype, int gzip);
+struct cache_entry *open_gzip(struct cache_entry *file, char *filename,
+			      struct http_request *req);
+void serve_static(conn_t *c, struct cache_entry *file,
+		  struct http_request *req);
+int not_modified(struct cache_entry *file, struct http_request *req);
+const char *get_filetype(char *filename);
+int compressible(const char *filetype);
+void serve_dynamic(conn_t *c, char *filename, char *cgiargs);
+void spawn_cgi(conn_t *c);
+void clienterror(conn_t *c, char *cause, char *errnum, 
 		 char *shortmsg, char *longmsg);
+void sigchld_handler(int sig);
+#ifdef USE_URING
+int uring_loop_init(loop_t *lp);
+void uring_loop_run(loop_t *lp);
+struct io_uring_sqe *get_sqe(loop_t *lp);
+#endif
+
+/* epoll tag for the cache's inotify descriptor */
+static char notify_tag;
 
 int main(int argc, char **argv) 
 {
-    int listenfd, connfd;
-    char hostname[MAXLINE], port[MAXLINE];
-    socklen_t clientlen;
-    struct sockaddr_storage clientaddr;
+    int i, nloops = DEFAULT_LOOPS, nworkers = DEFAULT_WORKERS, listenfd;
+    pthread_t tid;
+    loop_t *lp;
+    struct epoll_event ev;
 
     /* Check command line args */
-    if (argc != 2) {
-	fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    if (argc < 2 || argc > 4) {
+	fprintf(stderr, "usage: %s <port> [nthreads [nworkers]]\n", argv[0]);
 	exit(1);
     }
+    if (argc >= 3 && (nloops = atoi(argv[2])) < 1)
+	nloops = 1;
+    if (argc == 4)
+	nworkers = atoi(argv[3]);
 
+    Signal(SIGPIPE, SIG_IGN);              /* Dead clients show up as EPIPE */
+    Signal(SIGCHLD, sigchld_handler);      /* Reap CGI children */
     listenfd = Open_listenfd(argv[1]);
+    fcntl(listenfd, F_SETFL, O_NONBLOCK);
+    fcntl(listenfd, F_SETFD, FD_CLOEXEC);
+    cache_init();
+    cgipool_init("./cgi-bin", nworkers);
+
+    /* Every loop watches the listening socket and the cache's inotify
+       descriptor; EPOLLEXCLUSIVE wakes just one of them per event */
+    for (i = 0; i < nloops; i++) {
+	lp = Malloc(sizeof(loop_t));
+	lp->listenfd = listenfd;
+	lp->conns.prev = lp->conns.next = &lp->conns;
+#ifdef USE_URING
+	if ((lp->uring = (uring_loop_init(lp) == 0))) {
+	    if (i < nloops - 1)
+		Pthread_create(&tid, NULL, loop_run, lp);
+	    continue;
+	}
+#endif
+	if ((lp->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	    unix_error("epoll_create1 error");
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+	    unix_error("epoll_ctl error");
+	ev.data.ptr = &notify_tag;
+	if (cache_notifyfd() >= 0 &&
+	    epoll_ctl(lp->epfd, EPOLL_CTL_ADD, cache_notifyfd(), &ev) < 0)
+	    unix_error("epoll_ctl error");
+	if (i < nloops - 1)
+	    Pthread_create(&tid, NULL, loop_run, lp);
+    }
+    loop_run(lp); /* The main thread runs the last loop */
+    return 0;
+}
+/* $end tinymain */
+
+/*
+ * loop_run - dispatch events for one loop's connections, forever
+ */
+/* $begin loop_run */
+void *loop_run(void *vargp) 
+{
+    loop_t *lp = vargp;
+    struct epoll_event events[MAXEVENTS];
+    int i, n;
+
+#ifdef USE_URING
+    if (lp->uring) {
+	uring_loop_run(lp);
+	return NULL;
+    }
+#endif
+    while (1) {
+	/* Wake up at least once a second to expire idle connections */
+	if ((n = epoll_wait(lp->epfd, events, MAXEVENTS, 1000)) < 0) {
+	    if (errno == EINTR)  /* e.g., SIGCHLD */
+		continue;
+	    unix_error("epoll_wait error");
+	}
+	for (i = 0; i < n; i++) {
+	    if (events[i].data.ptr == NULL)
+		accept_conns(lp);
+	    else if (events[i].data.ptr == &notify_tag)
+		cache_invalidate();
+	    else
+		handle_conn(lp, events[i].data.ptr);
+	}
+	expire_conns(lp);
+    }
+    return NULL;
+}
+/* $end loop_run */
+
+/*
+ * expire_conns - close lp's connections that have been idle too long
+ */
+void expire_conns(loop_t *lp)
+{
+    time_t now = time(NULL);
+
+    while (lp->conns.next != &lp->conns &&
+	   now - lp->conns.next->active >= IDLE_TIMEOUT)
+	close_conn(lp, lp->conns.next);
+}
+
+#ifdef USE_URING
+/* Completions that are not for a connection */
+#define URING_ACCEPT ((unsigned long)NULL)
+#define URING_NOTIFY ((unsigned long)&notify_tag)
+#define URING_REMOVE 1UL  /* A poll removal; never a conn_t address */
+
+/*
+ * uring_loop_init - set up an io_uring for lp, with a multishot accept
+ *     on the listening socket and a poll on the cache's inotify
+ *     descriptor; returns -1, so lp falls back to epoll, if the kernel
+ *     can't do that
+ */
+int uring_loop_init(loop_t *lp)
+{
+    /* SEND_ZC (6.0) implies multishot accept and poll; EXT_ARG lets
+       the wait time out, for idle connections */
+    if (uring_init(&lp->ring, MAXEVENTS) < 0) {
+	fprintf(stderr, "io_uring unavailable (%s), using epoll\n",
+		strerror(errno));
+	return -1;
+    }
+    if (!(lp->ring.features & IORING_FEAT_EXT_ARG) ||
+	!uring_has_op(&lp->ring, IORING_OP_SEND_ZC)) {
+	fprintf(stderr, "io_uring too old, using epoll\n");
+	uring_free(&lp->ring);
+	return -1;
+    }
+    fcntl(lp->ring.fd, F_SETFD, FD_CLOEXEC);
+    uring_prep_accept(get_sqe(lp), lp->listenfd, 1, URING_ACCEPT);
+    if (cache_notifyfd() >= 0)
+	uring_prep_poll(get_sqe(lp), cache_notifyfd(), EPOLLIN, 1,
+			URING_NOTIFY);
+    return 0;
+}
+
+/*
+ * uring_loop_run - loop_run() on io_uring. Every pass submits what the
+ *     last one queued (new polls, removals, re-armed requests) and
+ *     waits for completions in the same io_uring_enter() call.
+ */
+void uring_loop_run(loop_t *lp)
+{
+    struct io_uring_cqe *cqe;
+    struct sockaddr_storage clientaddr;
+    socklen_t clientlen;
+    unsigned long data;
+    unsigned flags;
+    int res;
+    conn_t *c;
+
+    while (1) {
+	/* Wake up at least once a second to expire idle connections */
+	if (uring_submit(&lp->ring, 1, 1000) < 0)
+	    unix_error("io_uring_enter error");
+
+	while ((cqe = uring_peek_cqe(&lp->ring)) != NULL) {
+	    data = cqe->user_data;
+	    res = cqe->res;
+	    flags = cqe->flags;
+	    uring_cqe_seen(&lp->ring);
+
+	    if (data == URING_ACCEPT) {
+		if (res >= 0) {
+		    /* Multishot accepts don't report the peer */
+		    clientlen = sizeof(clientaddr);
+		    if (getpeername(res, (SA *)&clientaddr, &clientlen) < 0)
+			clientlen = 0;
+		    add_conn(lp, res, &clientaddr, clientlen);
+		}
+		else if (res != -EINTR && res != -ECONNABORTED)
+		    fprintf(stderr, "accept error: %s\n", strerror(-res));
+		if (!(flags & IORING_CQE_F_MORE))
+		    uring_prep_accept(get_sqe(lp), lp->listenfd, 1,
+				      URING_ACCEPT);
+		continue;
+	    }
+	    if (data == URING_NOTIFY) {
+		cache_invalidate();
+		if (!(flags & IORING_CQE_F_MORE))
+		    uring_prep_poll(get_sqe(lp), cache_notifyfd(), EPOLLIN, 1,
+				    URING_NOTIFY);
+		continue;
+	    }
+	    if (data == URING_REMOVE)
+		continue;
+
+	    c = (conn_t *)data;
+	    if (c->closed) {
+		if (!(flags & IORING_CQE_F_MORE))
+		    Free(c);      /* Its last completion */
+		continue;
+	    }
+	    if (!(flags & IORING_CQE_F_MORE))
+		uring_prep_poll(get_sqe(lp), c->fd,
+				EPOLLIN | EPOLLOUT | EPOLLRDHUP, 1, data);
+	    handle_conn(lp, c);
+	}
+	expire_conns(lp);
+    }
+}
+
+struct io_uring_sqe *get_sqe(loop_t *lp)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = uring_get_sqe(&lp->ring)) == NULL)
+	unix_error("io_uring_enter error");
+    return sqe;
+}
+#endif /* USE_URING */
+
+/*
+ * accept_conns - accept every pending connection into loop lp
+ */
+void accept_conns(loop_t *lp) 
+{
+    int connfd;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;
+
     while (1) {
 	clientlen = sizeof(clientaddr);
-	connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen); //line:netp:tiny:accept
-        Getnameinfo((SA *) &clientaddr, clientlen, hostname, MAXLINE, 
-                    port, MAXLINE, 0);
-        printf("Accepted connection from (%s, %s)\n", hostname, port);
-	doit(connfd);                                             //line:netp:tiny:doit
-	Close(connfd);                                            //line:netp:tiny:close
+	if ((connfd = accept4(lp->listenfd, (SA *)&clientaddr, &clientlen,
+			      SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+	    if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED)
+		fprintf(stderr, "accept error: %s\n", strerror(errno));
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    return;
+	}
+	add_conn(lp, connfd, &clientaddr, clientlen);
     }
 }
-/* $end tinymain */
 
 /*
- * doit - handle one HTTP request/response transaction
+ * add_conn - start serving connected socket connfd in loop lp
+ */
+void add_conn(loop_t *lp, int connfd, struct sockaddr_storage *addr,
+	      socklen_t addrlen)
+{
+    int one = 1;
+    char hostname[MAXLINE], port[MAXLINE];
+    struct epoll_event ev;
+    conn_t *c;
+
+    if (getnameinfo((SA *)addr, addrlen, hostname, MAXLINE,
+		    port, MAXLINE, NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+	printf("Accepted connection from (%s, %s)\n", hostname, port);
+
+    /* Coalescing is up to TCP_CORK, so don't let Nagle hold back
+       the tail of a response waiting for a delayed ACK */
+    setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    c = Malloc(sizeof(conn_t));
+    c->fd = connfd;
+    c->state = CONN_READ;
+    c->corked = 0;
+    c->inlen = 0;
+    c->file = NULL;
+    c->fileoff = c->fileend = 0;
+    c->cgiprog = c->cgiargs = NULL;
+    http_init_request(&c->req);
+    c->next = c->prev = c;
+    touch_conn(lp, c);
+
+#ifdef USE_URING
+    if (lp->uring) {
+	c->closed = 0;
+	uring_prep_poll(get_sqe(lp), connfd, EPOLLIN | EPOLLOUT | EPOLLRDHUP,
+			1, (unsigned long)c);
+	return;
+    }
+#endif
+    /* Edge-triggered: handle_conn() always runs until EAGAIN */
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(lp->epfd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+	fprintf(stderr, "epoll_ctl error: %s\n", strerror(errno));
+	close_conn(lp, c);
+    }
+}
+
+/*
+ * handle_conn - advance connection c as far as it will go without
+ *     blocking
+ */
+/* $begin handle_conn */
+void handle_conn(loop_t *lp, conn_t *c) 
+{
+    ssize_t n;
+
+    while (1) {
+	switch (c->state) {
+	case CONN_READ:
+	    /* Serve any request that is already complete in in[] */
+	    if ((n = http_parse_request(c->in, c->inlen, &c->req)) > 0) {
+		fwrite(c->in, 1, c->req.hdrlen, stdout);
+		doit(c, &c->req);
+		c->inlen -= n;
+		memmove(c->in, c->in + n, c->inlen);
+		http_init_request(&c->req);
+		break;
+	    }
+	    if (n < 0 || c->inlen == MAXBUF) {
+		clienterror(c, "", "400", "Bad Request",
+			    "Tiny couldn't parse the request");
+		break;
+	    }
+
+	    /* Out of complete requests: flush what has been written, even
+	       with part of the next one in in[], as the rest of it may not
+	       come until the client has seen these responses */
+	    if (c->corked)
+		set_cork(c, 0);
+	    if ((n = read(c->fd, c->in + c->inlen, MAXBUF - c->inlen)) > 0) {
+		c->inlen += n;
+		touch_conn(lp, c);
+		break;
+	    }
+	    if (n < 0 && errno == EAGAIN)
+		return;
+	    close_conn(lp, c); /* EOF or error */
+	    return;
+
+	case CONN_SEND_HDRS:
+	    n = send(c->fd, c->out + c->outpos, c->outlen - c->outpos,
+		     MSG_NOSIGNAL | (c->file ? MSG_MORE : 0));
+	    if (n < 0) {
+		if (errno == EAGAIN)
+		    return;
+		close_conn(lp, c);
+		return;
+	    }
+	    touch_conn(lp, c);
+	    if ((c->outpos += n) < c->outlen)
+		break;
+	    if (c->cgiprog) {       /* The CGI program writes the rest */
+		set_cork(c, 0);
+		if (cgipool_dispatch(c->cgiprog, c->fd, c->cgiargs) < 0)
+		    spawn_cgi(c);   /* No pool, or it is backed up */
+		close_conn(lp, c);
+		return;
+	    }
+	    c->state = CONN_SEND_BODY;
+	    break;
+
+	case CONN_SEND_BODY:
+	    if (c->file && c->fileoff < c->fileend) {
+		n = sendfile(c->fd, c->file->fd, &c->fileoff,
+			     c->fileend - c->fileoff);
+		if (n < 0 && errno == EAGAIN)
+		    return;
+		if (n <= 0) {  /* Error, or the file shrank under us */
+		    close_conn(lp, c);
+		    return;
+		}
+		touch_conn(lp, c);
+		break;
+	    }
+
+	    /* Response is out; on to the next request, if any */
+	    if (c->file) {
+		cache_release(c->file);
+		c->file = NULL;
+	    }
+	    if (!c->keepalive) {
+		close_conn(lp, c);
+		return;
+	    }
+	    c->state = CONN_READ;
+	    break;
+	}
+    }
+}
+/* $end handle_conn */
+
+/*
+ * close_conn - close c and forget about it
+ */
+void close_conn(loop_t *lp, conn_t *c) 
+{
+    c->prev->next = c->next;
+    c->next->prev = c->prev;
+    if (c->file)
+	cache_release(c->file);
+    free(c->cgiprog);
+    free(c->cgiargs);
+#ifdef USE_URING
+    if (lp->uring) {
+	/* Completions for c may already be queued; c is freed when its
+	   poll reports that it has ended */
+	uring_prep_poll_remove(get_sqe(lp), (unsigned long)c, URING_REMOVE);
+	Close(c->fd);
+	c->closed = 1;
+	return;
+    }
+#endif
+    /* A CGI child or pool worker may still hold the socket, and epoll
+       keeps reporting a file until its last descriptor is closed */
+    epoll_ctl(lp->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    Close(c->fd);
+    Free(c);
+}
+
+/*
+ * touch_conn - note that c made progress, moving it to the back of
+ *     lp's activity list
+ */
+void touch_conn(loop_t *lp, conn_t *c) 
+{
+    c->active = time(NULL);
+    c->prev->next = c->next;
+    c->next->prev = c->prev;
+    c->prev = lp->conns.prev;
+    c->next = &lp->conns;
+    lp->conns.prev->next = c;
+    lp->conns.prev = c;
+}
+
+/*
+ * set_cork - hold back (on = 1) or flush (on = 0) partial TCP segments
+ */
+void set_cork(conn_t *c, int on)
+{
+    setsockopt(c->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    c->corked = on;
+}
+
+/*
+ * doit - set up the response to one HTTP request
  */
 /* $begin doit */
-void doit(int fd) 
+void doit(conn_t *c, struct http_request *req) 
 {
     int is_static;
     struct stat sbuf;
-    char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+    char method[HTTP_MAXTOKEN], uri[HTTP_MAXURI];
     char filename[MAXLINE], cgiargs[MAXLINE];
-    rio_t rio;
+    struct cache_entry *file;
 
-    /* Read request line and headers */
-    Rio_readinitb(&rio, fd);
-    if (!Rio_readlineb(&rio, buf, MAXLINE))  //line:netp:doit:readrequest
-        return;
-    printf("%s", buf);
-    sscanf(buf, "%s %s %s", method, uri, version);       //line:netp:doit:parserequest
-    if (strcasecmp(method, "GET")) {                     //line:netp:doit:beginrequesterr
-        clienterror(fd, method, "501", "Not Implemented",
+    c->keepalive = req->keepalive;
+    if (!c->corked)                                      /* Batch the response */
+	set_cork(c, 1);
+    if (!http_slice_is(req->method, "GET")) {            //line:netp:doit:beginrequesterr
+        clienterror(c, http_slice_copy(method, HTTP_MAXTOKEN, req->method),
+                    "501", "Not Implemented",
                     "Tiny does not implement this method");
         return;
     }                                                    //line:netp:doit:endrequesterr
-    read_requesthdrs(&rio);                              //line:netp:doit:readrequesthdrs
+    if (req->transfer_encoding.p) {                      /* Chunked body */
+	clienterror(c, "", "501", "Not Implemented",
+		    "Tiny does not implement Transfer-Encoding");
+	return;
+    }
 
     /* Parse URI from GET request */
+    http_slice_copy(uri, HTTP_MAXURI, req->uri);
     is_static = parse_uri(uri, filename, cgiargs);       //line:netp:doit:staticcheck
+    if (is_static && (file = cache_lookup(filename))) {  /* Hot file */
+	serve_static(c, open_gzip(file, filename, req), req);
+	return;
+    }
     if (stat(filename, &sbuf) < 0) {                     //line:netp:doit:beginnotfound
-	clienterror(fd, filename, "404", "Not found",
+	clienterror(c, filename, "404", "Not found",
 		    "Tiny couldn't find this file");
 	return;
     }                                                    //line:netp:doit:endnotfound
 
     if (is_static) { /* Serve static content */          
 	if (!(S_ISREG(sbuf.st_mode)) || !(S_IRUSR & sbuf.st_mode)) { //line:netp:doit:readable
-	    clienterror(fd, filename, "403", "Forbidden",
+	    clienterror(c, filename, "403", "Forbidden",
+			"Tiny couldn't read the file");
+	    return;
+	}
+	if (!(file = open_static(filename, &sbuf, get_filetype(filename), 0))) {
+	    clienterror(c, filename, "403", "Forbidden",
 			"Tiny couldn't read the file");
 	    return;
 	}
-	serve_static(fd, filename, sbuf.st_size);        //line:netp:doit:servestatic
+	serve_static(c, open_gzip(file, filename, req), req); //line:netp:doit:servestatic
     }
     else { /* Serve dynamic content */
 	if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) { //line:netp:doit:executable
-	    clienterror(fd, filename, "403", "Forbidden",
+	    clienterror(c, filename, "403", "Forbidden",
 			"Tiny couldn't run the CGI program");
 	    return;
 	}
-	serve_dynamic(fd, filename, cgiargs);            //line:netp:doit:servedynamic
+	serve_dynamic(c, filename, cgiargs);             //line:netp:doit:servedynamic
     }
 }
 /* $end doit */
 
-/*
- * read_requesthdrs - read HTTP request headers
- */
-/* $begin read_requesthdrs */
-void read_requesthdrs(rio_t *rp) 
-{
-    char buf[MAXLINE];
-
-    Rio_readlineb(rp, buf, MAXLINE);
-    printf("%s", buf);
-    while(strcmp(buf, "\r\n")) {          //line:netp:readhdrs:checkterm
-	Rio_readlineb(rp, buf, MAXLINE);
-	printf("%s", buf);
-    }
-    return;
-}
-/* $end read_requesthdrs */
-
 /*
  * parse_uri - parse URI into filename and CGI args
  *             return 0 if dynamic content, 1 if static
@@ -146,100 +652,296 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 /* $end parse_uri */
 
 /*
- * serve_static - copy a file back to the client 
+ * open_static - open a file and cache it along with the parts of its
+ *     response headers that never change; return NULL on failure.
+ *     With gzip set, filename is the precompressed sibling of a file
+ *     of the given type.
+ */
+struct cache_entry *open_static(char *filename, struct stat *sbuf,
+				const char *filetype, int gzip)
+{
+    char hdrs[MAXBUF], etag[CACHE_MAXETAG], lastmod[MAXLINE];
+    int fd, hdrlen;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0)
+	return NULL;
+
+    /* Validators: the two encodings of a file must not share a tag */
+    snprintf(etag, CACHE_MAXETAG, "\"%llx-%llx%s\"",
+	     (long long)sbuf->st_mtime, (long long)sbuf->st_size,
+	     gzip ? "-gz" : "");
+    http_format_date(lastmod, MAXLINE, sbuf->st_mtime);
+
+    hdrlen = snprintf(hdrs, MAXBUF,      //line:netp:servestatic:beginserve
+                      "Content-type: %s\r\n"
+                      "%s%s"
+                      "Last-Modified: %s\r\n"
+                      "ETag: %s\r\n"
+                      "Accept-Ranges: bytes\r\n",
+                      filetype,
+                      gzip ? "Content-Encoding: gzip\r\n" : "",
+                      compressible(filetype) ? "Vary: Accept-Encoding\r\n" : "",
+                      lastmod, etag);    //line:netp:servestatic:endserve
+    return cache_insert(filename, fd, sbuf, filetype, etag, hdrs, hdrlen);
+}
+
+/*
+ * open_gzip - return the precompressed <filename>.gz sibling of file
+ *     in its place, if the client accepts gzip and file is worth
+ *     compressing and has one. The sibling, or that there is none, is
+ *     remembered with file's cache entry, so a hot file is only looked
+ *     for once.
+ */
+struct cache_entry *open_gzip(struct cache_entry *file, char *filename,
+			      struct http_request *req)
+{
+    char gzname[MAXLINE];
+    struct cache_entry *gz;
+    struct stat sbuf;
+
+    if (!req->accept_gzip || !compressible(file->filetype))
+	return file;
+    if (!(gz = cache_variant(file))) {                   /* Not known yet */
+	if (snprintf(gzname, MAXLINE, "%s.gz", filename) >= MAXLINE)
+	    return file;
+	if (stat(gzname, &sbuf) < 0 || !S_ISREG(sbuf.st_mode) ||
+	    !(gz = open_static(gzname, &sbuf, file->filetype, 1)))
+	    gz = cache_insert_missing(gzname);
+	cache_set_variant(file, gz);
+    }
+    if (gz->fd < 0) {                                    /* There is none */
+	cache_release(gz);
+	return file;
+    }
+    cache_release(file);
+    return gz;
+}
+
+/*
+ * serve_static - queue the response to a GET of file: the whole file,
+ *     one byte range of it (206), or no body at all when the client's
+ *     copy is still good (304) or the range is past the end (416)
  */
 /* $begin serve_static */
-void serve_static(int fd, char *filename, int filesize)
+void serve_static(conn_t *c, struct cache_entry *file,
+		  struct http_request *req)
 {
-    int srcfd;
-    char *srcp, filetype[MAXLINE], buf[MAXBUF];
+    off_t first = 0, last = file->size - 1, len = -1;
+    char *status = "200 OK", range[MAXLINE] = "";
+    int partial = (req->range_first >= 0 || req->range_last >= 0);
 
-    /* Send response headers to client */
-    get_filetype(filename, filetype);    //line:netp:servestatic:getfiletype
-    sprintf(buf, "HTTP/1.0 200 OK\r\n"); //line:netp:servestatic:beginserve
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Server: Tiny Web Server\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-length: %d\r\n", filesize);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: %s\r\n\r\n", filetype);
-    Rio_writen(fd, buf, strlen(buf));    //line:netp:servestatic:endserve
+    /* A range is only honored for the version named in If-Range */
+    if (partial && req->if_range.len &&
+	!http_slice_eq(req->if_range, file->etag) &&
+	http_parse_date(req->if_range.p, req->if_range.len) != file->mtime)
+	partial = 0;
 
-    /* Send response body to client */
-    srcfd = Open(filename, O_RDONLY, 0); //line:netp:servestatic:open
-    srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0); //line:netp:servestatic:mmap
-    Close(srcfd);                       //line:netp:servestatic:close
-    Rio_writen(fd, srcp, filesize);     //line:netp:servestatic:write
-    Munmap(srcp, filesize);             //line:netp:servestatic:munmap
+    if (not_modified(file, req)) {
+	status = "304 Not Modified";
+	len = file->size;   /* What a 200 would have said */
+	last = -1;
+    }
+    else if (partial) {
+	if (req->range_first < 0) {          /* Last range_last bytes */
+	    first = file->size - req->range_last;
+	    if (first < 0)
+		first = 0;
+	}
+	else {
+	    first = req->range_first;
+	    if (req->range_last >= 0 && req->range_last < last)
+		last = req->range_last;
+	}
+	if (first > last) {                  /* Nothing of it exists */
+	    status = "416 Range Not Satisfiable";
+	    sprintf(range, "Content-Range: bytes */%lld\r\n",
+		    (long long)file->size);
+	    first = 0;
+	    last = -1;
+	}
+	else {
+	    status = "206 Partial Content";
+	    sprintf(range, "Content-Range: bytes %lld-%lld/%lld\r\n",
+		    (long long)first, (long long)last, (long long)file->size);
+	}
+    }
+
+    /* Status line and per-request headers, then the prebuilt ones */
+    if (len < 0)
+	len = last - first + 1;
+    c->outlen = sprintf(c->out, "HTTP/1.1 %s\r\n"
+                        "Server: Tiny Web Server\r\n"
+                        "Content-length: %lld\r\n%s",
+                        status, (long long)len, range);
+    memcpy(c->out + c->outlen, file->hdrs, file->hdrlen);
+    c->outlen += file->hdrlen;
+    c->outlen += sprintf(c->out + c->outlen, "Connection: %s\r\n\r\n",
+                         c->keepalive ? "keep-alive" : "close");
+    c->outpos = 0;
+    c->state = CONN_SEND_HDRS;
+
+    if (last < first) {                      /* Headers only */
+	cache_release(file);
+	c->file = NULL;
+	c->fileoff = c->fileend = 0;
+	return;
+    }
+    c->file = file;
+    c->fileoff = first;
+    c->fileend = last + 1;
+}
+
+/*
+ * not_modified - is the client's cached copy of file still current?
+ *     If-None-Match takes precedence over If-Modified-Since.
+ */
+int not_modified(struct cache_entry *file, struct http_request *req)
+{
+    if (req->if_none_match.len)  /* "*" or a list that has our tag */
+	return http_slice_eq(req->if_none_match, "*") ||
+	    http_slice_has(req->if_none_match, file->etag);
+    return req->if_modified_since >= 0 &&
+	file->mtime <= req->if_modified_since;
 }
 
 /*
  * get_filetype - derive file type from file name
  */
-void get_filetype(char *filename, char *filetype) 
-{
-    if (strstr(filename, ".html"))
-	strcpy(filetype, "text/html");
-    else if (strstr(filename, ".gif"))
-	strcpy(filetype, "image/gif");
-    else if (strstr(filename, ".png"))
-	strcpy(filetype, "image/png");
-    else if (strstr(filename, ".jpg"))
-	strcpy(filetype, "image/jpeg");
-    else
-	strcpy(filetype, "text/plain");
+const char *get_filetype(char *filename) 
+{
+    static const struct { const char *ext, *type; } types[] = {
+	{ ".html", "text/html" },
+	{ ".gif", "image/gif" },
+	{ ".png", "image/png" },
+	{ ".jpg", "image/jpeg" },
+	{ ".css", "text/css" },
+	{ ".js", "application/javascript" },
+	{ ".json", "application/json" },
+	{ ".svg", "image/svg+xml" },
+	{ NULL, NULL }
+    };
+    char *ext = strrchr(filename, '.');
+    int i;
+
+    for (i = 0; ext && types[i].ext; i++)
+	if (!strcmp(ext, types[i].ext))
+	    return types[i].type;
+    return "text/plain";
 }  
 /* $end serve_static */
 
 /*
- * serve_dynamic - run a CGI program on behalf of the client
+ * compressible - is content of this type worth sending gzipped?
  */
-/* $begin serve_dynamic */
-void serve_dynamic(int fd, char *filename, char *cgiargs) 
+int compressible(const char *filetype)
 {
-    char buf[MAXLINE], *emptylist[] = { NULL };
+    return !strncmp(filetype, "text/", 5) || strstr(filetype, "javascript") ||
+	strstr(filetype, "json") || strstr(filetype, "+xml");
+}
 
+/*
+ * serve_dynamic - queue the first part of the response; the rest
+ *     comes from a CGI program that gets the socket once it is sent
+ */
+/* $begin serve_dynamic */
+void serve_dynamic(conn_t *c, char *filename, char *cgiargs) 
+{
     /* Return first part of HTTP response */
-    sprintf(buf, "HTTP/1.0 200 OK\r\n"); 
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Server: Tiny Web Server\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-  
-    if (Fork() == 0) { /* Child */ //line:netp:servedynamic:fork
-	/* Real server would set all CGI vars here */
-	setenv("QUERY_STRING", cgiargs, 1); //line:netp:servedynamic:setenv
-	Dup2(fd, STDOUT_FILENO);         /* Redirect stdout to client */ //line:netp:servedynamic:dup2
-	Execve(filename, emptylist, environ); /* Run CGI program */ //line:netp:servedynamic:execve
-    }
-    Wait(NULL); /* Parent waits for and reaps child */ //line:netp:servedynamic:wait
+    c->outlen = snprintf(c->out, MAXBUF, "HTTP/1.1 200 OK\r\n"
+                         "Server: Tiny Web Server\r\n");
+    c->outpos = 0;
+    c->state = CONN_SEND_HDRS;
+    c->file = NULL;
+    c->fileoff = c->fileend = 0;
+
+    /* CGI output carries no length we can rely on, so the end of the
+       response is marked by closing the connection */
+    c->keepalive = 0;
+    c->cgiprog = strdup(filename);
+    c->cgiargs = strdup(cgiargs);
+}
+
+/*
+ * spawn_cgi - run c's CGI program with its stdout on the socket
+ */
+void spawn_cgi(conn_t *c) 
+{
+    char *emptylist[] = { NULL }, **envp, *qs;
+    int i, n;
+    pid_t pid;
+
+    /* Build the environment before forking: the child of a threaded
+       process may only make async-signal-safe calls before execve */
+    for (n = 0; environ[n]; n++)
+	;
+    envp = Malloc((n + 2) * sizeof(char *));
+    qs = Malloc(strlen(c->cgiargs) + sizeof("QUERY_STRING="));
+    sprintf(qs, "QUERY_STRING=%s", c->cgiargs);
+    envp[0] = qs;                        //line:netp:servedynamic:setenv
+    for (i = 0; i < n; i++)
+	envp[i+1] = environ[i];
+    envp[n+1] = NULL;
+
+    if ((pid = fork()) == 0) { /* Child */ //line:netp:servedynamic:fork
+	/* The child blocks on the socket like any other CGI program */
+	fcntl(c->fd, F_SETFL, 0);
+	signal(SIGPIPE, SIG_DFL);
+	dup2(c->fd, STDOUT_FILENO);      /* Redirect stdout to client */ //line:netp:servedynamic:dup2
+	execve(c->cgiprog, emptylist, envp); /* Run CGI program */ //line:netp:servedynamic:execve
+	_exit(1);
+    }
+    if (pid < 0)
+	fprintf(stderr, "fork error: %s\n", strerror(errno));
+    Free(qs);
+    Free(envp);
 }
 /* $end serve_dynamic */
 
 /*
- * clienterror - returns an error message to the client
+ * sigchld_handler - reap every CGI child (or pool supervisor) that
+ *     has exited
+ */
+void sigchld_handler(int sig) 
+{
+    int olderrno = errno;
+
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+	;
+    errno = olderrno;
+}
+
+/*
+ * clienterror - queue an error message for the client and close the
+ *     connection once it is sent
  */
 /* $begin clienterror */
-void clienterror(int fd, char *cause, char *errnum, 
+void clienterror(conn_t *c, char *cause, char *errnum, 
 		 char *shortmsg, char *longmsg) 
 {
-    char buf[MAXLINE];
-
-    /* Print the HTTP response headers */
-    sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "Content-type: text/html\r\n\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-
-    /* Print the HTTP response body */
-    sprintf(buf, "<html><title>Tiny Error</title>");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "<body bgcolor=""ffffff"">\r\n");
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "%s: %s\r\n", errnum, shortmsg);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "<p>%s: %s\r\n", longmsg, cause);
-    Rio_writen(fd, buf, strlen(buf));
-    sprintf(buf, "<hr><em>The Tiny Web server</em>\r\n");
-    Rio_writen(fd, buf, strlen(buf));
+    char body[MAXBUF];
+    int bodylen;
+
+    /* Build the HTTP response body */
+    bodylen = snprintf(body, MAXBUF,
+                       "<html><title>Tiny Error</title>"
+                       "<body bgcolor=""ffffff"">\r\n"
+                       "%s: %s\r\n"
+                       "<p>%s: %.512s\r\n"
+                       "<hr><em>The Tiny Web server</em>\r\n",
+                       errnum, shortmsg, longmsg, cause);
+
+    /* Headers and body go out together. The body is sized up front
+       so the client can tell where it ends. */
+    c->outlen = snprintf(c->out, MAXBUF,
+                         "HTTP/1.1 %s %s\r\n"
+                         "Connection: close\r\n"
+                         "Content-length: %d\r\n"
+                         "Content-type: text/html\r\n\r\n%s",
+                         errnum, shortmsg, bodylen, body);
+    c->outpos = 0;
+    c->keepalive = 0;
+    c->state = CONN_SEND_HDRS;
+    c->file = NULL;
+    c->fileoff = c->fileend = 0;
 }
 /* $end clienterror */
@@ -0,0 +1,161 @@
+/*
+ * tinybench.c - Measure the request rate of a Web server by fetching
+ *     the same URI over and over, one connection per request.
+ *
+ *     usage: tinybench [-n nreqs] [-k] [-P depth] [-p serverpid]
+ *                      <host> <port> <uri>
+ *
+ *     With -k, all requests go over one persistent HTTP/1.1
+ *     connection, and with -P they are also pipelined: depth requests
+ *     are written back to back before their responses are read.
+ *
+ *     If the server's pid is given, the user+system CPU time that the
+ *     server burned during the run is read from /proc and reported
+ *     per request. Otherwise only the client side is measured.
+ */
+#include "csapp.h"
+
+static long proc_cputicks(pid_t pid);
+static void send_requests(int fd, char *uri, int n, int keepalive);
+static ssize_t read_response(rio_t *rp);
+
+int main(int argc, char **argv)
+{
+    int c, i, j, nreqs = 1000, keepalive = 0, depth = 1, clientfd = -1;
+    pid_t serverpid = 0;
+    rio_t rio;
+    long ticks0 = 0, ticks1 = 0;
+    double secs, bytes = 0;
+    struct timeval start, end;
+    ssize_t n;
+
+    while ((c = getopt(argc, argv, "n:kP:p:")) != -1) {
+	switch (c) {
+	case 'n':
+	    nreqs = atoi(optarg);
+	    break;
+	case 'k':
+	    keepalive = 1;
+	    break;
+	case 'P':
+	    keepalive = 1;
+	    depth = atoi(optarg) > 0 ? atoi(optarg) : 1;
+	    break;
+	case 'p':
+	    serverpid = atoi(optarg);
+	    break;
+	default:
+	    optind = argc + 1; /* force the usage message */
+	}
+    }
+    if (argc - optind != 3) {
+	fprintf(stderr, "usage: %s [-n nreqs] [-k] [-P depth] [-p serverpid] "
+		"<host> <port> <uri>\n", argv[0]);
+	exit(1);
+    }
+
+    if (serverpid > 0)
+	ticks0 = proc_cputicks(serverpid);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nreqs; i += depth) {
+	if (depth > nreqs - i)
+	    depth = nreqs - i;
+	if (clientfd < 0) {
+	    clientfd = Open_clientfd(argv[optind], argv[optind+1]);
+	    Rio_readinitb(&rio, clientfd);
+	}
+	send_requests(clientfd, argv[optind+2], depth, keepalive);
+	for (j = 0; j < depth; j++) {
+	    if ((n = read_response(&rio)) < 0)
+		app_error("tinybench: bad response");
+	    bytes += n;
+	}
+	if (!keepalive) {
+	    Close(clientfd);
+	    clientfd = -1;
+	}
+    }
+    if (clientfd >= 0)
+	Close(clientfd);
+    gettimeofday(&end, NULL);
+    if (serverpid > 0)
+	ticks1 = proc_cputicks(serverpid);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    printf("%s: %d requests in %.3f s, %.0f req/s, %.1f MB/s",
+	   argv[optind+2], nreqs, secs, nreqs / secs, bytes / secs / 1e6);
+    if (serverpid > 0)
+	printf(", server cpu %.1f us/req",
+	       (ticks1 - ticks0) * 1e6 / sysconf(_SC_CLK_TCK) / nreqs);
+    printf("\n");
+    exit(0);
+}
+
+/*
+ * send_requests - write n GETs for uri to fd in a single write
+ */
+static void send_requests(int fd, char *uri, int n, int keepalive)
+{
+    char req[MAXLINE], *buf = Malloc(n * MAXLINE);
+    int i, len;
+
+    len = snprintf(req, MAXLINE, keepalive ? "GET %s HTTP/1.1\r\n\r\n" :
+		   "GET %s HTTP/1.0\r\n\r\n", uri);
+    for (i = 0; i < n; i++)
+	memcpy(buf + i * len, req, len);
+    Rio_writen(fd, buf, n * len);
+    Free(buf);
+}
+
+/*
+ * read_response - read one response from rp and return the body
+ *     length, or -1 if the response is malformed
+ */
+static ssize_t read_response(rio_t *rp)
+{
+    ssize_t len = -1, n;
+    char buf[MAXLINE];
+
+    /* Read the headers, remembering the Content-length */
+    while (Rio_readlineb(rp, buf, MAXLINE) > 0 && strcmp(buf, "\r\n"))
+	if (!strncasecmp(buf, "Content-length:", 15))
+	    len = atol(buf + 15);
+
+    /* Drain the body */
+    if (len >= 0) {
+	for (n = 0; n < len; ) {
+	    ssize_t rc = Rio_readnb(rp, buf,
+				    len - n < MAXLINE ? len - n : MAXLINE);
+	    if (rc == 0)
+		break;
+	    n += rc;
+	}
+	if (n != len)
+	    len = -1;
+    }
+    return len;
+}
+
+/*
+ * proc_cputicks - user+system time consumed so far by process pid,
+ *     in clock ticks
+ */
+static long proc_cputicks(pid_t pid)
+{
+    char path[MAXLINE], buf[MAXLINE], *p;
+    long utime, stime;
+    FILE *fp;
+
+    snprintf(path, MAXLINE, "/proc/%d/stat", (int)pid);
+    fp = Fopen(path, "r");
+    Fgets(buf, MAXLINE, fp);
+    Fclose(fp);
+
+    /* Skip "pid (comm) state"; comm may contain blanks */
+    if (!(p = strrchr(buf, ')')))
+	app_error("tinybench: bad /proc stat line");
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld",
+	       &utime, &stime) != 2)
+	app_error("tinybench: bad /proc stat line");
+    return utime + stime;
+}
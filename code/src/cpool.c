@@ -0,0 +1,316 @@
+/*
+ * cpool.c - Pools of persistent client connections with pipelined,
+ *     in-order requests
+ *
+ * A thread takes a connection with cpool_get, queues any number of
+ * requests on it with cpool_send, and collects the responses with
+ * cpool_wait, which runs each request's callback in the order the
+ * requests were sent. cpool_put hands the connection back for reuse,
+ * so the connect (and lookup) cost is paid once per connection rather
+ * than once per request. Requests are buffered and go out together
+ * when cpool_wait flushes them, or when the buffer fills; the server
+ * must be able to absorb a pipeline's worth of requests without us
+ * reading its responses.
+ *
+ * New connections come from open_clientfd_cached, which is
+ * open_clientfd plus a small table of the address that last accepted
+ * a connection for each host:port, so that most connects skip
+ * getaddrinfo.
+ */
+#include "cpool.h"
+#include <time.h>
+
+/* The address that last worked for a host:port */
+typedef struct {
+    char host[MAXLINE], port[16];
+    int family, socktype, protocol;
+    socklen_t addrlen;
+    struct sockaddr_storage addr;
+    time_t expires;              /* 0 if the slot is free */
+} addrent_t;
+
+static addrent_t addrcache[CPOOL_ADDRCACHE];
+static pthread_mutex_t addrlock = PTHREAD_MUTEX_INITIALIZER;
+
+static int addrcache_find(char *hostname, char *port);
+static int cpool_fail(cpool_conn_t *c);
+static int cpool_alive(cpool_conn_t *c);
+
+/*
+ * open_clientfd_cached - open_clientfd that first tries the address
+ *     that last worked for hostname:port, if it was looked up less than
+ *     CPOOL_ADDRTTL seconds ago. Same return values as open_clientfd.
+ */
+int open_clientfd_cached(char *hostname, char *port)
+{
+    int clientfd, rc, i;
+    struct addrinfo hints, *listp, *p;
+    addrent_t a, *e;
+    time_t now = time(NULL);
+
+    /* Copy the entry out so the lock isn't held across connect() */
+    pthread_mutex_lock(&addrlock);
+    i = addrcache_find(hostname, port);
+    if (i >= 0 && addrcache[i].expires > now)
+	a = addrcache[i];
+    else
+	a.expires = 0;
+    pthread_mutex_unlock(&addrlock);
+
+    if (a.expires) {
+	if ((clientfd = socket(a.family, a.socktype, a.protocol)) >= 0) {
+	    if (connect(clientfd, (SA *)&a.addr, a.addrlen) != -1)
+		return clientfd;
+	    close(clientfd);
+	}
+	/* Server moved or is down: look it up again below */
+    }
+
+    /* Get a list of potential server addresses */
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;  /* Open a connection */
+    hints.ai_flags = AI_NUMERICSERV;  /* ... using a numeric port arg. */
+    hints.ai_flags |= AI_ADDRCONFIG;  /* Recommended for connections */
+    if ((rc = getaddrinfo(hostname, port, &hints, &listp)) != 0) {
+        fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, port, gai_strerror(rc));
+        return -2;
+    }
+
+    /* Walk the list for one that we can successfully connect to */
+    for (p = listp; p; p = p->ai_next) {
+        if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+            continue; /* Socket failed, try the next */
+        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1)
+            break; /* Success */
+        if (close(clientfd) < 0) { /* Connect failed, try another */
+            fprintf(stderr, "open_clientfd_cached: close failed: %s\n", strerror(errno));
+            freeaddrinfo(listp);
+            return -1;
+        }
+    }
+
+    /* Remember the address that worked, in the slot for this
+       host:port, else a free or the stalest one */
+    if (p && strlen(hostname) < MAXLINE && strlen(port) < sizeof(a.port) &&
+	p->ai_addrlen <= sizeof(a.addr)) {
+	pthread_mutex_lock(&addrlock);
+	if ((i = addrcache_find(hostname, port)) < 0)
+	    for (i = 0, rc = 1; rc < CPOOL_ADDRCACHE; rc++)
+		if (addrcache[rc].expires < addrcache[i].expires)
+		    i = rc;
+	e = &addrcache[i];
+	strcpy(e->host, hostname);
+	strcpy(e->port, port);
+	e->family = p->ai_family;
+	e->socktype = p->ai_socktype;
+	e->protocol = p->ai_protocol;
+	e->addrlen = p->ai_addrlen;
+	memcpy(&e->addr, p->ai_addr, p->ai_addrlen);
+	e->expires = now + CPOOL_ADDRTTL;
+	pthread_mutex_unlock(&addrlock);
+    }
+
+    /* Clean up */
+    freeaddrinfo(listp);
+    if (!p) /* All connects failed */
+        return -1;
+    else    /* The last connect succeeded */
+        return clientfd;
+}
+
+/* Slot holding hostname:port, or -1; the caller holds addrlock */
+static int addrcache_find(char *hostname, char *port)
+{
+    int i;
+
+    for (i = 0; i < CPOOL_ADDRCACHE; i++)
+	if (addrcache[i].expires && !strcmp(addrcache[i].host, hostname) &&
+	    !strcmp(addrcache[i].port, port))
+	    return i;
+    return -1;
+}
+
+int Open_clientfd_cached(char *hostname, char *port)
+{
+    int rc;
+
+    if ((rc = open_clientfd_cached(hostname, port)) < 0)
+	unix_error("Open_clientfd_cached error");
+    return rc;
+}
+
+/*
+ * cpool_init - Create an empty pool of at most maxconns connections
+ *     to host:port; both strings must outlive the pool
+ */
+void cpool_init(cpool_t *p, char *host, char *port, int maxconns)
+{
+    p->host = host;
+    p->port = port;
+    Sem_init(&p->slots, 0, maxconns);
+    Sem_init(&p->mutex, 0, 1);
+    p->idle = NULL;
+    p->nconnects = 0;
+}
+
+/*
+ * cpool_free - Close the idle connections; every connection must have
+ *     been put back
+ */
+void cpool_free(cpool_t *p)
+{
+    cpool_conn_t *c;
+
+    while ((c = p->idle) != NULL) {
+	p->idle = c->next;
+	Close(c->fd);
+	Free(c);
+    }
+    sem_destroy(&p->slots);
+    sem_destroy(&p->mutex);
+}
+
+/*
+ * cpool_get - Take an idle connection, or open a new one, waiting if
+ *     all maxconns are in use. Idle connections the server has closed
+ *     are thrown away. Returns NULL if the connect fails.
+ */
+cpool_conn_t *cpool_get(cpool_t *p)
+{
+    cpool_conn_t *c;
+    int fd, one = 1;
+
+    P(&p->slots);
+    while (1) {
+	P(&p->mutex);
+	if ((c = p->idle) != NULL)
+	    p->idle = c->next;
+	V(&p->mutex);
+	if (!c)
+	    break;
+	if (cpool_alive(c))
+	    return c;
+	Close(c->fd);
+	Free(c);
+    }
+
+    if ((fd = open_clientfd_cached(p->host, p->port)) < 0) {
+	V(&p->slots);
+	return NULL;
+    }
+    /* Buffering already batches small requests; don't let Nagle hold
+       back the last segment of a flush */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c = Malloc(sizeof(cpool_conn_t));
+    c->fd = fd;
+    c->broken = 0;
+    c->head = c->tail = 0;
+    Rio_readinitb(&c->in, fd);
+    Rio_writeinitb(&c->out, fd);
+    P(&p->mutex);
+    p->nconnects++;
+    V(&p->mutex);
+    return c;
+}
+
+/*
+ * cpool_alive - Can idle connection c still take requests? Not if the
+ *     server has closed it (or reset it) while it sat in the pool, or
+ *     sent anything unasked, which would be taken for the response to
+ *     the next request.
+ */
+static int cpool_alive(cpool_conn_t *c)
+{
+    char b;
+
+    if (c->in.rio_cnt > 0)
+	return 0;
+    return recv(c->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+	(errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+/*
+ * cpool_put - Complete c's outstanding requests and give it back to
+ *     the pool, or close it if it has failed
+ */
+void cpool_put(cpool_t *p, cpool_conn_t *c)
+{
+    cpool_wait(c, -1);
+    if (c->broken) {
+	Close(c->fd);
+	Free(c);
+    }
+    else {
+	P(&p->mutex);
+	c->next = p->idle;
+	p->idle = c;
+	V(&p->mutex);
+    }
+    V(&p->slots);
+}
+
+/*
+ * cpool_send - Queue a request of n bytes on c; fn(c, rp, arg) reads
+ *     its response once the responses to all earlier requests on c have
+ *     been read. With CPOOL_MAXPIPE requests already in flight, the
+ *     oldest is completed first. Returns 0, or -1 if c has failed.
+ */
+int cpool_send(cpool_conn_t *c, void *req, size_t n,
+	       cpool_done_fn fn, void *arg)
+{
+    if (c->tail - c->head == CPOOL_MAXPIPE)
+	cpool_wait(c, 1);
+    if (c->broken) {
+	fn(c, NULL, arg);
+	return -1;
+    }
+    if (rio_writenb(&c->out, req, n) < 0) {
+	/* Earlier requests complete first, as they would have */
+	cpool_fail(c);
+	fn(c, NULL, arg);
+	return -1;
+    }
+    c->pending[c->tail % CPOOL_MAXPIPE].fn = fn;
+    c->pending[c->tail % CPOOL_MAXPIPE].arg = arg;
+    c->tail++;
+    return 0;
+}
+
+/*
+ * cpool_wait - Send whatever is queued on c and complete its n oldest
+ *     requests (all of them if n < 0), in order. Returns the number
+ *     that completed successfully, or -1 if c failed first.
+ */
+int cpool_wait(cpool_conn_t *c, int n)
+{
+    int done = 0;
+    unsigned i;
+
+    if (c->broken)
+	return -1;
+    if (rio_flushb(&c->out) < 0)
+	return cpool_fail(c);
+    for (; n != 0 && c->head != c->tail; n--) {
+	i = c->head++ % CPOOL_MAXPIPE;
+	if (c->pending[i].fn(c, &c->in, c->pending[i].arg) < 0)
+	    return cpool_fail(c);
+	done++;
+    }
+    return done;
+}
+
+/*
+ * cpool_fail - Mark c as failed and complete everything it still owes
+ *     with a NULL rp; returns -1
+ */
+static int cpool_fail(cpool_conn_t *c)
+{
+    unsigned i;
+
+    c->broken = 1;
+    while (c->head != c->tail) {
+	i = c->head++ % CPOOL_MAXPIPE;
+	c->pending[i].fn(c, NULL, c->pending[i].arg);
+    }
+    return -1;
+}
@@ -792,6 +792,78 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_sendn - Robustly send n bytes on a socket with send() flags
+ *    (unbuffered). Pass MSG_MORE to let the kernel coalesce this
+ *    data with whatever is sent next, e.g., headers and a body.
+ */
+ssize_t rio_sendn(int fd, void *usrbuf, size_t n, int flags) 
+{
+    size_t nleft = n;
+    ssize_t nsent;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if ((nsent = send(fd, bufp, nleft, flags)) <= 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nsent = 0;       /* and call send() again */
+	    else
+		return -1;       /* errno set by send() */
+	}
+	nleft -= nsent;
+	bufp += nsent;
+    }
+    return n;
+}
+
+/*
+ * rio_sendfile - Robustly copy n bytes starting at offset in file
+ *    infd to outfd without passing them through user space. Short
+ *    sends are retried; returns the number of bytes copied, which is
+ *    less than n only if the file was truncated underneath us.
+ */
+ssize_t rio_sendfile(int outfd, int infd, off_t offset, size_t n) 
+{
+    size_t nleft = n;
+    ssize_t nsent;
+
+    while (nleft > 0) {
+	if ((nsent = sendfile(outfd, infd, &offset, nleft)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nsent = 0;       /* and call sendfile() again */
+	    else
+		return -1;       /* errno set by sendfile() */
+	}
+	else if (nsent == 0)
+	    break;               /* EOF: file is shorter than n */
+	nleft -= nsent;
+    }
+    return (n - nleft);
+}
+
+
+/*
+ * rio_fill - Refill an empty internal buffer with a single read(),
+ *     retrying if interrupted; return the number of bytes now buffered,
+ *     0 on EOF, or -1 on error. On error (including EAGAIN) the buffer
+ *     is left empty with rio_cnt 0, so the next call can start over.
+ */
+static ssize_t rio_fill(rio_t *rp)
+{
+    while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
+	rp->rio_cnt = read(rp->rio_fd, rp->rio_base, rp->rio_bufsize);
+	if (rp->rio_cnt < 0) {
+	    rp->rio_cnt = 0;    /* Still empty, not -1, for later calls */
+	    if (errno != EINTR) /* Interrupted by sig handler return */
+		return -1;
+	}
+	else if (rp->rio_cnt == 0)  /* EOF */
+	    return 0;
+	else 
+	    rp->rio_bufptr = rp->rio_base; /* Reset buffer ptr */
+    }
+    return rp->rio_cnt;
+}
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -806,18 +878,8 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 {
     int cnt;
 
-    while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
-	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
-			   sizeof(rp->rio_buf));
-	if (rp->rio_cnt < 0) {
-	    if (errno != EINTR) /* Interrupted by sig handler return */
-		return -1;
-	}
-	else if (rp->rio_cnt == 0)  /* EOF */
-	    return 0;
-	else 
-	    rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
-    }
+    if (rp->rio_cnt <= 0 && (cnt = rio_fill(rp)) <= 0)
+	return cnt;     /* EOF or error */
 
     /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
     cnt = n;          
@@ -839,11 +901,56 @@ void rio_readinitb(rio_t *rp, int fd)
     rp->rio_fd = fd;  
     rp->rio_cnt = 0;  
     rp->rio_bufptr = rp->rio_buf;
+    rp->rio_base = rp->rio_buf;
+    rp->rio_bufsize = sizeof(rp->rio_buf);
 }
 /* $end rio_readinitb */
 
+/*
+ * rio_readinitbuf - Like rio_readinitb, but read through the caller's
+ *     buffer of bufsize bytes instead of the built-in RIO_BUFSIZE one.
+ *     A large buffer means fewer read() calls for streams of short
+ *     lines or records; buf must outlive rp. Returns 0, or -1 with
+ *     errno EINVAL if bufsize is 0 or too large for rio_cnt.
+ */
+int rio_readinitbuf(rio_t *rp, int fd, void *buf, size_t bufsize)
+{
+    if (bufsize == 0 || bufsize > INT_MAX) {
+	errno = EINVAL;
+	return -1;
+    }
+    rp->rio_fd = fd;
+    rp->rio_cnt = 0;
+    rp->rio_bufptr = buf;
+    rp->rio_base = buf;
+    rp->rio_bufsize = bufsize;
+    return 0;
+}
+
+/*
+ * rio_fadvise - Tell the kernel how rp's descriptor is going to be read,
+ *     e.g., POSIX_FADV_SEQUENTIAL to double the readahead window for a
+ *     long sequential scan, or POSIX_FADV_WILLNEED to start reading the
+ *     whole file in now. Only a hint: returns 0, or -1 with errno set
+ *     (ESPIPE for pipes and sockets, which callers can ignore).
+ */
+int rio_fadvise(rio_t *rp, int advice)
+{
+    int rc;
+
+    if ((rc = posix_fadvise(rp->rio_fd, 0, 0, advice)) != 0) {
+	errno = rc;
+	return -1;
+    }
+    return 0;
+}
+
 /*
  * rio_readnb - Robustly read n bytes (buffered)
+ *
+ * Once the internal buffer is empty, whatever is left of a request at
+ * least as large as the buffer is read straight into the user buffer,
+ * saving a memcpy() and most of the read() calls.
  */
 /* $begin rio_readnb */
 ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n) 
@@ -853,9 +960,16 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
     char *bufp = usrbuf;
     
     while (nleft > 0) {
-	if ((nread = rio_read(rp, bufp, nleft)) < 0) 
+	if (rp->rio_cnt <= 0 && nleft >= rp->rio_bufsize) {
+	    if ((nread = read(rp->rio_fd, bufp, nleft)) < 0) {
+		if (errno != EINTR) /* Interrupted by sig handler return */
+		    return -1;      /* errno set by read() */
+		continue;           /* and call read() again */
+	    }
+	}
+	else if ((nread = rio_read(rp, bufp, nleft)) < 0) 
             return -1;          /* errno set by read() */ 
-	else if (nread == 0)
+	if (nread == 0)
 	    break;              /* EOF */
 	nleft -= nread;
 	bufp += nread;
@@ -866,33 +980,341 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 
 /* 
  * rio_readlineb - Robustly read a text line (buffered)
+ *
+ * Finds the end of the line with memchr() and copies it out of the
+ * internal buffer in one piece, instead of going through rio_read()
+ * a byte at a time.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
-
-    for (n = 1; n < maxlen; n++) { 
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-	    *bufp++ = c;
-	    if (c == '\n') {
-                n++;
-     		break;
-            }
-	} else if (rc == 0) {
-	    if (n == 1)
-		return 0; /* EOF, no data read */
-	    else
-		break;    /* EOF, some data was read */
-	} else
-	    return -1;	  /* Error */
+    size_t n = 0, cnt;
+    ssize_t rc;
+    char *bufp = usrbuf, *nl = NULL;
+
+    while (!nl && n + 1 < maxlen) {
+	if (rp->rio_cnt <= 0 && (rc = rio_fill(rp)) <= 0) {
+	    if (rc < 0)
+		return -1;	  /* Error */
+	    if (n == 0)
+		return 0;     /* EOF, no data read */
+	    break;            /* EOF, some data was read */
+	}
+
+	/* Take everything up to and including the newline, if it is
+	   buffered, else everything that fits */
+	cnt = maxlen - 1 - n;
+	if (rp->rio_cnt < cnt)
+	    cnt = rp->rio_cnt;
+	if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+	    cnt = nl - rp->rio_bufptr + 1;
+	memcpy(bufp + n, rp->rio_bufptr, cnt);
+	rp->rio_bufptr += cnt;
+	rp->rio_cnt -= cnt;
+	n += cnt;
     }
-    *bufp = 0;
-    return n-1;
+    bufp[n] = 0;
+    return n;
 }
 /* $end rio_readlineb */
 
+/*
+ * rio_scanline - Read until the internal buffer holds a whole line, a
+ *     full buffer, or the last bytes before EOF, and return how many
+ *     bytes that is without consuming them; 0 on EOF, -1 on error.
+ *     On a non-blocking descriptor with no complete line yet, fails
+ *     with errno EAGAIN and leaves the partial line in the buffer so
+ *     that the next call picks up where this one stopped.
+ */
+static ssize_t rio_scanline(rio_t *rp)
+{
+    size_t scanned = 0;
+    ssize_t nread;
+    char *nl;
+
+    for (;;) {
+	/* Only look at bytes that arrived since the last pass */
+	if ((size_t)rp->rio_cnt > scanned &&
+	    (nl = memchr(rp->rio_bufptr + scanned, '\n',
+			 rp->rio_cnt - scanned)) != NULL)
+	    return nl - rp->rio_bufptr + 1;
+	scanned = rp->rio_cnt;
+	if (scanned == rp->rio_bufsize)
+	    return scanned;       /* Line longer than the buffer */
+
+	/* Move the partial line to the front and read in behind it */
+	if (rp->rio_bufptr != rp->rio_base) {
+	    memmove(rp->rio_base, rp->rio_bufptr, rp->rio_cnt);
+	    rp->rio_bufptr = rp->rio_base;
+	}
+	nread = read(rp->rio_fd, rp->rio_base + rp->rio_cnt,
+		     rp->rio_bufsize - rp->rio_cnt);
+	if (nread < 0) {
+	    if (errno != EINTR)
+		return -1;        /* errno set by read(), maybe EAGAIN */
+	}
+	else if (nread == 0)
+	    return rp->rio_cnt;   /* EOF: whatever is left, maybe nothing */
+	else
+	    rp->rio_cnt += nread;
+    }
+}
+
+/*
+ * rio_readlinep - Zero-copy version of rio_readlineb. Sets *linep to
+ *     the next line in the internal buffer and returns its length,
+ *     including the '\n'. The line is not NUL-terminated and stays
+ *     valid only until the next call on rp. A line longer than the
+ *     buffer comes back in buffer-sized pieces, and a last line with
+ *     no newline is returned as is. Returns 0 on EOF, -1 on error.
+ *     Safe on non-blocking descriptors, like rio_readlineb_nb.
+ */
+ssize_t rio_readlinep(rio_t *rp, char **linep)
+{
+    ssize_t n;
+
+    if ((n = rio_scanline(rp)) <= 0)
+	return n;
+    *linep = rp->rio_bufptr;
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+    return n;
+}
+
+/*
+ * Non-blocking Rio. These never wait: when the descriptor has nothing
+ * more to give or take they fail with errno EAGAIN, and whatever was
+ * partly done stays in the rio_t or rio_writer_t, to be resumed on the
+ * next call. Meant for O_NONBLOCK descriptors driven by a reactor.
+ */
+
+/*
+ * rio_readb_nb - Read up to n bytes that are buffered or can be read
+ *    without blocking; returns the number read, 0 on EOF, or -1
+ */
+ssize_t rio_readb_nb(rio_t *rp, void *usrbuf, size_t n)
+{
+    return rio_read(rp, usrbuf, n);
+}
+
+/*
+ * rio_readlineb_nb - Like rio_readlineb, but returns a line only once
+ *    all of it (up to maxlen-1 bytes) has arrived. Until then nothing
+ *    is consumed and it fails with EAGAIN.
+ */
+ssize_t rio_readlineb_nb(rio_t *rp, void *usrbuf, size_t maxlen)
+{
+    ssize_t n;
+    char *bufp = usrbuf;
+
+    if ((n = rio_scanline(rp)) < 0)
+	return -1;
+    if (n > maxlen - 1)
+	n = maxlen - 1;
+    memcpy(bufp, rp->rio_bufptr, n);
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+    bufp[n] = 0;
+    return n;
+}
+
+/*
+ * rio_writen_nb - Write as much of n bytes as the descriptor takes
+ *    without blocking; returns the number written, or -1 (EAGAIN if
+ *    it took none)
+ */
+ssize_t rio_writen_nb(int fd, void *usrbuf, size_t n)
+{
+    size_t nleft = n;
+    ssize_t nwritten;
+    char *bufp = usrbuf;
+
+    while (nleft > 0) {
+	if ((nwritten = write(fd, bufp, nleft)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN && nleft < n)
+		break;           /* Partial progress */
+	    return -1;
+	}
+	nleft -= nwritten;
+	bufp += nwritten;
+    }
+    return n - nleft;
+}
+
+/*
+ * rio_flushb_nb - Write out as much of a write buffer as the
+ *    descriptor takes; returns 0 once it is empty, or -1 (EAGAIN if
+ *    some of it is still waiting)
+ */
+int rio_flushb_nb(rio_writer_t *wp)
+{
+    ssize_t n;
+
+    if (wp->rio_cnt == 0)
+	return 0;
+    if ((n = rio_writen_nb(wp->rio_fd, wp->rio_buf, wp->rio_cnt)) < 0)
+	return -1;
+    wp->rio_cnt -= n;
+    if (wp->rio_cnt > 0) {
+	memmove(wp->rio_buf, wp->rio_buf + n, wp->rio_cnt);
+	errno = EAGAIN;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * rio_writev - Robustly write the iovcnt buffers in iov (unbuffered).
+ *    Short writes are resumed where they stopped, which updates iov in
+ *    place; returns the total number of bytes written, or -1 on error.
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nwritten = 0;    /* and call writev() again */
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	total += nwritten;
+
+	/* Step over the buffers that went out completely */
+	while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return total;
+}
+
+/*
+ * rio_writeinitb - Associate a descriptor with a write buffer
+ */
+void rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    wp->rio_fd = fd;
+    wp->rio_corked = 0;
+    wp->rio_cnt = 0;
+}
+
+/*
+ * rio_writenb - Robustly write n bytes (buffered). Bytes are held in
+ *    the internal buffer until it fills or rio_flushb() is called; data
+ *    that does not fit goes out along with the buffered bytes in one
+ *    writev().
+ */
+ssize_t rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    struct iovec iov[2];
+
+    if (n <= sizeof(wp->rio_buf) - wp->rio_cnt) {
+	memcpy(wp->rio_buf + wp->rio_cnt, usrbuf, n);
+	wp->rio_cnt += n;
+	return n;
+    }
+    iov[0].iov_base = wp->rio_buf;
+    iov[0].iov_len = wp->rio_cnt;
+    iov[1].iov_base = usrbuf;
+    iov[1].iov_len = n;
+    if (rio_writev(wp->rio_fd, iov, 2) < 0)
+	return -1;
+    wp->rio_cnt = 0;
+    return n;
+}
+
+/*
+ * rio_vprintfb - vprintf() into a write buffer; returns the number of
+ *    bytes added, or -1 on error
+ */
+static ssize_t rio_vprintfb(rio_writer_t *wp, const char *fmt, va_list ap)
+{
+    va_list aq;
+    size_t room = sizeof(wp->rio_buf) - wp->rio_cnt;
+    ssize_t rc;
+    char *big;
+    int n;
+
+    va_copy(aq, ap);
+    n = vsnprintf(wp->rio_buf + wp->rio_cnt, room, fmt, aq);
+    va_end(aq);
+    if (n < 0)
+	return -1;
+    if (n < room) {
+	wp->rio_cnt += n;
+	return n;
+    }
+
+    /* Didn't fit. Make room and format again, or if it would not fit
+       in an empty buffer either, format it on the side. */
+    if (n < sizeof(wp->rio_buf)) {
+	if (rio_flushb(wp) < 0)
+	    return -1;
+	wp->rio_cnt = vsnprintf(wp->rio_buf, sizeof(wp->rio_buf), fmt, ap);
+	return n;
+    }
+    if ((big = malloc(n + 1)) == NULL)
+	return -1;
+    vsnprintf(big, n + 1, fmt, ap);
+    rc = rio_writenb(wp, big, n);
+    free(big);
+    return rc;
+}
+
+/*
+ * rio_printfb - printf() into a write buffer
+ */
+ssize_t rio_printfb(rio_writer_t *wp, const char *fmt, ...)
+{
+    va_list ap;
+    ssize_t rc;
+
+    va_start(ap, fmt);
+    rc = rio_vprintfb(wp, fmt, ap);
+    va_end(ap);
+    return rc;
+}
+
+/*
+ * rio_flushb - Write out everything held in a write buffer
+ */
+int rio_flushb(rio_writer_t *wp)
+{
+    if (wp->rio_cnt > 0 && rio_writen(wp->rio_fd, wp->rio_buf, wp->rio_cnt) < 0)
+	return -1;
+    wp->rio_cnt = 0;
+    return 0;
+}
+
+/*
+ * rio_corkb - Turn cork mode on or off for a writer on a TCP socket.
+ *    While corked, the kernel sends only full segments, so buffer
+ *    flushes and anything else written to the descriptor (say, a
+ *    rio_sendfile() body after buffered headers) are packed together.
+ *    Uncorking flushes the buffer and pushes out any partial segment.
+ */
+int rio_corkb(rio_writer_t *wp, int on)
+{
+    if (!on && rio_flushb(wp) < 0)
+	return -1;
+    if (on == wp->rio_corked)
+	return 0;
+    if (setsockopt(wp->rio_fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) < 0)
+	return -1;
+    wp->rio_corked = on;
+    return 0;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -911,11 +1333,29 @@ void Rio_writen(int fd, void *usrbuf, size_t n)
 	unix_error("Rio_writen error");
 }
 
+void Rio_sendn(int fd, void *usrbuf, size_t n, int flags) 
+{
+    if (rio_sendn(fd, usrbuf, n, flags) != n)
+	unix_error("Rio_sendn error");
+}
+
+void Rio_sendfile(int outfd, int infd, off_t offset, size_t n) 
+{
+    if (rio_sendfile(outfd, infd, offset, n) != n)
+	unix_error("Rio_sendfile error");
+}
+
 void Rio_readinitb(rio_t *rp, int fd)
 {
     rio_readinitb(rp, fd);
 } 
 
+void Rio_readinitbuf(rio_t *rp, int fd, void *buf, size_t bufsize)
+{
+    if (rio_readinitbuf(rp, fd, buf, bufsize) < 0)
+	unix_error("Rio_readinitbuf error");
+}
+
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n) 
 {
     ssize_t rc;
@@ -934,6 +1374,57 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+ssize_t Rio_readlinep(rio_t *rp, char **linep)
+{
+    ssize_t rc;
+
+    if ((rc = rio_readlinep(rp, linep)) < 0)
+	unix_error("Rio_readlinep error");
+    return rc;
+}
+
+void Rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    if (rio_writev(fd, iov, iovcnt) < 0)
+	unix_error("Rio_writev error");
+}
+
+void Rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    rio_writeinitb(wp, fd);
+}
+
+void Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    if (rio_writenb(wp, usrbuf, n) != n)
+	unix_error("Rio_writenb error");
+}
+
+ssize_t Rio_printfb(rio_writer_t *wp, const char *fmt, ...)
+{
+    va_list ap;
+    ssize_t rc;
+
+    va_start(ap, fmt);
+    rc = rio_vprintfb(wp, fmt, ap);
+    va_end(ap);
+    if (rc < 0)
+	unix_error("Rio_printfb error");
+    return rc;
+}
+
+void Rio_flushb(rio_writer_t *wp)
+{
+    if (rio_flushb(wp) < 0)
+	unix_error("Rio_flushb error");
+}
+
+void Rio_corkb(rio_writer_t *wp, int on)
+{
+    if (rio_corkb(wp, on) < 0)
+	unix_error("Rio_corkb error");
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -1064,6 +1555,162 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+/****************************************************
+ * Reactor: a small edge-triggered event loop on epoll
+ ****************************************************/
+
+/*
+ * reactor_init - Create an empty reactor; returns 0, or -1 on error
+ */
+int reactor_init(reactor_t *r)
+{
+    if ((r->epfd = epoll_create1(0)) < 0)
+	return -1;
+    r->stop = 0;
+    r->dead = NULL;
+    return 0;
+}
+
+/*
+ * reactor_add - Put fd in non-blocking mode and call fn(r, ev, events)
+ *    whenever any of events (EPOLLIN, EPOLLOUT, ...) becomes ready.
+ *    Readiness is edge-triggered, so fn must keep reading or writing
+ *    until it gets EAGAIN. Returns the new event, or NULL on error.
+ */
+reactor_ev_t *reactor_add(reactor_t *r, int fd, unsigned events,
+			  reactor_fn fn, void *arg)
+{
+    reactor_ev_t *ev;
+    struct epoll_event ee;
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL, 0)) < 0 ||
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	return NULL;
+    if ((ev = malloc(sizeof(reactor_ev_t))) == NULL)
+	return NULL;
+    ev->fd = fd;
+    ev->fn = fn;
+    ev->arg = arg;
+    ev->next = NULL;
+    ee.events = events | EPOLLET;
+    ee.data.ptr = ev;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ee) < 0) {
+	free(ev);
+	return NULL;
+    }
+    return ev;
+}
+
+/*
+ * reactor_mod - Change the events that ev is waiting for
+ */
+int reactor_mod(reactor_t *r, reactor_ev_t *ev, unsigned events)
+{
+    struct epoll_event ee;
+
+    ee.events = events | EPOLLET;
+    ee.data.ptr = ev;
+    return epoll_ctl(r->epfd, EPOLL_CTL_MOD, ev->fd, &ee);
+}
+
+/*
+ * reactor_del - Stop watching ev's descriptor, which the caller still
+ *    has to close. Handlers may delete any event, including their own;
+ *    the memory is released only after the current batch is dispatched.
+ */
+int reactor_del(reactor_t *r, reactor_ev_t *ev)
+{
+    int rc = epoll_ctl(r->epfd, EPOLL_CTL_DEL, ev->fd, NULL);
+
+    ev->fd = -1;
+    ev->next = r->dead;
+    r->dead = ev;
+    return rc;
+}
+
+/*
+ * reactor_run - Dispatch events until a handler sets r->stop; returns
+ *    0 then, or -1 on error
+ */
+int reactor_run(reactor_t *r)
+{
+    struct epoll_event evs[REACTOR_MAXEVENTS];
+    reactor_ev_t *ev;
+    int i, n;
+
+    r->stop = 0;
+    while (!r->stop) {
+	if ((n = epoll_wait(r->epfd, evs, REACTOR_MAXEVENTS, -1)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	for (i = 0; i < n; i++) {
+	    ev = evs[i].data.ptr;
+	    if (ev->fd >= 0)   /* Not deleted earlier in this batch */
+		ev->fn(r, ev, evs[i].events);
+	}
+	while ((ev = r->dead) != NULL) {
+	    r->dead = ev->next;
+	    free(ev);
+	}
+    }
+    return 0;
+}
+
+/*
+ * reactor_free - Release a reactor. Events still registered are not
+ *    freed; delete them first.
+ */
+void reactor_free(reactor_t *r)
+{
+    reactor_ev_t *ev;
+
+    while ((ev = r->dead) != NULL) {
+	r->dead = ev->next;
+	free(ev);
+    }
+    close(r->epfd);
+}
+
+/****************************************
+ * Wrappers for the reactor
+ ****************************************/
+void Reactor_init(reactor_t *r)
+{
+    if (reactor_init(r) < 0)
+	unix_error("Reactor_init error");
+}
+
+reactor_ev_t *Reactor_add(reactor_t *r, int fd, unsigned events,
+			  reactor_fn fn, void *arg)
+{
+    reactor_ev_t *ev;
+
+    if ((ev = reactor_add(r, fd, events, fn, arg)) == NULL)
+	unix_error("Reactor_add error");
+    return ev;
+}
+
+void Reactor_mod(reactor_t *r, reactor_ev_t *ev, unsigned events)
+{
+    if (reactor_mod(r, ev, events) < 0)
+	unix_error("Reactor_mod error");
+}
+
+void Reactor_del(reactor_t *r, reactor_ev_t *ev)
+{
+    if (reactor_del(r, ev) < 0)
+	unix_error("Reactor_del error");
+}
+
+void Reactor_run(reactor_t *r)
+{
+    if (reactor_run(r) < 0)
+	unix_error("Reactor_run error");
+}
+
 /* $end csapp.c */
 
 
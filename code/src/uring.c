@@ -0,0 +1,376 @@
+/*
+ * uring.c - A minimal io_uring interface built directly on the
+ *     io_uring_setup/enter/register system calls (no liburing)
+ *
+ * Only what the servers here need: one ring per thread, batched
+ * submission, completions consumed in place, registered buffers and
+ * provided-buffer rings. Every function returns -1 with errno set on
+ * failure so that callers can fall back to epoll on kernels (or
+ * sandboxes) without io_uring.
+ */
+#include "uring.h"
+#include <sys/syscall.h>
+
+/* Ring indices are shared with the kernel */
+#define load_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+			      unsigned flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		   flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned op, void *arg, unsigned n)
+{
+    return syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+/*
+ * uring_init - Set up a ring with room for entries submissions
+ */
+int uring_init(uring_t *u, unsigned entries)
+{
+    struct io_uring_params p;
+    char *sq, *cq;
+    unsigned i;
+
+    memset(&p, 0, sizeof(p));
+    if ((u->fd = sys_io_uring_setup(entries, &p)) < 0)
+	return -1;
+    u->features = p.features;
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_ring_sz > u->sq_ring_sz)
+	    u->sq_ring_sz = u->cq_ring_sz;
+	u->cq_ring_sz = u->sq_ring_sz;
+    }
+
+    sq = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+	      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+	goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+	cq = sq;
+    else if ((cq = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->fd,
+			IORING_OFF_CQ_RING)) == MAP_FAILED) {
+	munmap(sq, u->sq_ring_sz);
+	goto fail;
+    }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		   u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+	munmap(sq, u->sq_ring_sz);
+	if (cq != sq)
+	    munmap(cq, u->cq_ring_sz);
+	goto fail;
+    }
+    u->sq_ring = sq;
+    u->cq_ring = cq;
+
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    u->sq_entries = p.sq_entries;
+    u->sqe_tail = *u->sq_tail;
+    u->nenter = 0;
+
+    /* SQE i always sits in slot i, so the index array never changes */
+    for (i = 0; i < p.sq_entries; i++)
+	u->sq_array[i] = i;
+    return 0;
+
+ fail:
+    close(u->fd);
+    return -1;
+}
+
+/*
+ * uring_free - Tear down a ring; requests still in flight are cancelled
+ */
+void uring_free(uring_t *u)
+{
+    munmap(u->sqes, u->sq_entries * sizeof(struct io_uring_sqe));
+    if (u->cq_ring != u->sq_ring)
+	munmap(u->cq_ring, u->cq_ring_sz);
+    munmap(u->sq_ring, u->sq_ring_sz);
+    close(u->fd);
+}
+
+/*
+ * uring_has_op - Return nonzero if the kernel supports opcode op
+ */
+int uring_has_op(uring_t *u, int op)
+{
+    struct io_uring_probe *probe;
+    size_t len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+    int ok = 0;
+
+    if ((probe = calloc(1, len)) == NULL)
+	return 0;
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+	ok = op <= probe->last_op &&
+	    (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+/*
+ * uring_get_sqe - Return a zeroed submission entry to fill in; it goes
+ *     to the kernel with the next uring_submit(). When the queue is
+ *     full, what is queued is submitted first. Returns NULL on error.
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *u)
+{
+    struct io_uring_sqe *sqe;
+
+    if (u->sqe_tail - load_acquire(u->sq_head) == u->sq_entries &&
+	uring_submit(u, 0, 0) < 0)
+	return NULL;
+    sqe = &u->sqes[u->sqe_tail & *u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sqe_tail++;
+    return sqe;
+}
+
+/*
+ * uring_submit - Hand the queued entries to the kernel and, if wait_nr
+ *     is nonzero, wait until that many completions are ready or
+ *     timeout_ms passes (forever if negative). All in one system call.
+ *     Returns the number of entries submitted, or -1 on error; running
+ *     out of time is not an error.
+ */
+int uring_submit(uring_t *u, unsigned wait_nr, int timeout_ms)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = 0, submit;
+    void *argp = NULL;
+    size_t argsz = 0;
+    int rc;
+
+    store_release(u->sq_tail, u->sqe_tail);
+    submit = u->sqe_tail - load_acquire(u->sq_head);
+    if (wait_nr > 0) {
+	flags |= IORING_ENTER_GETEVENTS;
+	if (timeout_ms >= 0 && (u->features & IORING_FEAT_EXT_ARG)) {
+	    memset(&arg, 0, sizeof(arg));
+	    ts.tv_sec = timeout_ms / 1000;
+	    ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+	    arg.ts = (__u64)(unsigned long)&ts;
+	    flags |= IORING_ENTER_EXT_ARG;
+	    argp = &arg;
+	    argsz = sizeof(arg);
+	}
+    }
+    else if (submit == 0)
+	return 0;
+
+    u->nenter++;
+    while ((rc = sys_io_uring_enter(u->fd, submit, wait_nr, flags,
+				    argp, argsz)) < 0) {
+	if (errno == ETIME)
+	    return 0;
+	if (errno != EINTR)
+	    return -1;
+	if (wait_nr > 0)
+	    return 0;  /* Let the caller look at the clock again */
+    }
+    return rc;
+}
+
+/*
+ * uring_peek_cqe - Return the oldest completion, or NULL if there is
+ *     none; it stays valid until uring_cqe_seen()
+ */
+struct io_uring_cqe *uring_peek_cqe(uring_t *u)
+{
+    unsigned head = *u->cq_head;
+
+    if (head == load_acquire(u->cq_tail))
+	return NULL;
+    return &u->cqes[head & *u->cq_mask];
+}
+
+/*
+ * uring_cqe_seen - Give the oldest completion slot back to the kernel
+ */
+void uring_cqe_seen(uring_t *u)
+{
+    store_release(u->cq_head, *u->cq_head + 1);
+}
+
+/*
+ * uring_register_buffers - Pin n buffers for the *_FIXED operations,
+ *     which then skip mapping user memory on every request
+ */
+int uring_register_buffers(uring_t *u, struct iovec *iov, unsigned n)
+{
+    return sys_io_uring_register(u->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+/*
+ * uring_bufring_init - Provide nbufs buffers of bufsize bytes as group
+ *     bgid. A receive with buffer select takes one of them only when
+ *     data arrives, so idle connections hold no buffer. nbufs must be
+ *     a power of 2.
+ */
+int uring_bufring_init(uring_t *u, uring_bufring_t *br, unsigned short bgid,
+		       unsigned nbufs, unsigned bufsize)
+{
+    struct io_uring_buf_reg reg;
+    size_t ringsz = nbufs * sizeof(struct io_uring_buf);
+    unsigned i;
+
+    br->ring = mmap(NULL, ringsz, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br->ring == MAP_FAILED)
+	return -1;
+    if ((br->bufs = malloc((size_t)nbufs * bufsize)) == NULL) {
+	munmap(br->ring, ringsz);
+	return -1;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)br->ring;
+    reg.ring_entries = nbufs;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+	free(br->bufs);
+	munmap(br->ring, ringsz);
+	return -1;
+    }
+    br->nbufs = nbufs;
+    br->bufsize = bufsize;
+    br->bgid = bgid;
+    br->tail = 0;
+    for (i = 0; i < nbufs; i++)
+	uring_buf_recycle(br, i);
+    return 0;
+}
+
+/*
+ * uring_bufring_free - Withdraw and free a provided-buffer ring
+ */
+void uring_bufring_free(uring_t *u, uring_bufring_t *br)
+{
+    struct io_uring_buf_reg reg;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = br->bgid;
+    sys_io_uring_register(u->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(br->ring, br->nbufs * sizeof(struct io_uring_buf));
+    free(br->bufs);
+}
+
+/*
+ * uring_buf - Return the memory of buffer bid, as reported in a
+ *     completion's flags >> IORING_CQE_BUFFER_SHIFT
+ */
+char *uring_buf(uring_bufring_t *br, unsigned bid)
+{
+    return br->bufs + (size_t)bid * br->bufsize;
+}
+
+/*
+ * uring_buf_recycle - Hand buffer bid back to the kernel
+ */
+void uring_buf_recycle(uring_bufring_t *br, unsigned bid)
+{
+    struct io_uring_buf *buf = &br->ring->bufs[br->tail & (br->nbufs - 1)];
+
+    buf->addr = (unsigned long)uring_buf(br, bid);
+    buf->len = br->bufsize;
+    buf->bid = bid;
+    store_release(&br->ring->tail, ++br->tail);
+}
+
+/*
+ * uring_prep_accept - Accept a connection on fd, as a non-blocking,
+ *     close-on-exec socket. A multishot accept keeps posting one
+ *     completion per connection until a completion arrives without
+ *     IORING_CQE_F_MORE.
+ */
+void uring_prep_accept(struct io_uring_sqe *sqe, int fd, int multishot,
+		       __u64 data)
+{
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (multishot)
+	sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = data;
+}
+
+/*
+ * uring_prep_recv - Receive from fd into a buffer picked from group
+ *     bgid; multishot keeps receiving until the peer closes, an error
+ *     happens or the group runs out of buffers (-ENOBUFS)
+ */
+void uring_prep_recv(struct io_uring_sqe *sqe, int fd, unsigned short bgid,
+		     int multishot, __u64 data)
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    if (multishot)
+	sqe->ioprio |= IORING_RECV_MULTISHOT;
+    sqe->user_data = data;
+}
+
+/*
+ * uring_prep_write_fixed - Write len bytes at buf, which must lie in
+ *     registered buffer bufindex, to fd
+ */
+void uring_prep_write_fixed(struct io_uring_sqe *sqe, int fd, void *buf,
+			    unsigned len, unsigned short bufindex, __u64 data)
+{
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->buf_index = bufindex;
+    sqe->user_data = data;
+}
+
+/*
+ * uring_prep_poll - Report when fd becomes ready for events (POLLIN,
+ *     POLLOUT, ...); multishot reports every wakeup, like EPOLLET
+ */
+void uring_prep_poll(struct io_uring_sqe *sqe, int fd, unsigned events,
+		     int multishot, __u64 data)
+{
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    if (multishot)
+	sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+}
+
+/*
+ * uring_prep_poll_remove - Cancel the poll submitted with user data
+ *     target; it completes with -ECANCELED
+ */
+void uring_prep_poll_remove(struct io_uring_sqe *sqe, __u64 target,
+			    __u64 data)
+{
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+}
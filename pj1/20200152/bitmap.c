@@ -4,6 +4,14 @@
 #include "round.h"  // 		#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "hex_dump.h"
 #define ASSERT(CONDITION) assert(CONDITION)
@@ -26,10 +34,23 @@ typedef unsigned long elem_type;
    simulates an array of bits. */
 struct bitmap
 {
-  size_t bit_cnt;  /* Number of bits. */
-  elem_type *bits; /* Elements that represent bits. */
+  size_t bit_cnt;              /* Number of bits. */
+  elem_type *bits;             /* Elements that represent bits. */
+  struct bitmap_mapping *map;  /* Backing file, or NULL. */
 };
 
+static void mark_dirty(struct bitmap *, size_t first, size_t last);
+static void close_mapped(struct bitmap *);
+
+/* Notes that elements FIRST through LAST of B are about to
+   change, if B is backed by a file. */
+static inline void
+touch(struct bitmap *b, size_t first, size_t last)
+{
+  if (b->map != NULL)
+    mark_dirty(b, first, last);
+}
+
 /* Returns the index of the element that contains the bit
    numbered BIT_IDX. */
 static inline size_t
@@ -69,6 +90,126 @@ last_mask(const struct bitmap *b)
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns a mask of the bits of element IDX that fall in the bit
+   range [START, END); START < END. */
+static inline elem_type
+range_mask(size_t idx, size_t start, size_t end)
+{
+  elem_type mask = (elem_type)-1;
+
+  if (elem_idx(start) == idx)
+    mask &= (elem_type)-1 << (start % ELEM_BITS);
+  if (elem_idx(end - 1) == idx && end % ELEM_BITS != 0)
+    mask &= ((elem_type)1 << (end % ELEM_BITS)) - 1;
+  return mask;
+}
+
+/* Returns an element with every bit set to VALUE. */
+static inline elem_type
+fill(bool value)
+{
+  return value ? (elem_type)-1 : 0;
+}
+
+/* Word-at-a-time kernels.
+
+   Operations on ranges of bits work an element at a time, masking
+   the partial elements at either end.  Over long runs of whole
+   elements, popcount_elems() and find_elem() use AVX2 when the CPU
+   has it, 256 bits per instruction; the plain versions are used
+   otherwise and for the leftover elements. */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_PATHS 1
+
+/* Returns true if the CPU can run the AVX2 paths. */
+static inline bool
+have_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+
+/* Counts the set bits in the N elements at E, 4 at a time, by
+   looking up each nibble in a 16-entry table (the vector popcount
+   of Mula et al.) and summing the bytes with VPSADBW. */
+__attribute__((target("avx2"))) static size_t
+popcount_elems_avx2(const elem_type *e, size_t n)
+{
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(e + i));
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4),
+                                                           low));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                                                _mm256_setzero_si256()));
+  }
+  return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+         + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+}
+
+/* Returns the index of the first of the N elements at E that is not
+   equal to PATTERN, looking at 4 elements at a time, or the
+   largest multiple of 4 not above N if there is none among those. */
+__attribute__((target("avx2"))) static size_t
+find_elem_avx2(const elem_type *e, size_t n, elem_type pattern)
+{
+  const __m256i p = _mm256_set1_epi64x(pattern);
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(e + i));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(v, p)) != -1)
+      break;
+  }
+  return i;
+}
+#endif
+
+/* Returns the number of set bits in the N elements at E. */
+static size_t
+popcount_elems(const elem_type *e, size_t n)
+{
+  size_t i = 0, cnt = 0;
+
+#ifdef HAVE_AVX2_PATHS
+  if (n >= 16 && have_avx2())
+  {
+    i = n / 4 * 4;
+    cnt = popcount_elems_avx2(e, i);
+  }
+#endif
+  for (; i < n; i++)
+    cnt += __builtin_popcountl(e[i]);
+  return cnt;
+}
+
+/* Returns the index of the first of the N elements at E that is not
+   equal to PATTERN, or N if they all are. */
+static size_t
+find_elem(const elem_type *e, size_t n, elem_type pattern)
+{
+  size_t i = 0;
+
+#ifdef HAVE_AVX2_PATHS
+  if (n >= 16 && have_avx2())
+    i = find_elem_avx2(e, n, pattern);
+#endif
+  while (i < n && e[i] == pattern)
+    i++;
+  return i;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -83,6 +224,7 @@ bitmap_create(size_t bit_cnt)
   {
     b->bit_cnt = bit_cnt;
     b->bits = malloc(byte_cnt(bit_cnt));
+    b->map = NULL;
     if (b->bits != NULL || bit_cnt == 0)
     {
       bitmap_set_all(b, false);
@@ -106,6 +248,7 @@ bitmap_create_in_buf(size_t bit_cnt, void *block, size_t block_size)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *)(b + 1);
+  b->map = NULL;
   bitmap_set_all(b, false);
   return b;
 }
@@ -120,10 +263,13 @@ bitmap_buf_size(size_t bit_cnt)
 
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by
-   bitmap_create_preallocated(). */
+   bitmap_create_preallocated().  A bitmap from
+   bitmap_open_mapped() is checkpointed and unmapped. */
 void bitmap_destroy(struct bitmap *b)
 {
-  if (b != NULL)
+  if (b != NULL && b->map != NULL)
+    close_mapped(b);
+  else if (b != NULL)
   {
     free(b->bits);
     free(b);
@@ -158,10 +304,14 @@ void bitmap_mark(struct bitmap *b, size_t bit_idx)
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
+  touch(b, idx, idx);
+
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm("orl %k1, %k0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+     the description of the OR instruction in [IA32-v2b].  The
+     operand size follows elem_type: a 32-bit OR would never
+     reach bits 32 to 63 of a 64-bit element. */
+  asm("or %1, %0" : "+m"(b->bits[idx]) : "r"(mask) : "cc");
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -170,10 +320,12 @@ void bitmap_reset(struct bitmap *b, size_t bit_idx)
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
+  touch(b, idx, idx);
+
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
-  asm("andl %k1, %k0" : "=m"(b->bits[idx]) : "r"(~mask) : "cc");
+  asm("and %1, %0" : "+m"(b->bits[idx]) : "r"(~mask) : "cc");
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -184,10 +336,12 @@ void bitmap_flip(struct bitmap *b, size_t bit_idx)
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
+  touch(b, idx, idx);
+
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
-  asm("xorl %k1, %k0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+  asm("xor %1, %0" : "+m"(b->bits[idx]) : "r"(mask) : "cc");
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -211,14 +365,22 @@ void bitmap_set_all(struct bitmap *b, bool value)
 /* Sets the CNT bits starting at START in B to VALUE. */
 void bitmap_set_multiple(struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
+  size_t end = start + cnt, first, last, i;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  if (cnt == 0)
+    return;
+  first = elem_idx(start);
+  last = elem_idx(end - 1);
+  touch(b, first, last);
+  for (i = first; i <= last; i++)
+  {
+    elem_type mask = range_mask(i, start, end);
+    b->bits[i] = (b->bits[i] & ~mask) | (fill(value) & mask);
+  }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -226,33 +388,51 @@ void bitmap_set_multiple(struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt, first, last, ones;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  if (cnt == 0)
+    return 0;
+  first = elem_idx(start);
+  last = elem_idx(end - 1);
+  ones = __builtin_popcountl(b->bits[first] & range_mask(first, start, end));
+  if (last > first)
+  {
+    ones += popcount_elems(b->bits + first + 1, last - first - 1);
+    ones += __builtin_popcountl(b->bits[last] & range_mask(last, start, end));
+  }
+  return value ? ones : cnt - ones;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
+  size_t end = start + cnt, first, last, n;
+  elem_type other = fill(!value), mask;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      return true;
-  return false;
+  if (cnt == 0)
+    return false;
+  first = elem_idx(start);
+  last = elem_idx(end - 1);
+
+  /* A bit is VALUE where the element differs from all-!VALUE. */
+  mask = range_mask(first, start, end);
+  if ((b->bits[first] ^ other) & mask)
+    return true;
+  if (first == last)
+    return false;
+  n = last - first - 1;
+  if (find_elem(b->bits + first + 1, n, other) < n)
+    return true;
+  return ((b->bits[last] ^ other) & range_mask(last, start, end)) != 0;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -285,16 +465,75 @@ bool bitmap_all(const struct bitmap *b, size_t start, size_t cnt)
 size_t
 bitmap_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
+  size_t idx, n, run_start = 0, run_len = 0;
+  elem_type other = fill(!value);
+
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt)
+  if (cnt > b->bit_cnt || start > b->bit_cnt - cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  /* One pass over the elements, carrying the length of the run of
+     VALUE bits that reaches the end of the previous element.  In
+     each element M has a 1 for every bit that is VALUE, and the
+     runs in it are found with count-trailing-zeros rather than bit
+     by bit. */
+  n = elem_cnt(b->bit_cnt);
+  for (idx = elem_idx(start); idx < n; idx++)
   {
-    size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
-        return i;
+    elem_type m;
+    size_t pos = 0;
+
+    /* No run in progress: skip elements with no VALUE bits. */
+    if (run_len == 0 && idx + 1 < n)
+    {
+      idx += find_elem(b->bits + idx, n - 1 - idx, other);
+    }
+
+    m = b->bits[idx] ^ other;
+    if (idx == elem_idx(start))
+      m &= (elem_type)-1 << (start % ELEM_BITS);
+    if (idx == n - 1)
+      m &= last_mask(b);
+
+    if (m == (elem_type)-1)
+    {
+      if (run_len == 0)
+        run_start = idx * ELEM_BITS;
+      run_len += ELEM_BITS;
+    }
+    else
+      while (pos < ELEM_BITS)
+      {
+        elem_type rest = m >> pos;
+        size_t ones = rest == (elem_type)-1 >> pos ? ELEM_BITS - pos
+                                                   : (size_t)__builtin_ctzl(~rest);
+
+        if (ones > 0)
+        {
+          if (run_len == 0)
+            run_start = idx * ELEM_BITS + pos;
+          run_len += ones;
+          if (run_len >= cnt)
+            return run_start;
+          pos += ones;
+          if (pos == ELEM_BITS)
+            break; /* Run may go on in the next element. */
+        }
+
+        /* Bit POS is not VALUE: the run ends, and the next one
+           starts at the next VALUE bit, if any. */
+        run_len = 0;
+        rest = m >> pos;
+        if (rest == 0)
+          break;
+        pos += __builtin_ctzl(rest);
+      }
+    if (run_len >= cnt)
+      return run_start;
   }
   return BITMAP_ERROR;
 }
@@ -305,7 +544,7 @@ bitmap_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
    If there is no such group, returns BITMAP_ERROR.
    If CNT is zero, returns 0.
    Bits are set atomically, but testing bits is not atomic with
-   setting them. */
+   setting them; see bitmap_scan_and_flip_atomic() for that. */
 size_t
 bitmap_scan_and_flip(struct bitmap *b, size_t start, size_t cnt, bool value)
 {
@@ -315,6 +554,190 @@ bitmap_scan_and_flip(struct bitmap *b, size_t start, size_t cnt, bool value)
   return idx;
 }
 
+/* Concurrent access.
+
+   These functions may be called on the same bitmap from several
+   threads at once, with no lock, on a multiprocessor as well.
+   Each changes its bits with atomic read-modify-write operations
+   on whole elements, so bits of one element that belong to
+   different callers never overwrite each other.  They must not be
+   mixed with the plain functions that change bits while other
+   threads are using the bitmap. */
+
+/* Sets the bits of element IDX in B that are in MASK to VALUE,
+   atomically. */
+static inline void
+set_elem_atomic(struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  touch(b, idx, idx);
+  if (value)
+    __atomic_fetch_or(&b->bits[idx], mask, __ATOMIC_RELEASE);
+  else
+    __atomic_fetch_and(&b->bits[idx], ~mask, __ATOMIC_RELEASE);
+}
+
+/* Atomically sets the bit numbered BIT_IDX in B to true, even
+   against other processors. */
+void bitmap_mark_atomic(struct bitmap *b, size_t bit_idx)
+{
+  ASSERT(bit_idx < b->bit_cnt);
+  set_elem_atomic(b, elem_idx(bit_idx), bit_mask(bit_idx), true);
+}
+
+/* Atomically sets the bit numbered BIT_IDX in B to false, even
+   against other processors. */
+void bitmap_reset_atomic(struct bitmap *b, size_t bit_idx)
+{
+  ASSERT(bit_idx < b->bit_cnt);
+  set_elem_atomic(b, elem_idx(bit_idx), bit_mask(bit_idx), false);
+}
+
+/* Atomically toggles the bit numbered BIT_IDX in B, even against
+   other processors. */
+void bitmap_flip_atomic(struct bitmap *b, size_t bit_idx)
+{
+  ASSERT(bit_idx < b->bit_cnt);
+  touch(b, elem_idx(bit_idx), elem_idx(bit_idx));
+  __atomic_fetch_xor(&b->bits[elem_idx(bit_idx)], bit_mask(bit_idx),
+                     __ATOMIC_ACQ_REL);
+}
+
+/* Returns the value of the bit numbered IDX in B, as last set by
+   any processor. */
+bool bitmap_test_atomic(const struct bitmap *b, size_t idx)
+{
+  ASSERT(idx < b->bit_cnt);
+  return (__atomic_load_n(&b->bits[elem_idx(idx)], __ATOMIC_ACQUIRE)
+          & bit_mask(idx)) != 0;
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.  Each element
+   is updated atomically, but the range as a whole is not: another
+   thread may see some of the bits changed and not others. */
+void bitmap_set_multiple_atomic(struct bitmap *b, size_t start, size_t cnt,
+                                bool value)
+{
+  size_t end = start + cnt, first, last, i;
+
+  ASSERT(b != NULL);
+  ASSERT(start <= b->bit_cnt);
+  ASSERT(start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return;
+  first = elem_idx(start);
+  last = elem_idx(end - 1);
+  for (i = first; i <= last; i++)
+    set_elem_atomic(b, i, range_mask(i, start, end), value);
+}
+
+/* Tries to flip the CNT bits starting at IDX in B from VALUE to
+   !VALUE, one element at a time with compare-and-swap.  If some
+   bit is no longer VALUE, another thread got there first: the
+   elements already flipped are put back and false is returned. */
+static bool
+claim_atomic(struct bitmap *b, size_t idx, size_t cnt, bool value)
+{
+  size_t end = idx + cnt, first = elem_idx(idx), last = elem_idx(end - 1), i;
+
+  touch(b, first, last);
+  for (i = first; i <= last; i++)
+  {
+    elem_type mask = range_mask(i, idx, end);
+    elem_type old = __atomic_load_n(&b->bits[i], __ATOMIC_RELAXED);
+
+    do
+    {
+      if ((old & mask) != (fill(value) & mask))
+      {
+        while (i-- > first)
+          set_elem_atomic(b, i, range_mask(i, idx, end), value);
+        return false;
+      }
+    } while (!__atomic_compare_exchange_n(&b->bits[i], &old, old ^ mask, false,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  }
+  return true;
+}
+
+/* Like bitmap_scan() with CNT > 0, but reads each element of B
+   with a relaxed atomic load, once, so that it does not race with
+   the atomic functions changing B in other threads as the plain
+   (and vectorized) reads of bitmap_scan() would.  What it finds
+   may be stale by the time it returns. */
+static size_t
+scan_atomic(const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t idx, n, run_start = 0, run_len = 0;
+  elem_type other = fill(!value);
+
+  if (cnt > b->bit_cnt || start > b->bit_cnt - cnt)
+    return BITMAP_ERROR;
+
+  /* The same runs as in bitmap_scan(), without skipping ahead
+     with find_elem(). */
+  n = elem_cnt(b->bit_cnt);
+  for (idx = elem_idx(start); idx < n; idx++)
+  {
+    elem_type m = __atomic_load_n(&b->bits[idx], __ATOMIC_RELAXED) ^ other;
+    size_t pos = 0;
+
+    if (idx == elem_idx(start))
+      m &= (elem_type)-1 << (start % ELEM_BITS);
+    if (idx == n - 1)
+      m &= last_mask(b);
+
+    while (pos < ELEM_BITS)
+    {
+      elem_type rest = m >> pos;
+      size_t ones = rest == (elem_type)-1 >> pos ? ELEM_BITS - pos
+                                                 : (size_t)__builtin_ctzl(~rest);
+
+      if (ones > 0)
+      {
+        if (run_len == 0)
+          run_start = idx * ELEM_BITS + pos;
+        run_len += ones;
+        if (run_len >= cnt)
+          return run_start;
+        pos += ones;
+        if (pos == ELEM_BITS)
+          break; /* Run may go on in the next element. */
+      }
+      run_len = 0;
+      rest = m >> pos;
+      if (rest == 0)
+        break;
+      pos += __builtin_ctzl(rest);
+    }
+  }
+  return BITMAP_ERROR;
+}
+
+/* Like bitmap_scan_and_flip(), but safe against other threads
+   changing B at the same time: the group found is claimed with
+   compare-and-swap, so no two callers ever get overlapping
+   groups.  The scan itself reads B without locking and may see a
+   group that is taken before it can be claimed; the search then
+   resumes at that group.  Returns BITMAP_ERROR if no group was
+   free when the scan passed over it. */
+size_t
+bitmap_scan_and_flip_atomic(struct bitmap *b, size_t start, size_t cnt,
+                            bool value)
+{
+  size_t idx;
+
+  if (cnt == 0)
+    return bitmap_scan(b, start, cnt, value);
+  while ((idx = scan_atomic(b, start, cnt, value)) != BITMAP_ERROR)
+  {
+    if (claim_atomic(b, idx, cnt, value))
+      return idx;
+    start = idx;
+  }
+  return BITMAP_ERROR;
+}
+
 /* Returns the number of bytes needed to store B in a file. */
 size_t
 bitmap_file_size(const struct bitmap *b)
@@ -322,6 +745,427 @@ bitmap_file_size(const struct bitmap *b)
   return byte_cnt(b->bit_cnt);
 }
 
+/* File-backed bitmaps.
+
+   bitmap_open_mapped() maps a file laid out as
+
+     - one PAGE_BYTES header: magic, bit count, whether the bits
+       are known to match the checksums, and a checksum of the
+       header itself;
+
+     - the bits, padded to a whole number of PAGE_BYTES pages;
+
+     - a 64-bit checksum of each page of bits.
+
+   Bits are changed in place in the shared mapping.  Each page of
+   bits that is changed is noted in a small in-memory bitmap, so
+   that bitmap_checkpoint() flushes and re-checksums just those
+   pages rather than the whole file.  Before the first change
+   after a checkpoint, the header is marked dirty on disk; a file
+   still marked dirty when it is opened was not checkpointed after
+   its last change, and is only accepted if every page still
+   matches its checksum.  Opening a clean file reads the header
+   only, however large the bitmap. */
+
+#define PAGE_BYTES 4096
+#define MAPPED_VERSION 1
+#define MAPPED_CLEAN 1
+#define MAPPED_DIRTY 2
+
+/* Where marking the header dirty has got to, in memory. */
+enum header_state
+  {
+    HEADER_CLEAN,       /* Not marked since the last checkpoint. */
+    HEADER_MARKING,     /* Being marked by one thread. */
+    HEADER_DIRTY        /* Marked dirty on disk. */
+  };
+
+static const char mapped_magic[8] = "bitmap\n";
+
+/* First page of a mapped bitmap file. */
+struct bitmap_header
+{
+  char magic[8];        /* mapped_magic. */
+  uint32_t version;     /* MAPPED_VERSION. */
+  uint32_t state;       /* MAPPED_CLEAN or MAPPED_DIRTY. */
+  uint64_t bit_cnt;     /* Number of bits. */
+  uint64_t header_sum;  /* Checksum of the fields above. */
+};
+
+/* The file behind a mapped bitmap. */
+struct bitmap_mapping
+{
+  int fd;                   /* Open file. */
+  uint8_t *base;            /* Mapping of the whole file. */
+  size_t len;               /* Length of the mapping. */
+  size_t page_cnt;          /* Pages of bits. */
+  struct bitmap_header *hdr;
+  uint64_t *sums;           /* Checksum of each page of bits. */
+  struct bitmap *dirty;     /* Pages changed since the last checkpoint. */
+  int header_state;         /* enum header_state. */
+  int mark_error;           /* errno from failing to mark it, or 0. */
+};
+
+/* Returns the number of pages holding BIT_CNT bits. */
+static inline size_t
+page_cnt(size_t bit_cnt)
+{
+  return DIV_ROUND_UP(byte_cnt(bit_cnt), PAGE_BYTES);
+}
+
+/* Returns the length of a file of PAGES pages of bits. */
+static inline size_t
+mapped_len(size_t pages)
+{
+  return PAGE_BYTES + pages * PAGE_BYTES + pages * sizeof(uint64_t);
+}
+
+/* Returns a checksum of the N bytes at P; N must be a multiple
+   of 8. */
+static uint64_t
+checksum(const void *p, size_t n)
+{
+  const uint64_t *w = p;
+  uint64_t h = 0x6a09e667f3bcc908ULL;
+  size_t i;
+
+  for (i = 0; i < n / sizeof *w; i++)
+  {
+    h = (h ^ w[i]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+/* Returns the checksum of page PAGE of the bits in M. */
+static uint64_t
+page_sum(const struct bitmap_mapping *m, size_t page)
+{
+  return checksum(m->base + PAGE_BYTES + page * PAGE_BYTES, PAGE_BYTES);
+}
+
+/* Points M's fields into the mapping at BASE, which holds PAGES
+   pages of bits. */
+static void
+set_layout(struct bitmap_mapping *m, void *base, size_t pages)
+{
+  m->base = base;
+  m->len = mapped_len(pages);
+  m->page_cnt = pages;
+  m->hdr = base;
+  m->sums = (uint64_t *)(m->base + PAGE_BYTES + pages * PAGE_BYTES);
+}
+
+/* Writes the LEN bytes at offset OFS in M's mapping to the file,
+   with msync() FLAGS: MS_SYNC waits for them to reach the disk,
+   MS_ASYNC leaves that to a later fdatasync().  Returns true if
+   successful. */
+static bool
+sync_range(struct bitmap_mapping *m, size_t ofs, size_t len, int flags)
+{
+  size_t start = ROUND_DOWN(ofs, (size_t)sysconf(_SC_PAGESIZE));
+
+  return len == 0 || msync(m->base + start, ofs + len - start, flags) == 0;
+}
+
+/* Sets the state in M's header to STATE and writes the header
+   to the file.  Returns true if successful. */
+static bool
+write_state(struct bitmap_mapping *m, uint32_t state)
+{
+  m->hdr->state = state;
+  m->hdr->header_sum = checksum(m->hdr, offsetof(struct bitmap_header,
+                                                 header_sum));
+  return sync_range(m, 0, PAGE_BYTES, MS_SYNC);
+}
+
+/* Notes that elements FIRST through LAST of mapped bitmap B are
+   about to change.  Safe to call from several threads at once,
+   like the atomic functions that call it: one thread marks the
+   header dirty, and the others spin until it is on disk, as none
+   of their changes may reach the file before it.  If it cannot be
+   marked, the change goes ahead regardless, the next change tries
+   again, and bitmap_checkpoint() reports the error. */
+static void
+mark_dirty(struct bitmap *b, size_t first, size_t last)
+{
+  struct bitmap_mapping *m = b->map;
+  size_t page = first * sizeof(elem_type) / PAGE_BYTES;
+  size_t end = last * sizeof(elem_type) / PAGE_BYTES;
+  int state;
+
+  while ((state = __atomic_load_n(&m->header_state, __ATOMIC_ACQUIRE))
+         != HEADER_DIRTY)
+  {
+    if (state == HEADER_MARKING)
+      sched_yield();
+    else if (__atomic_compare_exchange_n(&m->header_state, &state,
+                                         HEADER_MARKING, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+      if (write_state(m, MAPPED_DIRTY))
+        state = HEADER_DIRTY;
+      else
+      {
+        __atomic_store_n(&m->mark_error, errno, __ATOMIC_RELAXED);
+        state = HEADER_CLEAN;
+      }
+      __atomic_store_n(&m->header_state, state, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+  for (; page <= end; page++)
+    if (!bitmap_test_atomic(m->dirty, page))
+      bitmap_mark_atomic(m->dirty, page);
+}
+
+/* Writes the header and checksums of a new file of BIT_CNT bits,
+   all false, to the fresh zero-filled mapping in M. */
+static bool
+format_mapped(struct bitmap_mapping *m, size_t bit_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    m->sums[i] = i == 0 ? page_sum(m, 0) : m->sums[0];
+  if (!sync_range(m, PAGE_BYTES, m->len - PAGE_BYTES, MS_SYNC))
+    return false;
+  memcpy(m->hdr->magic, mapped_magic, sizeof mapped_magic);
+  m->hdr->version = MAPPED_VERSION;
+  m->hdr->bit_cnt = bit_cnt;
+  return write_state(m, MAPPED_CLEAN);
+}
+
+/* Checks that the existing file mapped in M is a bitmap and that
+   its bits can be trusted, marking it clean if they can.  Sets
+   errno and returns false if not. */
+static bool
+check_mapped(struct bitmap_mapping *m)
+{
+  struct bitmap_header *h = m->hdr;
+  size_t i;
+
+  if (memcmp(h->magic, mapped_magic, sizeof mapped_magic)
+      || h->version != MAPPED_VERSION
+      || h->header_sum != checksum(h, offsetof(struct bitmap_header,
+                                               header_sum))
+      || m->len != mapped_len(page_cnt(h->bit_cnt))
+      || (h->state != MAPPED_CLEAN && h->state != MAPPED_DIRTY))
+  {
+    errno = EINVAL;
+    return false;
+  }
+  if (h->state == MAPPED_CLEAN)
+    return true;
+
+  /* Changed without a checkpoint: some pages may have reached the
+     file and some not. */
+  for (i = 0; i < m->page_cnt; i++)
+    if (page_sum(m, i) != m->sums[i])
+    {
+      errno = EIO;
+      return false;
+    }
+  return write_state(m, MAPPED_CLEAN);
+}
+
+static struct bitmap *expand_mapped(struct bitmap *, size_t bit_cnt);
+
+/* Opens the bitmap stored in the file at PATH, creating the file
+   with BIT_CNT bits, all false, if it is empty or does not exist.
+   An existing bitmap with fewer than BIT_CNT bits is grown to
+   BIT_CNT bits; one with more keeps its size.
+
+   The bitmap is changed in place in a shared mapping of the file.
+   Call bitmap_checkpoint() to make its current contents durable,
+   and bitmap_destroy() to checkpoint and close it.
+
+   Returns NULL and sets errno on failure, which includes EINVAL if
+   the file is not a bitmap and EIO if it was changed after its
+   last checkpoint and those changes may have been torn. */
+struct bitmap *
+bitmap_open_mapped(const char *path, size_t bit_cnt)
+{
+  struct bitmap *b = malloc(sizeof *b);
+  struct bitmap_mapping *m = malloc(sizeof *m);
+  struct stat st;
+  bool fresh;
+  void *base = MAP_FAILED;
+  int saved;
+
+  if (b == NULL || m == NULL)
+  {
+    free(b);
+    free(m);
+    errno = ENOMEM;
+    return NULL;
+  }
+  m->dirty = NULL;
+  m->header_state = HEADER_CLEAN;
+  m->mark_error = 0;
+  if ((m->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0
+      || fstat(m->fd, &st) < 0)
+    goto fail;
+
+  fresh = st.st_size == 0;
+  if (fresh && ftruncate(m->fd, mapped_len(page_cnt(bit_cnt))) < 0)
+    goto fail;
+  m->len = fresh ? mapped_len(page_cnt(bit_cnt)) : (size_t)st.st_size;
+  if (m->len < PAGE_BYTES)
+  {
+    errno = EINVAL;
+    goto fail;
+  }
+  base = mmap(NULL, m->len, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+  if (base == MAP_FAILED)
+    goto fail;
+
+  /* Work out the layout from the length first: check_mapped()
+     rejects a file whose header disagrees with it. */
+  set_layout(m, base, (m->len - PAGE_BYTES) / (PAGE_BYTES + sizeof(uint64_t)));
+  if (fresh ? !format_mapped(m, bit_cnt) : !check_mapped(m))
+    goto fail;
+  if ((m->dirty = bitmap_create(m->page_cnt)) == NULL)
+  {
+    errno = ENOMEM;
+    goto fail;
+  }
+
+  b->bit_cnt = m->hdr->bit_cnt;
+  b->bits = (elem_type *)(m->base + PAGE_BYTES);
+  b->map = m;
+  if (bit_cnt > b->bit_cnt && expand_mapped(b, bit_cnt) == NULL)
+  {
+    saved = errno;
+    close_mapped(b);
+    errno = saved;
+    return NULL;
+  }
+  return b;
+
+fail:
+  saved = errno;
+  if (base != MAP_FAILED)
+    munmap(base, m->len);
+  if (m->fd >= 0)
+    close(m->fd);
+  bitmap_destroy(m->dirty);
+  free(m);
+  free(b);
+  errno = saved;
+  return NULL;
+}
+
+/* Makes the current contents of mapped bitmap B durable: writes
+   the pages changed since the last checkpoint and their checksums
+   to the file, waits for them with a single fdatasync() rather
+   than one flush per run of pages, and then marks the file clean.
+   Does nothing for a bitmap that is not backed by a file.  Must
+   not run while other threads are changing B.  Returns true if
+   successful.  Also returns false, setting errno, if marking the
+   file dirty failed before some change since the last checkpoint:
+   the checkpoint itself succeeded, but a crash before it could
+   have left that change torn in a file that looked clean. */
+bool bitmap_checkpoint(struct bitmap *b)
+{
+  struct bitmap_mapping *m = b->map;
+  size_t page, end, i;
+
+  if (m == NULL || (m->header_state == HEADER_CLEAN && m->mark_error == 0))
+    return true;
+  for (page = 0; (page = bitmap_scan(m->dirty, page, 1, true)) != BITMAP_ERROR;
+       page = end)
+  {
+    if ((end = bitmap_scan(m->dirty, page, 1, false)) == BITMAP_ERROR)
+      end = m->page_cnt;
+    for (i = page; i < end; i++)
+      m->sums[i] = page_sum(m, i);
+    if (!sync_range(m, PAGE_BYTES + page * PAGE_BYTES,
+                    (end - page) * PAGE_BYTES, MS_ASYNC)
+        || !sync_range(m, (uint8_t *)&m->sums[page] - m->base,
+                       (end - page) * sizeof *m->sums, MS_ASYNC))
+      return false;
+    bitmap_set_multiple(m->dirty, page, end - page, false);
+  }
+  if (fdatasync(m->fd) < 0)
+    return false;
+  m->header_state = HEADER_CLEAN;
+  if (!write_state(m, MAPPED_CLEAN))
+    return false;
+  if (m->mark_error != 0)
+  {
+    errno = m->mark_error;
+    m->mark_error = 0;
+    return false;
+  }
+  return true;
+}
+
+/* Grows mapped bitmap B to BIT_CNT bits, the new ones false.
+   The file is marked dirty while its layout changes, so a crash
+   part way through is caught when it is next opened.  Returns B,
+   or a null pointer if the file could not be grown, in which case
+   B is left as it was. */
+static struct bitmap *
+expand_mapped(struct bitmap *b, size_t bit_cnt)
+{
+  struct bitmap_mapping *m = b->map;
+  size_t old_pages = m->page_cnt, pages = page_cnt(bit_cnt), i;
+  size_t old_len = m->len;
+  uint8_t *base;
+  uint64_t zero_sum;
+
+  if (!bitmap_checkpoint(b) || !write_state(m, MAPPED_DIRTY))
+    return NULL;
+  m->header_state = HEADER_DIRTY;
+  if (pages > old_pages)
+  {
+    if (bitmap_expand(m->dirty, pages - old_pages) == NULL)
+      return NULL;
+    if (ftruncate(m->fd, mapped_len(pages)) < 0)
+      return NULL;
+    base = mmap(NULL, mapped_len(pages), PROT_READ | PROT_WRITE, MAP_SHARED,
+                m->fd, 0);
+    if (base == MAP_FAILED)
+    {
+      ftruncate(m->fd, old_len);
+      return NULL;
+    }
+    munmap(m->base, old_len);
+    set_layout(m, base, pages);
+
+    /* The checksums move up past the new pages of bits, which
+       take their old place and must read as zeros. */
+    memmove(m->sums, base + PAGE_BYTES + old_pages * PAGE_BYTES,
+            old_pages * sizeof *m->sums);
+    memset(base + PAGE_BYTES + old_pages * PAGE_BYTES, 0,
+           (pages - old_pages) * PAGE_BYTES);
+    zero_sum = page_sum(m, old_pages);
+    for (i = old_pages; i < pages; i++)
+      m->sums[i] = zero_sum;
+    if (!sync_range(m, PAGE_BYTES, m->len - PAGE_BYTES, MS_SYNC))
+      return NULL;
+    b->bits = (elem_type *)(base + PAGE_BYTES);
+  }
+  m->hdr->bit_cnt = bit_cnt;
+  b->bit_cnt = bit_cnt;
+  return bitmap_checkpoint(b) ? b : NULL;
+}
+
+/* Checkpoints and closes mapped bitmap B and frees it. */
+static void
+close_mapped(struct bitmap *b)
+{
+  struct bitmap_mapping *m = b->map;
+
+  bitmap_checkpoint(b);
+  munmap(m->base, m->len);
+  close(m->fd);
+  bitmap_destroy(m->dirty);
+  free(m);
+  free(b);
+}
+
 /* Debugging. */
 
 /* Dumps the contents of B to the console as hexadecimal. */
@@ -345,6 +1189,12 @@ struct bitmap *bitmap_expand(struct bitmap *bitmap, int size)
     return bitmap;
   }
 
+  if (bitmap->map != NULL)
+  {
+    // 파일에 매핑된 비트맵은 파일을 늘려서 다시 매핑 (새 비트는 이미 0)
+    return expand_mapped(bitmap, bitmap_size(bitmap) + size);
+  }
+
   size_t old_size = bitmap_size(bitmap);                           // 원래 크기를 저장
   size_t new_size = old_size + size;                               // 새로운 크기를 계산
   elem_type *new_bits = realloc(bitmap->bits, byte_cnt(new_size)); // 확장된 비트맵을 위해 메모리를 재할당
@@ -37,8 +37,18 @@ bool bitmap_all(const struct bitmap *, size_t start, size_t cnt);
 size_t bitmap_scan(const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip(struct bitmap *, size_t start, size_t cnt, bool);
 
+/* Concurrent access (no lock needed). */
+void bitmap_mark_atomic(struct bitmap *, size_t idx);
+void bitmap_reset_atomic(struct bitmap *, size_t idx);
+void bitmap_flip_atomic(struct bitmap *, size_t idx);
+bool bitmap_test_atomic(const struct bitmap *, size_t idx);
+void bitmap_set_multiple_atomic(struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_and_flip_atomic(struct bitmap *, size_t start, size_t cnt, bool);
+
 /* File input and output. */
 size_t bitmap_file_size(const struct bitmap *);
+struct bitmap *bitmap_open_mapped(const char *path, size_t bit_cnt);
+bool bitmap_checkpoint(struct bitmap *);
 
 /* Debugging. */
 void bitmap_dump(const struct bitmap *);
@@ -0,0 +1,491 @@
+// bitmapbench.c - 비트맵 count/contains/scan 성능 측정
+//
+// 사용법: bitmapbench [-n 비트 수(백만)] [-s 검증 횟수]
+//                    [-m 매핑 비트 수(백만)] [-f 매핑 파일]
+//
+// 블록 할당 맵을 흉내 낸 비트맵(대부분 할당됨, 드문드문 빈 구간)에서
+// 예전 방식(bitmap_test를 비트마다 호출)과 지금의 워드 단위 구현을
+// 비교하여 초당 처리한 기가비트(Gbit/s)를 출력한다.
+// 이어서 같은 맵에서 bitmap_scan과 계층 비트맵(hbitmap_scan)의
+// first-fit 검색 한 번에 걸리는 시간을 비교한다.
+// 마지막으로 여러 스레드가 한 맵에서 블록을 할당/해제할 때, 전역 락을 건
+// bitmap_scan_and_flip과 락 없는 bitmap_scan_and_flip_atomic의 처리량을 비교한다.
+// 끝으로 파일에 매핑된 비트맵을 만들고, 체크포인트(전부/일부 변경),
+// 다시 열기, 확장에 걸리는 시간을 재고, 체크포인트 없이 죽은 뒤에는
+// 열기가 거부되는지 확인한다.
+// 측정 전에 임의의 비트맵과 구간으로 구현들의 결과가 같은지 검증한다.
+
+#include "bitmap.h"
+#include "hbitmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+// 예전 bitmap_count: 비트마다 bitmap_test
+static size_t old_count(const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    size_t i, value_cnt = 0;
+
+    for (i = 0; i < cnt; i++)
+        if (bitmap_test(b, start + i) == value)
+            value_cnt++;
+    return value_cnt;
+}
+
+// 예전 bitmap_contains
+static bool old_contains(const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    size_t i;
+
+    for (i = 0; i < cnt; i++)
+        if (bitmap_test(b, start + i) == value)
+            return true;
+    return false;
+}
+
+// 예전 bitmap_scan: 후보 시작 위치마다 old_contains
+static size_t old_scan(const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+    if (cnt <= bitmap_size(b))
+    {
+        size_t last = bitmap_size(b) - cnt;
+        size_t i;
+        for (i = start; i <= last; i++)
+            if (!old_contains(b, i, cnt, !value))
+                return i;
+    }
+    return BITMAP_ERROR;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 비트맵 전체를 1(할당)로 채운 뒤, 평균 gap 비트마다 길이 1~hole인 빈 구간을 만든다
+static void fill_map(struct bitmap *b, size_t gap, size_t hole)
+{
+    size_t n = bitmap_size(b), i, len;
+
+    bitmap_set_all(b, true);
+    for (i = random() % gap; i < n; i += 1 + random() % (2 * gap))
+    {
+        len = 1 + random() % hole;
+        if (i + len > n)
+            len = n - i;
+        bitmap_set_multiple(b, i, len, false);
+    }
+}
+
+// 작은 비트맵들에서 임의의 구간으로 예전/새 구현의 결과를 비교
+static void verify(int rounds)
+{
+    int r;
+
+    for (r = 0; r < rounds; r++)
+    {
+        size_t n = 1 + random() % 2000, start, cnt, i;
+        struct bitmap *b = bitmap_create(n);
+        bool value = random() % 2;
+
+        if (b == NULL)
+        {
+            fprintf(stderr, "bitmap_create failed\n");
+            exit(1);
+        }
+        // 밀도를 바꿔 가며 임의로 채움
+        for (i = 0; i < n; i++)
+            bitmap_set(b, i, random() % 8 < (size_t)r % 9);
+        start = random() % (n + 1);
+        cnt = random() % (n - start + 1);
+
+        if (bitmap_count(b, start, cnt, value) != old_count(b, start, cnt, value) ||
+            bitmap_contains(b, start, cnt, value) != old_contains(b, start, cnt, value) ||
+            bitmap_scan(b, start, cnt % 70, value) != old_scan(b, start, cnt % 70, value))
+        {
+            fprintf(stderr, "mismatch: n %zu start %zu cnt %zu value %d\n",
+                    n, start, cnt, value);
+            exit(1);
+        }
+        bitmap_destroy(b);
+    }
+    printf("verified %d random ranges\n", rounds);
+}
+
+// 임의의 set_multiple 뒤에 bitmap과 hbitmap(힌트 있음/없음)의 scan 결과를 비교
+static void verify_hbitmap(int rounds)
+{
+    int r, op;
+
+    for (r = 0; r < rounds / 100; r++)
+    {
+        size_t n = 1 + random() % 20000, start, cnt;
+        struct bitmap *b = bitmap_create(n);
+        struct hbitmap *h = hbitmap_create(n, true), *g = hbitmap_create(n, false);
+
+        if (b == NULL || h == NULL || g == NULL)
+        {
+            fprintf(stderr, "create failed\n");
+            exit(1);
+        }
+        for (op = 0; op < 200; op++)
+        {
+            bool value = random() % 2;
+
+            start = random() % (n + 1);
+            cnt = random() % (n - start + 1) % (1 + random() % 300);
+            bitmap_set_multiple(b, start, cnt, value);
+            hbitmap_set_multiple(h, start, cnt, value);
+            hbitmap_set_multiple(g, start, cnt, value);
+
+            start = random() % (n + 1);
+            cnt = random() % 150;
+            value = random() % 2;
+            if (hbitmap_scan(h, start, cnt, value) != bitmap_scan(b, start, cnt, value) ||
+                hbitmap_scan(g, start, cnt, value) != bitmap_scan(b, start, cnt, value))
+            {
+                fprintf(stderr, "hbitmap mismatch: n %zu start %zu cnt %zu value %d\n",
+                        n, start, cnt, value);
+                exit(1);
+            }
+        }
+        bitmap_destroy(b);
+        hbitmap_destroy(h);
+        hbitmap_destroy(g);
+    }
+    printf("verified hbitmap on %d random bitmaps\n", rounds / 100);
+}
+
+// 할당 벤치마크: 스레드마다 next-fit 커서로 1~8비트를 할당하고,
+// 최근 할당 64개를 넘으면 가장 오래된 것을 해제한다
+#define ALLOC_RING 64
+
+static struct bitmap *amap;
+static pthread_mutex_t amap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int alloc_stop;
+static int alloc_locked; // 1이면 전역 락 + 일반 함수, 0이면 atomic 함수
+
+struct alloc_worker
+{
+    pthread_t tid;
+    unsigned seed;
+    long ops;     // 할당 + 해제 횟수
+    long overlap; // 이미 할당된 비트를 또 받은 횟수 (0이어야 함)
+};
+
+// amap의 [idx, idx + cnt)가 모두 1인지 atomic 읽기로 확인한다
+static bool claimed(size_t idx, size_t cnt)
+{
+    size_t i;
+
+    for (i = idx; i < idx + cnt; i++)
+        if (!bitmap_test_atomic(amap, i))
+            return false;
+    return true;
+}
+
+static void *alloc_thread(void *arg)
+{
+    struct alloc_worker *w = arg;
+    size_t n = bitmap_size(amap), cursor = rand_r(&w->seed) % n;
+    size_t idx[ALLOC_RING], len[ALLOC_RING];
+    int head = 0, cnt = 0;
+
+    while (!__atomic_load_n(&alloc_stop, __ATOMIC_RELAXED))
+    {
+        size_t want = 1 + rand_r(&w->seed) % 8, got;
+
+        if (alloc_locked)
+        {
+            pthread_mutex_lock(&amap_lock);
+            if ((got = bitmap_scan_and_flip(amap, cursor, want, false)) == BITMAP_ERROR)
+                got = bitmap_scan_and_flip(amap, 0, want, false);
+            pthread_mutex_unlock(&amap_lock);
+        }
+        else if ((got = bitmap_scan_and_flip_atomic(amap, cursor, want, false)) == BITMAP_ERROR)
+            got = bitmap_scan_and_flip_atomic(amap, 0, want, false);
+        if (got != BITMAP_ERROR)
+        {
+            w->ops++;
+            cursor = got + want < n ? got + want : 0;
+            // 받은 구간은 모두 1이어야 하고, 우리가 0으로 만들기 전까지 그대로여야 함.
+            // 락 모드는 락이 겹침을 막으므로, 락 없는 모드만 atomic 읽기로 확인한다
+            if (!alloc_locked && !claimed(got, want))
+                w->overlap++;
+            if (cnt == ALLOC_RING)
+            {
+                if (alloc_locked)
+                {
+                    pthread_mutex_lock(&amap_lock);
+                    bitmap_set_multiple(amap, idx[head], len[head], false);
+                    pthread_mutex_unlock(&amap_lock);
+                }
+                else
+                    bitmap_set_multiple_atomic(amap, idx[head], len[head], false);
+                w->ops++;
+                head = (head + 1) % ALLOC_RING;
+                cnt--;
+            }
+            idx[(head + cnt) % ALLOC_RING] = got;
+            len[(head + cnt) % ALLOC_RING] = want;
+            cnt++;
+        }
+    }
+    return NULL;
+}
+
+// threads개 스레드로 secs초 동안 할당/해제, 초당 연산 수를 출력
+static void alloc_bench(int threads, int locked, double secs)
+{
+    struct alloc_worker *w = calloc(threads, sizeof *w);
+    long ops = 0, overlap = 0;
+    double t0;
+    int i;
+
+    amap = bitmap_create(1 << 20);
+    if (w == NULL || amap == NULL)
+    {
+        fprintf(stderr, "alloc_bench: out of memory\n");
+        exit(1);
+    }
+    srandom(2);
+    fill_map(amap, 64, 32); // 절반쯤 차 있는 맵
+    alloc_locked = locked;
+    alloc_stop = 0;
+    t0 = now();
+    for (i = 0; i < threads; i++)
+    {
+        w[i].seed = i + 1;
+        pthread_create(&w[i].tid, NULL, alloc_thread, &w[i]);
+    }
+    usleep(secs * 1e6);
+    __atomic_store_n(&alloc_stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(w[i].tid, NULL);
+        ops += w[i].ops;
+        overlap += w[i].overlap;
+    }
+    printf("alloc %-7s %2d threads %10.0f ops/s%s\n", locked ? "locked" : "atomic",
+           threads, ops / (now() - t0), overlap ? "  OVERLAP!" : "");
+    bitmap_destroy(amap);
+    free(w);
+}
+
+// 파일에 매핑된 비트맵: 만들기, 체크포인트, 다시 열기, 확장, 비정상 종료 후 열기
+static void mapped_bench(const char *path, size_t n)
+{
+    struct bitmap *b, *ref;
+    double t0;
+    size_t i, touched = 1000;
+    pid_t pid;
+    int status;
+
+    unlink(path);
+    t0 = now();
+    if ((b = bitmap_open_mapped(path, n)) == NULL)
+    {
+        perror("bitmap_open_mapped");
+        exit(1);
+    }
+    printf("mapped %zu Mbit: create %10.3f ms\n", n >> 20, (now() - t0) * 1e3);
+
+    // 전체를 바꾼 뒤의 체크포인트와 일부 비트만 바꾼 뒤의 체크포인트
+    bitmap_set_all(b, true);
+    t0 = now();
+    bitmap_checkpoint(b);
+    printf("checkpoint, all dirty  %10.3f ms\n", (now() - t0) * 1e3);
+    ref = bitmap_create(n);
+    bitmap_set_all(ref, true);
+    for (i = 0; i < touched; i++)
+    {
+        size_t idx = random() % n;
+        bitmap_reset(b, idx);
+        bitmap_reset(ref, idx);
+    }
+    t0 = now();
+    bitmap_checkpoint(b);
+    printf("checkpoint, %zu bits %10.3f ms\n", touched, (now() - t0) * 1e3);
+    bitmap_destroy(b);
+
+    // 깨끗하게 닫힌 파일은 헤더만 읽고 열림
+    t0 = now();
+    b = bitmap_open_mapped(path, 0);
+    printf("reopen                 %10.3f ms\n", (now() - t0) * 1e3);
+    if (b == NULL || bitmap_size(b) != n
+        || bitmap_count(b, 0, n, false) != bitmap_count(ref, 0, n, false)
+        || bitmap_scan(b, 0, 1, false) != bitmap_scan(ref, 0, 1, false))
+    {
+        fprintf(stderr, "mapped bitmap mismatch after reopen\n");
+        exit(1);
+    }
+
+    // 확장: 새 비트는 0, 기존 비트는 그대로
+    t0 = now();
+    if (bitmap_expand(b, 1 << 20) == NULL)
+    {
+        perror("bitmap_expand");
+        exit(1);
+    }
+    printf("expand by 1 Mbit       %10.3f ms\n", (now() - t0) * 1e3);
+    if (bitmap_size(b) != n + (1 << 20) || bitmap_count(b, n, 1 << 20, true) != 0
+        || bitmap_count(b, 0, n, false) != bitmap_count(ref, 0, n, false))
+    {
+        fprintf(stderr, "mapped bitmap mismatch after expand\n");
+        exit(1);
+    }
+    bitmap_destroy(b);
+
+    // 체크포인트 없이 바꾸고 죽은 프로세스의 파일은 거부되어야 함
+    if ((pid = fork()) == 0)
+    {
+        b = bitmap_open_mapped(path, 0);
+        bitmap_flip(b, n / 2);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    b = bitmap_open_mapped(path, 0);
+    printf("reopen after crash: %s\n",
+           b == NULL && errno == EIO ? "rejected (EIO)" : "ACCEPTED!");
+    bitmap_destroy(b);
+    bitmap_destroy(ref);
+    unlink(path);
+}
+
+// 한 가지 연산을 시간 측정하고 Gbit/s를 출력, 결과를 돌려줌
+#define RUN(name, bits, expr)                                                  \
+    ({                                                                         \
+        double t0 = now();                                                     \
+        size_t res = (expr);                                                   \
+        double secs = now() - t0;                                              \
+        printf("%-24s %10.2f Gbit/s  (%zu)\n", name, (bits) / secs / 1e9, res); \
+        res;                                                                   \
+    })
+
+int main(int argc, char **argv)
+{
+    size_t mbits = 64, map_mbits = 1024, n, pos, scanned;
+    const char *map_path = "bitmapbench.map";
+    int c, rounds = 100000;
+    struct bitmap *b;
+
+    while ((c = getopt(argc, argv, "n:s:m:f:")) != -1)
+    {
+        if (c == 'n')
+            mbits = atol(optarg);
+        else if (c == 's')
+            rounds = atoi(optarg);
+        else if (c == 'm')
+            map_mbits = atol(optarg);
+        else if (c == 'f')
+            map_path = optarg;
+        else
+        {
+            fprintf(stderr, "usage: %s [-n megabits] [-s rounds] [-m megabits] [-f file]\n", argv[0]);
+            exit(1);
+        }
+    }
+    srandom(1);
+    verify(rounds);
+    verify_hbitmap(rounds);
+
+    n = mbits << 20;
+    if ((b = bitmap_create(n)) == NULL)
+    {
+        fprintf(stderr, "bitmap_create failed\n");
+        exit(1);
+    }
+    // 4096비트마다 1~32비트 빈 구간: 64비트 빈 구간은 끝에만 있음
+    fill_map(b, 4096, 32);
+    bitmap_set_multiple(b, n - 100, 100, false);
+
+    RUN("count (old)", n, old_count(b, 0, n, false));
+    RUN("count", n, bitmap_count(b, 0, n, false));
+    bitmap_set_all(b, true);
+    RUN("contains (old, full)", n, old_contains(b, 0, n, false));
+    RUN("contains (full)", n, bitmap_contains(b, 0, n, false));
+
+    // 스캔: 64비트 빈 구간은 맨 끝에만 있으므로 전체를 훑는다
+    fill_map(b, 4096, 32);
+    bitmap_set_multiple(b, n - 100, 100, false);
+    pos = RUN("scan 64 (old)", n, old_scan(b, 0, 64, false));
+    scanned = RUN("scan 64", n, bitmap_scan(b, 0, 64, false));
+    if (pos != scanned)
+    {
+        fprintf(stderr, "scan mismatch: %zu vs %zu\n", pos, scanned);
+        exit(1);
+    }
+
+    // 빈 구간이 전혀 없는 꽉 찬 맵에서 1비트 스캔 (AVX2로 건너뛰기)
+    bitmap_set_all(b, true);
+    bitmap_reset(b, n - 1);
+    RUN("scan 1, full (old)", n, old_scan(b, 0, 1, false));
+    RUN("scan 1, full", n, bitmap_scan(b, 0, 1, false));
+
+    // first-fit: 64비트 빈 구간이 맨 끝에만 있는 맵에서 검색 한 번의 시간
+    fill_map(b, 4096, 32);
+    bitmap_set_multiple(b, n - 100, 100, false);
+    {
+        struct hbitmap *h = hbitmap_create(n, true);
+        size_t pos, end, lens[] = {1, 16, 64};
+        int k, reps = 20;
+
+        if (h == NULL)
+        {
+            fprintf(stderr, "hbitmap_create failed\n");
+            exit(1);
+        }
+        // b의 빈 구간들을 h에 그대로 옮김
+        hbitmap_set_all(h, true);
+        for (pos = 0; (pos = bitmap_scan(b, pos, 1, false)) != BITMAP_ERROR; pos = end)
+        {
+            if ((end = bitmap_scan(b, pos, 1, true)) == BITMAP_ERROR)
+                end = n;
+            hbitmap_set_multiple(h, pos, end - pos, false);
+        }
+        for (k = 0; k < 3; k++)
+        {
+            size_t bpos = 0, hpos = 0;
+            double t0, tb, th;
+            int j;
+
+            // 시작 위치를 바꿔 가며 reps번 검색
+            t0 = now();
+            for (j = 0; j < reps; j++)
+                bpos += bitmap_scan(b, (n / reps) * j, lens[k], false);
+            tb = (now() - t0) / reps;
+            t0 = now();
+            for (j = 0; j < reps; j++)
+                hpos += hbitmap_scan(h, (n / reps) * j, lens[k], false);
+            th = (now() - t0) / reps;
+            if (bpos != hpos)
+            {
+                fprintf(stderr, "hbitmap_scan mismatch\n");
+                exit(1);
+            }
+            printf("first-fit %2zu: bitmap_scan %10.0f ns, hbitmap_scan %8.0f ns\n",
+                   lens[k], tb * 1e9, th * 1e9);
+        }
+        hbitmap_destroy(h);
+    }
+
+    bitmap_destroy(b);
+
+    for (c = 1; c <= 8; c *= 2)
+    {
+        alloc_bench(c, 1, 0.5);
+        alloc_bench(c, 0, 0.5);
+    }
+
+    mapped_bench(map_path, map_mbits << 20);
+    return 0;
+}
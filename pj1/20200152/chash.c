@@ -0,0 +1,697 @@
+/* Concurrent hash table.
+
+   See chash.h for basic information. */
+
+#include "chash.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+#define list_elem_to_hash_elem(LIST_ELEM) \
+  list_entry(LIST_ELEM, struct hash_elem, list_elem)
+
+/* Loads and stores of fields that readers use without a lock. */
+#define LOAD(P) __atomic_load_n(P, __ATOMIC_RELAXED)
+#define LOAD_ACQ(P) __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define STORE(P, V) __atomic_store_n(P, V, __ATOMIC_RELAXED)
+#define STORE_REL(P, V) __atomic_store_n(P, V, __ATOMIC_RELEASE)
+
+/* Elems/bucket > 4 in a stripe: double the number of buckets. */
+#define MAX_ELEMS_PER_BUCKET 4
+
+/* A bucket array. */
+struct chash_table
+{
+  size_t bucket_cnt;            /* Number of buckets, a power of 2. */
+  struct chash_table *next;     /* Array being grown into, or NULL. */
+  bool moved[CHASH_STRIPES];    /* Stripes already moved to `next'. */
+  struct list buckets[];        /* Array of `bucket_cnt' lists. */
+};
+
+static void retire(hash_action_func *, struct hash_elem *, void *aux,
+                   struct chash_table *);
+
+/* Returns the stripe of H that an element with hash HASH is in. */
+static inline struct chash_stripe *
+stripe_of(struct chash *h, unsigned hash)
+{
+  return &h->stripes[hash & (CHASH_STRIPES - 1)];
+}
+
+/* Returns a bucket array of BUCKET_CNT empty buckets, or a null
+   pointer if memory allocation fails. */
+static struct chash_table *
+alloc_table(size_t bucket_cnt)
+{
+  struct chash_table *t;
+  size_t i;
+
+  t = malloc(sizeof *t + sizeof *t->buckets * bucket_cnt);
+  if (t == NULL)
+    return NULL;
+  t->bucket_cnt = bucket_cnt;
+  t->next = NULL;
+  for (i = 0; i < CHASH_STRIPES; i++)
+    t->moved[i] = false;
+  for (i = 0; i < bucket_cnt; i++)
+    list_init(&t->buckets[i]);
+  return t;
+}
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool chash_init(struct chash *h,
+                hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  size_t i;
+
+  h->table = alloc_table(CHASH_STRIPES);
+  if (h->table == NULL)
+    return false;
+  pthread_mutex_init(&h->resize_lock, NULL);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+  for (i = 0; i < CHASH_STRIPES; i++)
+  {
+    pthread_mutex_init(&h->stripes[i].lock, NULL);
+    h->stripes[i].seq = 0;
+    h->stripes[i].elem_cnt = 0;
+  }
+  return true;
+}
+
+/* Destroys hash table H, which no other thread may be using.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as in hash_destroy().  Elements already
+   passed to chash_retire() are not in the table and are left to
+   it. */
+void chash_destroy(struct chash *h, hash_action_func *destructor)
+{
+  struct chash_table *t = h->table;
+  size_t i;
+
+  if (destructor != NULL)
+    for (i = 0; i < t->bucket_cnt; i++)
+      while (!list_empty(&t->buckets[i]))
+      {
+        struct list_elem *elem = list_pop_front(&t->buckets[i]);
+        destructor(list_elem_to_hash_elem(elem), h->aux);
+      }
+  free(t);
+  pthread_mutex_destroy(&h->resize_lock);
+  for (i = 0; i < CHASH_STRIPES; i++)
+    pthread_mutex_destroy(&h->stripes[i].lock);
+}
+
+/* Links E in at the front of BUCKET.  A reader walking BUCKET at
+   the same time sees the chain either with E or without it. */
+static void
+link_front(struct list *bucket, struct list_elem *e)
+{
+  struct list_elem *first = bucket->head.next;
+
+  e->prev = &bucket->head;
+  STORE(&e->next, first);
+  first->prev = e;
+  STORE_REL(&bucket->head.next, e);
+}
+
+/* Unlinks E from its chain.  E's own link is left alone, so that
+   a reader standing on E can still walk on to the rest of the
+   chain. */
+static void
+unlink_elem(struct list_elem *e)
+{
+  STORE(&e->prev->next, e->next);
+  e->next->prev = e->prev;
+}
+
+/* Searches the chain of BUCKET in H for an element equal to E,
+   without locking.  Walks until it reaches any chain's tail,
+   which is where a reader ends up if the element it stands on is
+   moved to another chain. */
+static struct hash_elem *
+search(struct chash *h, struct list *bucket, struct hash_elem *e)
+{
+  struct list_elem *i, *next;
+
+  for (i = LOAD_ACQ(&bucket->head.next); (next = LOAD_ACQ(&i->next)) != NULL;
+       i = next)
+  {
+    struct hash_elem *hi = list_elem_to_hash_elem(i);
+    if (hi == e || (!h->less(hi, e, h->aux) && !h->less(e, hi, h->aux)))
+      return hi;
+  }
+  return NULL;
+}
+
+/* Returns the bucket in H for an element with hash HASH: in the
+   array being grown into, if its stripe has been moved there.
+   Readers and writers alike; a writer holds the stripe's lock.
+   Either must be in a read section, since the array it loads
+   from H may be retired at any time. */
+static struct list *
+find_bucket(struct chash *h, unsigned hash)
+{
+  struct chash_table *t = LOAD_ACQ(&h->table);
+  struct chash_table *next = LOAD_ACQ(&t->next);
+
+  if (next != NULL && LOAD_ACQ(&t->moved[hash & (CHASH_STRIPES - 1)]))
+    t = next;
+  return &t->buckets[hash & (t->bucket_cnt - 1)];
+}
+
+/* Returns H's bucket array if stripe S, whose lock the caller
+   holds, averages more than MAX_ELEMS_PER_BUCKET elements a
+   bucket in it and it is not already being grown, otherwise a
+   null pointer. */
+static struct chash_table *
+needs_growth(struct chash *h, struct chash_stripe *s)
+{
+  struct chash_table *t = LOAD_ACQ(&h->table);
+
+  if (LOAD(&t->next) == NULL
+      && s->elem_cnt > MAX_ELEMS_PER_BUCKET * (t->bucket_cnt / CHASH_STRIPES))
+    return t;
+  return NULL;
+}
+
+/* Doubles the number of buckets in H, if its bucket array is
+   still OLD and another thread is not already doing it.  One
+   stripe at a time, the stripe's lock is taken and its elements
+   are moved to the new array, with the stripe's sequence number
+   odd, so that a reader that walked one of its chains meanwhile
+   looks again.  The old array is retired,
+   since readers may still be walking it.  Growing fails quietly
+   if memory is short, and is tried again on a later insertion. */
+static void
+grow(struct chash *h, struct chash_table *old)
+{
+  struct chash_table *new;
+  size_t s, i;
+
+  if (pthread_mutex_trylock(&h->resize_lock) != 0)
+    return;
+  if (h->table != old)
+  {
+    /* Already grown by the time we got the lock. */
+    pthread_mutex_unlock(&h->resize_lock);
+    return;
+  }
+  new = alloc_table(old->bucket_cnt * 2);
+  if (new == NULL)
+  {
+    pthread_mutex_unlock(&h->resize_lock);
+    return;
+  }
+  STORE_REL(&old->next, new);
+
+  for (s = 0; s < CHASH_STRIPES; s++)
+  {
+    struct chash_stripe *st = &h->stripes[s];
+
+    pthread_mutex_lock(&st->lock);
+    STORE(&st->seq, st->seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = s; i < old->bucket_cnt; i += CHASH_STRIPES)
+      while (!list_empty(&old->buckets[i]))
+      {
+        struct list_elem *elem = list_front(&old->buckets[i]);
+        unsigned hash = h->hash(list_elem_to_hash_elem(elem), h->aux);
+
+        unlink_elem(elem);
+        link_front(&new->buckets[hash & (new->bucket_cnt - 1)], elem);
+      }
+    STORE(&old->moved[s], true);
+    STORE_REL(&st->seq, st->seq + 1);
+    pthread_mutex_unlock(&st->lock);
+  }
+
+  STORE_REL(&h->table, new);
+  retire(NULL, NULL, NULL, old);
+  pthread_mutex_unlock(&h->resize_lock);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct hash_elem *
+chash_insert(struct chash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash(new, h->aux);
+  struct chash_stripe *s = stripe_of(h, hash);
+  struct list *bucket;
+  struct hash_elem *old;
+  struct chash_table *full;
+
+  /* The bucket array may be retired by a grow() that finishes
+     while we wait for the lock. */
+  chash_read_lock();
+  pthread_mutex_lock(&s->lock);
+  bucket = find_bucket(h, hash);
+  old = search(h, bucket, new);
+  if (old == NULL)
+  {
+    link_front(bucket, &new->list_elem);
+    s->elem_cnt++;
+  }
+  full = needs_growth(h, s);
+  pthread_mutex_unlock(&s->lock);
+  chash_read_unlock();
+
+  if (full != NULL)
+    grow(h, full);
+  return old;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned.  NEW is linked in
+   before the old element is unlinked, so a concurrent reader
+   always finds one or the other.  The old element must be
+   retired like a deleted one. */
+struct hash_elem *
+chash_replace(struct chash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash(new, h->aux);
+  struct chash_stripe *s = stripe_of(h, hash);
+  struct list *bucket;
+  struct hash_elem *old;
+  struct chash_table *full;
+
+  chash_read_lock();
+  pthread_mutex_lock(&s->lock);
+  bucket = find_bucket(h, hash);
+  old = search(h, bucket, new);
+  link_front(bucket, &new->list_elem);
+  if (old != NULL)
+    unlink_elem(&old->list_elem);
+  else
+    s->elem_cnt++;
+  full = needs_growth(h, s);
+  pthread_mutex_unlock(&s->lock);
+  chash_read_unlock();
+
+  if (full != NULL)
+    grow(h, full);
+  return old;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table.  Takes
+   no lock.  The element returned may be deleted by another
+   thread at any time, so a caller that uses it must have called
+   chash_read_lock() first, and may use it only until it calls
+   chash_read_unlock(). */
+struct hash_elem *
+chash_find(struct chash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash(e, h->aux);
+  struct chash_stripe *s = stripe_of(h, hash);
+  struct hash_elem *found;
+  unsigned seq;
+
+  chash_read_lock();
+  do
+  {
+    while ((seq = LOAD_ACQ(&s->seq)) & 1)
+      sched_yield();
+    found = search(h, find_bucket(h, hash), e);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (LOAD(&s->seq) != seq);
+  chash_read_unlock();
+  return found;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   Readers may still be looking at the element returned, so it
+   must not be freed or reused until chash_retire() says so. */
+struct hash_elem *
+chash_delete(struct chash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash(e, h->aux);
+  struct chash_stripe *s = stripe_of(h, hash);
+  struct hash_elem *found;
+
+  chash_read_lock();
+  pthread_mutex_lock(&s->lock);
+  found = search(h, find_bucket(h, hash), e);
+  if (found != NULL)
+  {
+    unlink_elem(&found->list_elem);
+    s->elem_cnt--;
+  }
+  pthread_mutex_unlock(&s->lock);
+  chash_read_unlock();
+  return found;
+}
+
+/* Work for one chash_apply() thread. */
+struct apply_job
+{
+  struct chash *h;          /* The hash table. */
+  hash_action_func *action; /* Function to call. */
+  size_t first;             /* First stripe. */
+  size_t step;              /* Distance between stripes. */
+  pthread_t thread;         /* Thread running the job. */
+};
+
+/* Calls JOB's action for each element in its stripes, holding
+   each stripe's lock while visiting it. */
+static void *
+apply_stripes(void *job_)
+{
+  struct apply_job *job = job_;
+  struct chash *h = job->h;
+  struct chash_table *t = h->table;
+  size_t s, i;
+
+  for (s = job->first; s < CHASH_STRIPES; s += job->step)
+  {
+    pthread_mutex_lock(&h->stripes[s].lock);
+    for (i = s; i < t->bucket_cnt; i += CHASH_STRIPES)
+    {
+      struct list *bucket = &t->buckets[i];
+      struct list_elem *elem, *next;
+
+      for (elem = list_begin(bucket); elem != list_end(bucket); elem = next)
+      {
+        next = list_next(elem);
+        job->action(list_elem_to_hash_elem(elem), h->aux);
+      }
+    }
+    pthread_mutex_unlock(&h->stripes[s].lock);
+  }
+  return NULL;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order, dividing the stripes among THREADS threads (the caller
+   and THREADS - 1 new ones).  Each stripe is locked while its
+   elements are visited, so readers and writers to other stripes
+   carry on meanwhile; ACTION must not modify H.  The table does
+   not grow until all threads are done. */
+void chash_apply(struct chash *h, hash_action_func *action, int threads)
+{
+  struct apply_job one, *jobs;
+  int i;
+
+  ASSERT(action != NULL);
+
+  if (threads > CHASH_STRIPES)
+    threads = CHASH_STRIPES;
+  if (threads < 1)
+    threads = 1;
+  jobs = threads > 1 ? malloc(sizeof *jobs * threads) : NULL;
+  if (jobs == NULL)
+  {
+    /* One thread, or no memory for more: do it all here. */
+    jobs = &one;
+    threads = 1;
+  }
+
+  pthread_mutex_lock(&h->resize_lock);
+  for (i = 0; i < threads; i++)
+  {
+    jobs[i].h = h;
+    jobs[i].action = action;
+    jobs[i].first = i;
+    jobs[i].step = threads;
+  }
+  /* A job whose thread cannot be started is run here instead. */
+  for (i = 1; i < threads; i++)
+    if (pthread_create(&jobs[i].thread, NULL, apply_stripes, &jobs[i]) != 0)
+      jobs[i].h = NULL;
+  apply_stripes(&jobs[0]);
+  for (i = 1; i < threads; i++)
+    if (jobs[i].h != NULL)
+      pthread_join(jobs[i].thread, NULL);
+    else
+    {
+      jobs[i].h = h;
+      apply_stripes(&jobs[i]);
+    }
+  pthread_mutex_unlock(&h->resize_lock);
+  if (jobs != &one)
+    free(jobs);
+}
+
+/* Returns the number of elements in H.  While other threads are
+   inserting or deleting, the count is only approximate. */
+size_t
+chash_size(struct chash *h)
+{
+  size_t cnt = 0, i;
+
+  for (i = 0; i < CHASH_STRIPES; i++)
+    cnt += LOAD(&h->stripes[i].elem_cnt);
+  return cnt;
+}
+
+/* Epoch-based reclamation.
+
+   A global epoch counter only moves forward, and only when every
+   thread in a read section has seen its current value.  Each
+   thread announces the epoch it saw when it entered its read
+   section.  Something unlinked and then retired during epoch E
+   can be seen only by readers that entered during epoch E or
+   earlier, so once the epoch reaches E + 2, all of those have
+   left and it can be reclaimed.
+
+   Retired things wait in a list kept by the thread that retired
+   them, which tries to advance the epoch and reclaims what it can
+   every RETIRE_BATCH retirements. */
+
+#define RETIRE_BATCH 64
+
+/* Something waiting to be reclaimed. */
+struct retired
+{
+  unsigned long epoch;        /* Global epoch when retired. */
+  hash_action_func *action;   /* Called as ACTION (ELEM, AUX)... */
+  struct hash_elem *elem;
+  void *aux;
+  struct chash_table *table;  /* ...or, if ACTION is null, freed. */
+};
+
+/* A thread that has used chash_read_lock() or chash_retire(). */
+struct reader
+{
+  unsigned long state;        /* Epoch << 1 | 1 while reading, else 0. */
+  int depth;                  /* Nesting of chash_read_lock(). */
+  bool in_use;                /* Owned by a live thread. */
+  struct retired *limbo;      /* Retired, not yet reclaimed. */
+  size_t limbo_cnt;           /* Number of entries in `limbo'. */
+  size_t limbo_cap;           /* Room in `limbo'. */
+  struct reader *next;        /* Next in `readers'. */
+};
+
+static unsigned long global_epoch = 1;
+static struct reader *readers;            /* All readers, ever. */
+static __thread struct reader *self;      /* This thread's reader. */
+static pthread_key_t reader_key;          /* Releases it on exit. */
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+
+static void release_reader(void *);
+
+static void
+make_reader_key(void)
+{
+  pthread_key_create(&reader_key, release_reader);
+}
+
+/* Returns this thread's reader, taking over one left by a thread
+   that has exited or else adding a new one. */
+static struct reader *
+get_self(void)
+{
+  struct reader *r;
+
+  if (self != NULL)
+    return self;
+  pthread_once(&reader_once, make_reader_key);
+  for (r = LOAD_ACQ(&readers); r != NULL; r = r->next)
+  {
+    bool expected = false;
+    if (!LOAD(&r->in_use)
+        && __atomic_compare_exchange_n(&r->in_use, &expected, true, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      break;
+  }
+  if (r == NULL)
+  {
+    r = calloc(1, sizeof *r);
+    if (r == NULL)
+      abort();
+    r->in_use = true;
+    r->next = LOAD(&readers);
+    while (!__atomic_compare_exchange_n(&readers, &r->next, r, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      continue;
+  }
+  pthread_setspecific(reader_key, r);
+  self = r;
+  return r;
+}
+
+/* Starts a read section: until the matching chash_read_unlock(),
+   nothing this thread can see in any struct chash is reclaimed.
+   Read sections nest, and never wait for other threads. */
+void chash_read_lock(void)
+{
+  struct reader *r = get_self();
+
+  if (r->depth++ == 0)
+  {
+    STORE(&r->state, LOAD(&global_epoch) << 1 | 1);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  }
+}
+
+/* Ends a read section started by chash_read_lock(). */
+void chash_read_unlock(void)
+{
+  struct reader *r = self;
+
+  ASSERT(r != NULL && r->depth > 0);
+  if (--r->depth == 0)
+    STORE_REL(&r->state, 0);
+}
+
+/* Advances the global epoch if every thread in a read section has
+   seen its current value.  Returns true if the epoch moved, by
+   this call or another. */
+static bool
+try_advance(void)
+{
+  unsigned long epoch = LOAD_ACQ(&global_epoch);
+  struct reader *r;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (r = LOAD_ACQ(&readers); r != NULL; r = r->next)
+  {
+    unsigned long state = LOAD_ACQ(&r->state);
+    if ((state & 1) && (state >> 1) != epoch)
+      return false;
+  }
+  __atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  return true;
+}
+
+/* Reclaims X. */
+static void
+run_retired(struct retired *x)
+{
+  if (x->action != NULL)
+    x->action(x->elem, x->aux);
+  else
+    free(x->table);
+}
+
+/* Reclaims whatever R has retired that no reader can still see. */
+static void
+reclaim(struct reader *r)
+{
+  unsigned long epoch = LOAD_ACQ(&global_epoch);
+  size_t i, j = 0;
+
+  for (i = 0; i < r->limbo_cnt; i++)
+    if (r->limbo[i].epoch + 2 <= epoch)
+      run_retired(&r->limbo[i]);
+    else
+      r->limbo[j++] = r->limbo[i];
+  r->limbo_cnt = j;
+}
+
+/* Queues ACTION (ELEM, AUX), or freeing TABLE if ACTION is null,
+   to happen once no reader can see ELEM or TABLE any more. */
+static void
+retire(hash_action_func *action, struct hash_elem *elem, void *aux,
+       struct chash_table *table)
+{
+  struct reader *r = get_self();
+  struct retired x = {LOAD_ACQ(&global_epoch), action, elem, aux, table};
+
+  if (r->limbo_cnt == r->limbo_cap)
+  {
+    size_t cap = r->limbo_cap ? r->limbo_cap * 2 : RETIRE_BATCH;
+    struct retired *limbo = realloc(r->limbo, sizeof *limbo * cap);
+
+    if (limbo == NULL)
+    {
+      /* Out of memory: wait for the readers instead, if this
+         thread is not one of them.  If it is, X is leaked. */
+      if (r->depth == 0)
+      {
+        chash_synchronize();
+        run_retired(&x);
+      }
+      return;
+    }
+    r->limbo = limbo;
+    r->limbo_cap = cap;
+  }
+  r->limbo[r->limbo_cnt++] = x;
+  if (r->limbo_cnt % RETIRE_BATCH == 0)
+  {
+    try_advance();
+    reclaim(r);
+  }
+}
+
+/* Calls ACTION (E, AUX) for element E, deleted from or replaced
+   in hash table H, once no reader can still be looking at it.
+   ACTION may then free or reuse E.  It is called later, by this
+   thread, from a call to chash_retire() or chash_synchronize(),
+   or when this thread exits. */
+void chash_retire(struct chash *h, struct hash_elem *e,
+                  hash_action_func *action)
+{
+  ASSERT(action != NULL);
+  retire(action, e, h->aux, NULL);
+}
+
+/* Waits until every read section in progress has ended, then
+   reclaims everything this thread has retired so far.  Must not
+   be called from within a read section. */
+void chash_synchronize(void)
+{
+  struct reader *r = get_self();
+  unsigned long target = LOAD_ACQ(&global_epoch) + 2;
+
+  ASSERT(r->depth == 0);
+  while (LOAD_ACQ(&global_epoch) < target)
+    if (!try_advance())
+      sched_yield();
+  reclaim(r);
+}
+
+/* Called when a thread with reader R exits: reclaims what R still
+   holds, waiting for readers if need be, and frees R for reuse by
+   a later thread. */
+static void
+release_reader(void *r_)
+{
+  struct reader *r = r_;
+
+  while (r->limbo_cnt > 0)
+  {
+    if (!try_advance())
+      sched_yield();
+    reclaim(r);
+  }
+  free(r->limbo);
+  r->limbo = NULL;
+  r->limbo_cap = 0;
+  r->depth = 0;
+  STORE(&r->state, 0);
+  STORE_REL(&r->in_use, false);
+}
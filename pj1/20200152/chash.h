@@ -0,0 +1,86 @@
+#ifndef __MYLIB_CHASH_H
+#define __MYLIB_CHASH_H
+
+/* Concurrent hash table.
+
+   A chained hash table of the same elements as struct hash (see
+   hash.h) that many threads can use at once without a lock
+   around it.
+
+   Writers (insert, replace, delete) lock one of CHASH_STRIPES
+   stripes, chosen by the element's hash, so writers to different
+   stripes do not wait for each other.  Readers (find) take no
+   lock at all: writers link elements into a chain so that a
+   reader walking it concurrently always sees a well-formed chain,
+   and an element removed from a chain stays readable until every
+   reader that might still be looking at it has finished.
+
+   That last part is epoch-based reclamation.  A thread reading
+   the table, or using an element it found there, does so between
+   chash_read_lock() and chash_read_unlock(); these only note that
+   the thread is reading, in memory of its own, and never wait.
+   An element that chash_delete() or chash_replace() returns may
+   still be in use by such readers, so instead of freeing or
+   reusing it right away, pass it to chash_retire(), which calls a
+   function on it once they are all done.
+
+   When the table grows, which it does when it averages more than
+   four elements a bucket, the new bucket array is filled one
+   stripe at a time, each under its stripe's lock, so writers wait
+   only for their own stripe.  A reader that may have walked a
+   chain while it was being moved notices and looks again.  The
+   table never shrinks. */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* Number of writer locks, a power of 2.  Also the smallest number
+   of buckets. */
+#define CHASH_STRIPES 64
+
+/* One writer lock and the part of the table it covers: the
+   buckets whose index is the stripe's number modulo
+   CHASH_STRIPES. */
+struct chash_stripe
+{
+  pthread_mutex_t lock; /* Held by writers to these buckets. */
+  unsigned seq;         /* Odd while the buckets are being moved. */
+  size_t elem_cnt;      /* Number of elements in these buckets. */
+} __attribute__((aligned(64)));
+
+/* Concurrent hash table. */
+struct chash
+{
+  struct chash_table *table;        /* Current bucket array. */
+  pthread_mutex_t resize_lock;      /* Held while growing or applying. */
+  hash_hash_func *hash;             /* Hash function. */
+  hash_less_func *less;             /* Comparison function. */
+  void *aux;                        /* Auxiliary data for `hash' and `less'. */
+  struct chash_stripe stripes[CHASH_STRIPES];
+};
+
+/* Basic life cycle. */
+bool chash_init(struct chash *, hash_hash_func *, hash_less_func *, void *aux);
+void chash_destroy(struct chash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *chash_insert(struct chash *, struct hash_elem *);
+struct hash_elem *chash_replace(struct chash *, struct hash_elem *);
+struct hash_elem *chash_find(struct chash *, struct hash_elem *);
+struct hash_elem *chash_delete(struct chash *, struct hash_elem *);
+
+/* Reclamation. */
+void chash_read_lock(void);
+void chash_read_unlock(void);
+void chash_retire(struct chash *, struct hash_elem *, hash_action_func *);
+void chash_synchronize(void);
+
+/* Iteration. */
+void chash_apply(struct chash *, hash_action_func *, int threads);
+
+/* Information. */
+size_t chash_size(struct chash *);
+
+#endif /* chash.h */
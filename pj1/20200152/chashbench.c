@@ -0,0 +1,374 @@
+// chashbench.c - 여러 스레드가 함께 쓰는 해시 테이블 성능 비교
+//
+// 사용법: chashbench [-k 키 수] [-d 초]
+//
+// 전역 뮤텍스로 감싼 struct hash와 struct chash(스트라이프 락 + 락 없는 읽기)를
+// 1, 2, 4, 8 스레드에서 두 가지 작업으로 비교하여 초당 연산 수를 출력한다.
+//   read-mostly  찾기 95%, 삽입/삭제 5%
+//   write-heavy  찾기 50%, 삽입/삭제 50%
+// 키 공간의 절반을 미리 넣어 두고, 삽입/삭제는 각 스레드가 자기 몫의 키만 다룬다.
+// chash에서 지운 원소는 chash_retire로 넘겨, 읽는 스레드가 없을 때 다시 쓸 수 있게 한다.
+// 이어서 chash_apply를 1, 2, 4 스레드로 돌린 시간을 출력한다.
+// 측정 전에, 다른 스레드들이 삽입/삭제로 테이블을 키우는 동안
+// 항상 들어 있는 키를 찾지 못하는 일이 없는지 검증한다.
+
+#include "hash.h"
+#include "chash.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// 원소 상태: 테이블에 있음, 없음, 지웠지만 아직 읽는 스레드가 볼 수 있음
+enum { IN, OUT, RETIRED };
+
+struct item
+{
+    struct hash_elem elem;
+    int key;
+    int state;
+};
+
+static unsigned item_hash(const struct hash_elem *e, void *aux)
+{
+    return hash_int(hash_entry(e, struct item, elem)->key);
+}
+
+static bool item_less(const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+    return hash_entry(a, struct item, elem)->key < hash_entry(b, struct item, elem)->key;
+}
+
+// chash_retire가 부르는 함수: 이제 다시 넣어도 됨
+static void item_reclaimed(struct hash_elem *e, void *aux)
+{
+    hash_entry(e, struct item, elem)->state = OUT;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long xorshift(unsigned long *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static struct item *items;      // 키 i의 원소는 items[i]
+static int nkeys;
+static int nthreads;
+static int find_pct;            // 찾기 비율(%)
+static int use_chash;           // 0이면 뮤텍스 + struct hash
+static int stop;                // 스레드들을 멈추라는 신호
+static struct hash mtable;
+static pthread_mutex_t mlock = PTHREAD_MUTEX_INITIALIZER;
+static struct chash ctable;
+
+static bool stopped(void)
+{
+    return __atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+struct worker
+{
+    pthread_t tid;
+    int id;
+    long ops;
+    long misses;                // 검증: 항상 있어야 할 키를 못 찾은 횟수
+};
+
+static struct hash_elem *t_find(struct hash_elem *e)
+{
+    struct hash_elem *found;
+
+    if (use_chash)
+        return chash_find(&ctable, e);
+    pthread_mutex_lock(&mlock);
+    found = hash_find(&mtable, e);
+    pthread_mutex_unlock(&mlock);
+    return found;
+}
+
+// 자기 몫의 키 하나를 넣거나 뺌
+static void t_toggle(struct item *it)
+{
+    if (it->state == OUT)
+    {
+        it->state = IN;
+        if (use_chash)
+            chash_insert(&ctable, &it->elem);
+        else
+        {
+            pthread_mutex_lock(&mlock);
+            hash_insert(&mtable, &it->elem);
+            pthread_mutex_unlock(&mlock);
+        }
+    }
+    else if (it->state == IN)
+    {
+        if (use_chash)
+        {
+            it->state = RETIRED;
+            chash_delete(&ctable, &it->elem);
+            chash_retire(&ctable, &it->elem, item_reclaimed);
+        }
+        else
+        {
+            pthread_mutex_lock(&mlock);
+            hash_delete(&mtable, &it->elem);
+            pthread_mutex_unlock(&mlock);
+            it->state = OUT;
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    struct worker *w = arg;
+    unsigned long seed = 0x9e3779b97f4a7c15UL * (w->id + 1);
+    struct item probe;
+
+    while (!stopped())
+    {
+        unsigned long r = xorshift(&seed);
+        int i;
+
+        for (i = 0; i < 64; i++, w->ops++)
+        {
+            r = xorshift(&seed);
+            if ((int)(r % 100) < find_pct)
+            {
+                probe.key = (r >> 8) % nkeys;
+                t_find(&probe.elem);
+            }
+            else
+            {
+                // 자기 몫의 키: key % nthreads == id
+                int k = ((r >> 8) % (nkeys / nthreads)) * nthreads + w->id;
+                t_toggle(&items[k]);
+            }
+        }
+    }
+    return NULL;
+}
+
+// 채워진 테이블에서 작업 하나를 THREADS개 스레드로 SECS초 동안 돌림
+static void run(const char *name, int pct, int chash, int threads, double secs)
+{
+    struct worker *w = calloc(threads, sizeof *w);
+    double t0;
+    long ops = 0;
+    int i;
+
+    find_pct = pct;
+    use_chash = chash;
+    nthreads = threads;
+    if (chash)
+        chash_init(&ctable, item_hash, item_less, NULL);
+    else
+        hash_init(&mtable, item_hash, item_less, NULL);
+    for (i = 0; i < nkeys; i++)
+    {
+        items[i].key = i;
+        items[i].state = OUT;
+        if (i % 2 == 0)
+            t_toggle(&items[i]);
+    }
+
+    stop = 0;
+    t0 = now();
+    for (i = 0; i < threads; i++)
+    {
+        w[i].id = i;
+        pthread_create(&w[i].tid, NULL, worker, &w[i]);
+    }
+    usleep(secs * 1e6);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(w[i].tid, NULL);
+        ops += w[i].ops;
+    }
+    printf("%-12s %-6s %d threads %12.0f ops/s\n", name, chash ? "chash" : "mutex",
+           threads, ops / (now() - t0));
+
+    // 끝난 스레드들이 retire한 원소는 스레드가 끝날 때 모두 회수됨
+    if (chash)
+        chash_destroy(&ctable, NULL);
+    else
+        hash_destroy(&mtable, NULL);
+    free(w);
+}
+
+// 검증: 짝수 키는 계속 들어 있고, 홀수 키는 쓰는 스레드들이 넣었다 뺐다 함
+static struct item *vitems;
+static int vkeys;
+
+static void *verify_reader(void *arg)
+{
+    struct worker *w = arg;
+    unsigned long seed = 12345 + w->id;
+    struct item probe;
+
+    while (!stopped())
+    {
+        struct hash_elem *e;
+
+        probe.key = (xorshift(&seed) % (vkeys / 2)) * 2;
+        chash_read_lock();
+        e = chash_find(&ctable, &probe.elem);
+        if (e == NULL || hash_entry(e, struct item, elem)->key != probe.key)
+            w->misses++;
+        chash_read_unlock();
+        w->ops++;
+    }
+    return NULL;
+}
+
+static void *verify_writer(void *arg)
+{
+    struct worker *w = arg;
+    int k;
+
+    // 홀수 키 중 자기 몫을 모두 넣어 테이블을 키우고, 이어서 넣었다 뺐다 반복
+    for (k = 2 * w->id + 1; k < vkeys; k += 2 * nthreads)
+    {
+        vitems[k].state = IN;
+        chash_insert(&ctable, &vitems[k].elem);
+    }
+    while (!stopped())
+    {
+        for (k = 2 * w->id + 1; k < vkeys && !stopped(); k += 2 * nthreads)
+        {
+            struct item *it = &vitems[k];
+
+            if (it->state == IN)
+            {
+                it->state = RETIRED;
+                if (chash_delete(&ctable, &it->elem) == NULL)
+                    w->misses++;
+                chash_retire(&ctable, &it->elem, item_reclaimed);
+            }
+            else if (it->state == OUT)
+            {
+                it->state = IN;
+                if (chash_insert(&ctable, &it->elem) != NULL)
+                    w->misses++;
+            }
+            w->ops++;
+        }
+    }
+    return NULL;
+}
+
+static void count_item(struct hash_elem *e, void *aux)
+{
+    __atomic_fetch_add((long *)aux, 1, __ATOMIC_RELAXED);
+}
+
+static void verify(void)
+{
+    struct worker w[4];
+    long misses = 0, counted = 0;
+    int i, expect;
+
+    vkeys = 1 << 18;
+    vitems = calloc(vkeys, sizeof *vitems);
+    chash_init(&ctable, item_hash, item_less, &counted);
+    for (i = 0; i < vkeys; i++)
+    {
+        vitems[i].key = i;
+        vitems[i].state = OUT;
+        if (i % 2 == 0)
+        {
+            vitems[i].state = IN;
+            chash_insert(&ctable, &vitems[i].elem);
+        }
+    }
+    nthreads = 2;
+    stop = 0;
+    for (i = 0; i < 4; i++)
+    {
+        w[i].id = i % 2;
+        w[i].ops = w[i].misses = 0;
+        pthread_create(&w[i].tid, NULL, i < 2 ? verify_reader : verify_writer, &w[i]);
+    }
+    usleep(500000);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(w[i].tid, NULL);
+        misses += w[i].misses;
+    }
+    for (expect = 0, i = 0; i < vkeys; i++)
+        expect += vitems[i].state == IN;
+    chash_apply(&ctable, count_item, 4);
+    if (misses != 0 || counted != expect || chash_size(&ctable) != (size_t)expect)
+    {
+        fprintf(stderr, "verify failed: %ld misses, %ld applied, %zu in table, %d expected\n",
+                misses, counted, chash_size(&ctable), expect);
+        exit(1);
+    }
+    chash_destroy(&ctable, NULL);
+    free(vitems);
+}
+
+int main(int argc, char **argv)
+{
+    double secs = 0.5, t0;
+    int c, t;
+    long counted;
+
+    nkeys = 1 << 20;
+    while ((c = getopt(argc, argv, "k:d:")) != -1)
+    {
+        if (c == 'k')
+            nkeys = atoi(optarg);
+        else if (c == 'd')
+            secs = atof(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-k keys] [-d secs]\n", argv[0]);
+            exit(1);
+        }
+    }
+    verify();
+
+    items = calloc(nkeys, sizeof *items);
+    for (t = 1; t <= 8; t *= 2)
+    {
+        run("read-mostly", 95, 0, t, secs);
+        run("read-mostly", 95, 1, t, secs);
+    }
+    for (t = 1; t <= 8; t *= 2)
+    {
+        run("write-heavy", 50, 0, t, secs);
+        run("write-heavy", 50, 1, t, secs);
+    }
+
+    // 모든 키를 넣은 테이블에서 chash_apply
+    chash_init(&ctable, item_hash, item_less, &counted);
+    for (c = 0; c < nkeys; c++)
+    {
+        items[c].key = c;
+        chash_insert(&ctable, &items[c].elem);
+    }
+    for (t = 1; t <= 4; t *= 2)
+    {
+        counted = 0;
+        t0 = now();
+        chash_apply(&ctable, count_item, t);
+        printf("chash_apply %d threads %8.2f ms (%ld elements)\n", t,
+               (now() - t0) * 1e3, counted);
+    }
+    chash_destroy(&ctable, NULL);
+    return 0;
+}
@@ -5,6 +5,9 @@ See hash.h for basic information. */
 #include "hash.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
 
 #define ASSERT(CONDITION) assert(CONDITION)
 
@@ -17,6 +20,28 @@ static struct hash_elem *find_elem(struct hash *, struct list *,
 static void insert_elem(struct hash *, struct list *, struct hash_elem *);
 static void remove_elem(struct hash *, struct hash_elem *);
 static void rehash(struct hash *);
+static void move_buckets(struct hash *, size_t cnt);
+static struct list *next_bucket(struct hash *, struct list *);
+
+/* Returns true if bucket IDX of H's bucket array is set up.
+   While old buckets are being moved, a new bucket is set up when
+   the first old bucket whose elements belong in it is moved. */
+static inline bool
+bucket_ready(const struct hash *h, size_t idx)
+{
+  return h->old_buckets == NULL
+         || (idx & (h->old_bucket_cnt - 1)) < h->moved_cnt;
+}
+
+/* Returns the hash value that picks E's bucket in H: the value of
+   H's hash function, mixed with H's seed if it has one. */
+static inline unsigned
+bucket_hash(const struct hash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash(e, h->aux);
+
+  return h->seed != 0 ? hash_u64(hash, h->seed) : hash;
+}
 
 /* Initializes hash table H to compute hash values using HASH and
    compare hash elements using LESS, given auxiliary data AUX. */
@@ -26,6 +51,10 @@ bool hash_init(struct hash *h,
   h->elem_cnt = 0;
   h->bucket_cnt = 4;
   h->buckets = malloc(sizeof *h->buckets * h->bucket_cnt);
+  h->old_bucket_cnt = 0;
+  h->old_buckets = NULL;
+  h->moved_cnt = 0;
+  h->seed = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -39,6 +68,21 @@ bool hash_init(struct hash *h,
     return false;
 }
 
+/* Initializes hash table H like hash_init(), but with a random
+   seed mixed into every hash value before it picks a bucket.  An
+   adversary who can choose the keys then cannot choose keys that
+   all land in one bucket, unless they collide in HASH itself;
+   hashing keys with hash_bytes64() and a seed of their own, say
+   one from hash_random_seed() passed in AUX, rules that out too. */
+bool hash_init_seeded(struct hash *h,
+                      hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  if (!hash_init(h, hash, less, aux))
+    return false;
+  h->seed = hash_random_seed();
+  return true;
+}
+
 /* Removes all the elements from H.
 
    If DESTRUCTOR is non-null, then it is called for each element
@@ -50,13 +94,12 @@ bool hash_init(struct hash *h,
    whether done in DESTRUCTOR or elsewhere. */
 void hash_clear(struct hash *h, hash_action_func *destructor)
 {
+  struct list *bucket;
   size_t i;
 
-  for (i = 0; i < h->bucket_cnt; i++)
-  {
-    struct list *bucket = &h->buckets[i];
-
-    if (destructor != NULL)
+  if (destructor != NULL)
+    for (bucket = next_bucket(h, NULL); bucket != NULL;
+         bucket = next_bucket(h, bucket))
       while (!list_empty(bucket))
       {
         struct list_elem *list_elem = list_pop_front(bucket);
@@ -64,8 +107,10 @@ void hash_clear(struct hash *h, hash_action_func *destructor)
         destructor(hash_elem, h->aux);
       }
 
-    list_init(bucket);
-  }
+  free(h->old_buckets);
+  h->old_buckets = NULL;
+  for (i = 0; i < h->bucket_cnt; i++)
+    list_init(&h->buckets[i]);
 
   h->elem_cnt = 0;
 }
@@ -85,6 +130,7 @@ void hash_destroy(struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear(h, destructor);
   free(h->buckets);
+  free(h->old_buckets);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -157,13 +203,13 @@ hash_delete(struct hash *h, struct hash_elem *e)
    undefined behavior, whether done from ACTION or elsewhere. */
 void hash_apply(struct hash *h, hash_action_func *action)
 {
-  size_t i;
+  struct list *bucket;
 
   ASSERT(action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++)
+  for (bucket = next_bucket(h, NULL); bucket != NULL;
+       bucket = next_bucket(h, bucket))
   {
-    struct list *bucket = &h->buckets[i];
     struct list_elem *elem, *next;
 
     for (elem = list_begin(bucket); elem != list_end(bucket); elem = next)
@@ -197,7 +243,7 @@ void hash_first(struct hash_iterator *i, struct hash *h)
   ASSERT(h != NULL);
 
   i->hash = h;
-  i->bucket = i->hash->buckets;
+  i->bucket = next_bucket(h, NULL);
   i->elem = list_elem_to_hash_elem(list_head(i->bucket));
 }
 
@@ -217,7 +263,7 @@ hash_next(struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem(list_next(&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem(list_end(i->bucket)))
   {
-    if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+    if ((i->bucket = next_bucket(i->hash, i->bucket)) == NULL)
     {
       i->elem = NULL;
       break;
@@ -294,12 +340,209 @@ hash_int(int i)
   return hash_bytes(&i, sizeof i);
 }
 
-/* Returns the bucket in H that E belongs in. */
+/* The 64-bit functions below follow wyhash (Wang Yi, public
+   domain): the input is read 8 or 16 bytes at a time and each
+   pair of words is combined with one 64 x 64 -> 128-bit multiply,
+   whose high and low halves are folded together.  These are its
+   default secret constants. */
+#define WY_P0 0x2d358dccaa6c78a5ull
+#define WY_P1 0x8bb84b93962eacc9ull
+#define WY_P2 0x4b33a62ed433d4a3ull
+#define WY_P3 0x4d5a2da51de1aa47ull
+
+/* Replaces A and B by the low and high halves of their 128-bit
+   product. */
+static inline void
+wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 r = (unsigned __int128)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, la = (uint32_t)*a, hb = *b >> 32, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), lo;
+  uint64_t c = t < rl;
+
+  lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/* Returns the 128-bit product of A and B with its two halves
+   xored together. */
+static inline uint64_t
+wymix(uint64_t a, uint64_t b)
+{
+  wymum(&a, &b);
+  return a ^ b;
+}
+
+/* Returns the 8 bytes at P as a word, in the machine's byte
+   order.  memcpy() compiles to a single unaligned load. */
+static inline uint64_t
+read64(const unsigned char *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the 4 bytes at P as a word. */
+static inline uint64_t
+read32(const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/* Returns a 64-bit hash of the SIZE bytes in BUF, given SEED.
+   Inputs of up to 16 bytes are read as two overlapping pairs of
+   words, longer ones 16 bytes at a time, or 48 at a time in three
+   independent lanes while at least 48 remain. */
+uint64_t
+hash_bytes64(const void *buf_, size_t size, uint64_t seed)
+{
+  const unsigned char *p = buf_;
+  uint64_t a, b;
+
+  ASSERT(buf_ != NULL || size == 0);
+
+  seed ^= wymix(seed ^ WY_P0, WY_P1);
+  if (size <= 16)
+  {
+    if (size >= 4)
+    {
+      size_t mid = (size >> 3) << 2;
+      a = read32(p) << 32 | read32(p + mid);
+      b = read32(p + size - 4) << 32 | read32(p + size - 4 - mid);
+    }
+    else if (size > 0)
+    {
+      a = (uint64_t)p[0] << 16 | (uint64_t)p[size >> 1] << 8 | p[size - 1];
+      b = 0;
+    }
+    else
+      a = b = 0;
+  }
+  else
+  {
+    size_t i = size;
+
+    if (i >= 48)
+    {
+      uint64_t see1 = seed, see2 = seed;
+      do
+      {
+        seed = wymix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+        see1 = wymix(read64(p + 16) ^ WY_P2, read64(p + 24) ^ see1);
+        see2 = wymix(read64(p + 32) ^ WY_P3, read64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i >= 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16)
+    {
+      seed = wymix(read64(p) ^ WY_P1, read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+  a ^= WY_P1;
+  b ^= seed;
+  wymum(&a, &b);
+  return wymix(a ^ WY_P0 ^ size, b ^ WY_P1);
+}
+
+/* Returns a 64-bit hash of string S, given SEED. */
+uint64_t
+hash_string64(const char *s, uint64_t seed)
+{
+  ASSERT(s != NULL);
+
+  return hash_bytes64(s, strlen(s), seed);
+}
+
+/* Returns a 64-bit hash of X, given SEED.  Unlike hash_bytes64()
+   on X's 8 bytes, this is only two multiplies, and suits integer
+   keys and mixing an existing hash value with a seed.  One
+   multiply leaves the low bits visibly uneven for runs of
+   consecutive keys; the second evens them out.  The first
+   multiplier is made odd so that no seed makes it zero. */
+uint64_t
+hash_u64(uint64_t x, uint64_t seed)
+{
+  return wymix(wymix(x ^ WY_P0, (seed ^ WY_P1) | 1), WY_P2);
+}
+
+/* Returns a random nonzero seed for the functions above, from
+   the kernel's random number generator if it is available, or
+   else from the clock and the addresses of the stack and this
+   function, which vary from run to run under ASLR. */
+uint64_t
+hash_random_seed(void)
+{
+  static uint64_t counter;
+  uint64_t seed;
+
+  if (getrandom(&seed, sizeof seed, GRND_NONBLOCK) != sizeof seed)
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    seed = hash_u64((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+                    (uintptr_t)&ts ^ (uintptr_t)hash_random_seed);
+    seed = hash_u64(seed, ++counter);
+  }
+  return seed != 0 ? seed : 1;
+}
+
+/* Returns the bucket in H that E belongs in: its old bucket, if
+   that has not been moved yet, otherwise its new one. */
 static struct list *
 find_bucket(struct hash *h, struct hash_elem *e)
 {
-  size_t bucket_idx = h->hash(e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = bucket_hash(h, e);
+
+  if (h->old_buckets != NULL)
+  {
+    size_t old_idx = hash & (h->old_bucket_cnt - 1);
+    if (old_idx >= h->moved_cnt)
+      return &h->old_buckets[old_idx];
+  }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket of H that follows B in iteration order, or
+   the first one if B is a null pointer, or a null pointer after
+   the last one.  The order is the new buckets that are set up,
+   then the old buckets that have not been moved. */
+static struct list *
+next_bucket(struct hash *h, struct list *b)
+{
+  struct list *new_end = h->buckets + h->bucket_cnt;
+
+  if (b == NULL || (b >= h->buckets && b < new_end))
+  {
+    for (b = b == NULL ? h->buckets : b + 1; b < new_end; b++)
+      if (bucket_ready(h, b - h->buckets))
+        return b;
+    if (h->old_buckets == NULL)
+      return NULL;
+    b = h->old_buckets + h->moved_cnt;
+  }
+  else
+    b++;
+  return b < h->old_buckets + h->old_bucket_cnt ? b : NULL;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -337,22 +580,30 @@ is_power_of_2(size_t x)
 #define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
 #define MAX_ELEMS_PER_BUCKET 4  /* Elems/bucket > 4: increase # of buckets. */
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Old buckets moved by each insertion or deletion while the table
+   is being resized.  Growth doubles the bucket count once the
+   element count reaches twice it, so moving even one bucket per
+   operation finishes long before the next resize is due. */
+#define MOVE_BUCKETS 4
+
+/* Moves a few more old buckets of hash table H, if it is being
+   resized, or else starts resizing it if its number of buckets is
+   not the ideal.  Starting can fail because of an out-of-memory
+   condition, but that'll just make hash accesses less efficient
+   until the next insertion or deletion tries again. */
 static void
 rehash(struct hash *h)
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
-  size_t i;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
 
   ASSERT(h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
+  if (h->old_buckets != NULL)
+  {
+    move_buckets(h, MOVE_BUCKETS);
+    return;
+  }
 
   /* Calculate the number of buckets to use now.
      We want one bucket for about every BEST_ELEMS_PER_BUCKET.
@@ -365,10 +616,11 @@ rehash(struct hash *h)
     new_bucket_cnt = turn_off_least_1bit(new_bucket_cnt);
 
   /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
-  /* Allocate new buckets and initialize them as empty. */
+  /* Allocate new buckets.  They are initialized as the old
+     buckets are moved into them. */
   new_buckets = malloc(sizeof *new_buckets * new_bucket_cnt);
   if (new_buckets == NULL)
   {
@@ -377,31 +629,50 @@ rehash(struct hash *h)
        there's no reason for it to be an error. */
     return;
   }
-  for (i = 0; i < new_bucket_cnt; i++)
-    list_init(&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old buckets until all
+     their elements have been moved.  Moving the first few right
+     away sets up bucket 0, where iteration starts. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->moved_cnt = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
+  move_buckets(h, MOVE_BUCKETS);
+}
 
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++)
+/* Moves the elements of up to CNT more old buckets of hash table
+   H into the appropriate new buckets, setting up the new buckets
+   they belong in first, and frees the old buckets after the last
+   one is moved. */
+static void
+move_buckets(struct hash *h, size_t cnt)
+{
+  for (; cnt > 0 && h->moved_cnt < h->old_bucket_cnt; cnt--)
   {
-    struct list *old_bucket;
-    struct list_elem *elem, *next;
+    size_t i = h->moved_cnt, j;
+    struct list *old_bucket = &h->old_buckets[i];
 
-    old_bucket = &old_buckets[i];
-    for (elem = list_begin(old_bucket);
-         elem != list_end(old_bucket); elem = next)
+    /* When growing, old bucket I splits into new buckets I,
+       I + old_bucket_cnt, ...; when shrinking, it is the first
+       old bucket that goes into new bucket I, if any. */
+    for (j = i; j < h->bucket_cnt; j += h->old_bucket_cnt)
+      list_init(&h->buckets[j]);
+
+    while (!list_empty(old_bucket))
     {
-      struct list *new_bucket = find_bucket(h, list_elem_to_hash_elem(elem));
-      next = list_next(elem);
-      list_remove(elem);
-      list_push_front(new_bucket, elem);
+      struct list_elem *elem = list_pop_front(old_bucket);
+      unsigned hash = bucket_hash(h, list_elem_to_hash_elem(elem));
+      list_push_front(&h->buckets[hash & (h->bucket_cnt - 1)], elem);
     }
+    h->moved_cnt++;
   }
 
-  free(old_buckets);
+  if (h->moved_cnt == h->old_bucket_cnt)
+  {
+    free(h->old_buckets);
+    h->old_buckets = NULL;
+  }
 }
 
 /* Inserts E into BUCKET (in hash table H). */
@@ -420,8 +691,8 @@ remove_elem(struct hash *h, struct hash_elem *e)
   list_remove(&e->list_elem);
 }
 
+/* Returns a hash of integer I, spread over all 32 bits. */
 unsigned hash_int_2(int i)
 {
-  i = ((i * 31) + 17) % 53;
-  return hash_bytes(&i, sizeof i);
+  return hash_u64((unsigned)i, 0);
 }
@@ -15,7 +15,21 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to ./list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   The table is resized incrementally: when the number of
+   elements calls for a new bucket array, it is allocated next to
+   the old one, and each insertion or deletion then moves the
+   elements of a few old buckets into it, so no single operation
+   pays for moving the whole table.  Until every old bucket has
+   been moved, an element is looked up in its old bucket if that
+   bucket has not been moved yet, and in its new one otherwise.
+
+   A table set up with hash_init_seeded() mixes every hash value
+   with a random seed of its own before picking a bucket, so which
+   keys share a bucket cannot be predicted from outside the
+   process.  hash_init() leaves hash values as they are, and with
+   them the order in which a given set of elements is iterated. */
 
 #define hash_entry(HASH_ELEM, STRUCT, MEMBER) \
   ((STRUCT *)((uint8_t *)&(HASH_ELEM)->list_elem - offsetof(STRUCT, MEMBER.list_elem)))
@@ -49,12 +63,16 @@ typedef void hash_action_func(struct hash_elem *e, void *aux);
 /* Hash table. */
 struct hash
 {
-  size_t elem_cnt;      /* Number of elements in table. */
-  size_t bucket_cnt;    /* Number of buckets, a power of 2. */
-  struct list *buckets; /* Array of `bucket_cnt' lists. */
-  hash_hash_func *hash; /* Hash function. */
-  hash_less_func *less; /* Comparison function. */
-  void *aux;            /* Auxiliary data for `hash' and `less'. */
+  size_t elem_cnt;          /* Number of elements in table. */
+  size_t bucket_cnt;        /* Number of buckets, a power of 2. */
+  struct list *buckets;     /* Array of `bucket_cnt' lists. */
+  size_t old_bucket_cnt;    /* Number of old buckets, a power of 2. */
+  struct list *old_buckets; /* Buckets being moved out of, or NULL. */
+  size_t moved_cnt;         /* Old buckets already moved. */
+  uint64_t seed;            /* Mixed into hash values, if nonzero. */
+  hash_hash_func *hash;     /* Hash function. */
+  hash_less_func *less;     /* Comparison function. */
+  void *aux;                /* Auxiliary data for `hash' and `less'. */
 };
 
 /* A hash table iterator. */
@@ -67,6 +85,8 @@ struct hash_iterator
 
 /* Basic life cycle. */
 bool hash_init(struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_seeded(struct hash *, hash_hash_func *, hash_less_func *,
+                      void *aux);
 void hash_clear(struct hash *, hash_action_func *);
 void hash_destroy(struct hash *, hash_action_func *);
 
@@ -91,6 +111,13 @@ unsigned hash_bytes(const void *, size_t);
 unsigned hash_string(const char *);
 unsigned hash_int(int);
 
+/* Seeded 64-bit hash functions.  Any bits of the result may be
+   used, e.g. the low 32 as a hash_hash_func's return value. */
+uint64_t hash_bytes64(const void *, size_t, uint64_t seed);
+uint64_t hash_string64(const char *, uint64_t seed);
+uint64_t hash_u64(uint64_t, uint64_t seed);
+uint64_t hash_random_seed(void);
+
 /*user defined functions*/
 unsigned hash_int_2(int i);
 
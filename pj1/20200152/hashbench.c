@@ -0,0 +1,294 @@
+// hashbench.c - 체인 해시(struct hash)와 오픈 어드레싱 해시(struct shash) 성능 비교
+//
+// 사용법: hashbench [-n 최대 원소 수] [-s 검증 횟수]
+//
+// 원소 수 1K, 10K, ..., 최대 원소 수까지 각 테이블에 대해
+// 삽입, 찾기(있는 키), 찾기(없는 키), 삭제 한 번에 걸리는 시간(ns)을 출력한다.
+// 찾기와 삭제는 삽입과 다른 무작위 순서로 한다.
+// 이어서 빈 테이블에 원소를 하나씩 넣으며 삽입마다 걸린 시간을 재어
+// 테이블이 커지는 동안의 지연 분포(중앙값, 99%, 99.9%, 99.99%, 최대)를 출력한다.
+// 측정 전에 임의의 연산열로 두 테이블의 결과가 같은지 검증한다.
+
+#include "hash.h"
+#include "shash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+struct item
+{
+    struct hash_elem elem;
+    int key;
+};
+
+static unsigned item_hash(const struct hash_elem *e, void *aux)
+{
+    return hash_int(hash_entry(e, struct item, elem)->key);
+}
+
+static bool item_less(const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+    return hash_entry(a, struct item, elem)->key < hash_entry(b, struct item, elem)->key;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// i번째 키: 홀수 곱셈은 2^32 안에서 일대일이므로 키가 겹치지 않음
+static int key_of(size_t i)
+{
+    return (int)((unsigned)i * 0x9e3779b1u);
+}
+
+static void shuffle(size_t *a, size_t n)
+{
+    size_t i;
+
+    for (i = n - 1; i > 0; i--)
+    {
+        size_t j = random() % (i + 1), t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+}
+
+// 두 테이블을 각각 순회하며 원소가 서로 같은지 확인
+// (struct hash는 크기를 바꾸는 도중일 수 있음: 옛 버킷과 새 버킷을 모두 돌아야 함)
+static void check_iteration(struct hash *h, struct shash *s, struct item *a, struct item *b)
+{
+    struct shash_iterator it;
+    struct hash_iterator hit;
+    size_t cnt;
+
+    for (cnt = 0, shash_first(&it, s); shash_next(&it); cnt++)
+        if (hash_find(h, &a[hash_entry(shash_cur(&it), struct item, elem)->key].elem) == NULL)
+        {
+            fprintf(stderr, "verify failed: iteration\n");
+            exit(1);
+        }
+    if (cnt != hash_size(h))
+    {
+        fprintf(stderr, "verify failed: %zu elements iterated\n", cnt);
+        exit(1);
+    }
+    for (cnt = 0, hash_first(&hit, h); hash_next(&hit); cnt++)
+        if (shash_find(s, &b[hash_entry(hash_cur(&hit), struct item, elem)->key].elem) == NULL)
+        {
+            fprintf(stderr, "verify failed: hash iteration\n");
+            exit(1);
+        }
+    if (cnt != shash_size(s))
+    {
+        fprintf(stderr, "verify failed: %zu hash elements iterated\n", cnt);
+        exit(1);
+    }
+}
+
+// 작은 키 범위에서 무작위 삽입/교체/삭제/찾기를 두 테이블에 똑같이 하고 결과를 비교
+static void verify(int rounds)
+{
+    enum { KEYS = 4096 };
+    static struct item a[KEYS], b[KEYS];
+    struct hash h;
+    struct shash s;
+    int r, k;
+
+    hash_init(&h, item_hash, item_less, NULL);
+    shash_init(&s, item_hash, item_less, NULL);
+    for (k = 0; k < KEYS; k++)
+        a[k].key = b[k].key = k;
+    for (r = 0; r < rounds; r++)
+    {
+        struct hash_elem *x, *y;
+        int op = random() % 4;
+
+        k = random() % KEYS;
+        if (op == 0 || op == 1)
+        {
+            // 이미 있는 원소를 다시 넣지 않도록 먼저 찾아 봄
+            if (hash_find(&h, &a[k].elem) != NULL)
+                continue;
+            x = op == 0 ? hash_insert(&h, &a[k].elem) : hash_replace(&h, &a[k].elem);
+            y = op == 0 ? shash_insert(&s, &b[k].elem) : shash_replace(&s, &b[k].elem);
+        }
+        else if (op == 2)
+        {
+            x = hash_delete(&h, &a[k].elem);
+            y = shash_delete(&s, &b[k].elem);
+        }
+        else
+        {
+            x = hash_find(&h, &a[k].elem);
+            y = shash_find(&s, &b[k].elem);
+        }
+        if ((x == NULL) != (y == NULL) || hash_size(&h) != shash_size(&s))
+        {
+            fprintf(stderr, "verify failed: op %d key %d\n", op, k);
+            exit(1);
+        }
+        // 크기를 바꾸는 도중에는 매번, 아니면 가끔 순회를 확인
+        if (h.old_buckets != NULL || r % 1000 == 0)
+            check_iteration(&h, &s, a, b);
+    }
+    check_iteration(&h, &s, a, b);
+    hash_destroy(&h, NULL);
+    shash_destroy(&s, NULL);
+}
+
+// 테이블 종류에 상관없이 같은 측정을 하기 위한 함수 묶음
+struct table_ops
+{
+    const char *name;
+    void (*init)(void *);
+    void (*destroy)(void *);
+    struct hash_elem *(*insert)(void *, struct hash_elem *);
+    struct hash_elem *(*find)(void *, struct hash_elem *);
+    struct hash_elem *(*delete)(void *, struct hash_elem *);
+};
+
+static void h_init(void *t) { hash_init(t, item_hash, item_less, NULL); }
+static void h_destroy(void *t) { hash_destroy(t, NULL); }
+static struct hash_elem *h_insert(void *t, struct hash_elem *e) { return hash_insert(t, e); }
+static struct hash_elem *h_find(void *t, struct hash_elem *e) { return hash_find(t, e); }
+static struct hash_elem *h_delete(void *t, struct hash_elem *e) { return hash_delete(t, e); }
+static void s_init(void *t) { shash_init(t, item_hash, item_less, NULL); }
+static void s_destroy(void *t) { shash_destroy(t, NULL); }
+static struct hash_elem *s_insert(void *t, struct hash_elem *e) { return shash_insert(t, e); }
+static struct hash_elem *s_find(void *t, struct hash_elem *e) { return shash_find(t, e); }
+static struct hash_elem *s_delete(void *t, struct hash_elem *e) { return shash_delete(t, e); }
+
+static const struct table_ops tables[] = {
+    {"hash", h_init, h_destroy, h_insert, h_find, h_delete},
+    {"shash", s_init, s_destroy, s_insert, s_find, s_delete},
+};
+
+// 원소 N개로 한 테이블을 측정: 종류별 연산이 약 2백만 번이 되도록 반복
+static void bench(const struct table_ops *t, struct item *items, struct item *misses,
+                  size_t *order, size_t n)
+{
+    union { struct hash h; struct shash s; } table;
+    size_t reps = n >= 2000000 ? 1 : 2000000 / n, r, i;
+    double ins = 0, hit = 0, miss = 0, del = 0, t0;
+    long found = 0;
+
+    for (r = 0; r < reps; r++)
+    {
+        t->init(&table);
+        t0 = now();
+        for (i = 0; i < n; i++)
+            t->insert(&table, &items[i].elem);
+        ins += now() - t0;
+        t0 = now();
+        for (i = 0; i < n; i++)
+            found += t->find(&table, &items[order[i]].elem) != NULL;
+        hit += now() - t0;
+        t0 = now();
+        for (i = 0; i < n; i++)
+            found -= t->find(&table, &misses[order[i]].elem) != NULL;
+        miss += now() - t0;
+        t0 = now();
+        for (i = 0; i < n; i++)
+            t->delete(&table, &items[order[i]].elem);
+        del += now() - t0;
+        t->destroy(&table);
+    }
+    if (found != (long)(n * reps))
+    {
+        fprintf(stderr, "%s: %ld found, expected %zu\n", t->name, found, n * reps);
+        exit(1);
+    }
+    printf("%9zu %-6s insert %7.1f  find hit %7.1f  find miss %7.1f  delete %7.1f ns\n",
+           n, t->name, ins / (n * reps) * 1e9, hit / (n * reps) * 1e9,
+           miss / (n * reps) * 1e9, del / (n * reps) * 1e9);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 빈 테이블에 N개를 넣으며 삽입 하나하나의 시간을 재고 분포를 출력
+static void latency(const struct table_ops *t, struct item *items, size_t n)
+{
+    union { struct hash h; struct shash s; } table;
+    double *lat = malloc(n * sizeof *lat), t0, t1;
+    size_t i;
+
+    if (lat == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    t->init(&table);
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        t->insert(&table, &items[i].elem);
+        t1 = now();
+        lat[i] = t1 - t0;
+        t0 = t1;
+    }
+    t->destroy(&table);
+    qsort(lat, n, sizeof *lat, cmp_double);
+    printf("%9zu %-6s insert latency: p50 %6.0f  p99 %6.0f  p99.9 %7.0f  "
+           "p99.99 %8.0f  max %9.0f ns\n",
+           n, t->name, lat[n / 2] * 1e9, lat[n / 100 * 99] * 1e9,
+           lat[n / 1000 * 999] * 1e9, lat[n / 10000 * 9999] * 1e9, lat[n - 1] * 1e9);
+    free(lat);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = 10000000, n, i;
+    int c, rounds = 1000000;
+    struct item *items, *misses;
+    size_t *order;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1)
+    {
+        if (c == 'n')
+            max = atol(optarg);
+        else if (c == 's')
+            rounds = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n max elements] [-s rounds]\n", argv[0]);
+            exit(1);
+        }
+    }
+    srandom(1);
+    verify(rounds);
+
+    items = malloc(max * sizeof *items);
+    misses = malloc(max * sizeof *misses);
+    order = malloc(max * sizeof *order);
+    if (items == NULL || misses == NULL || order == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < max; i++)
+    {
+        items[i].key = key_of(i);
+        misses[i].key = key_of(i + max);
+    }
+    for (n = 1000; n <= max; n *= 10)
+    {
+        for (i = 0; i < n; i++)
+            order[i] = i;
+        shuffle(order, n);
+        for (i = 0; i < sizeof tables / sizeof tables[0]; i++)
+            bench(&tables[i], items, misses, order, n);
+    }
+    for (n = 1000000; n <= max; n *= 10)
+        for (i = 0; i < sizeof tables / sizeof tables[0]; i++)
+            latency(&tables[i], items, n);
+    return 0;
+}
@@ -0,0 +1,258 @@
+// hashfuncbench.c - 해시 함수 속도와 버킷 분포 비교
+//
+// 사용법: hashfuncbench [-n 키 수]
+//
+// 1. 바이트 해시(hash_bytes: FNV, hash_bytes64: wyhash 방식)가 입력 길이별로
+//    한 사이클에 몇 바이트를 처리하는지(bytes/cycle)와 GB/s를 출력한다.
+// 2. 정수 해시(hash_int, hash_int_2, hash_u64) 한 번에 드는 사이클을 출력한다.
+// 3. 실제로 쓸 만한 키 집합마다, struct hash처럼 원소 2개에 버킷 하나(2의 거듭제곱)를
+//    두고 해시 값의 하위 비트로 버킷을 고를 때 체인 길이 분포를 출력한다.
+//    avg는 있는 키를 찾을 때 비교하는 원소 수의 평균이고,
+//    ideal은 해시가 완전히 무작위일 때의 기댓값이다.
+// 사이클은 x86의 타임스탬프 카운터로 재며, 다른 아키텍처에서는 GB/s만 의미가 있다.
+
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static unsigned long xorshift(unsigned long *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static uint64_t seed;
+static volatile uint64_t sink;      // 결과를 버리지 않게 하여 계산이 없어지지 않도록 함
+
+// 바꾸기 전의 hash_int_2: % 53 때문에 해시 값이 53가지뿐
+static unsigned old_hash_int_2(int i)
+{
+    i = ((i * 31) + 17) % 53;
+    return hash_bytes(&i, sizeof i);
+}
+
+// 길이 LEN인 입력을 REPS번 해시하는 시간과 사이클을 잼
+static void bytes_speed(const char *name, int wy, const unsigned char *buf, size_t len, long reps)
+{
+    unsigned long long c0;
+    uint64_t acc = 0;
+    double t0;
+    long r;
+
+    t0 = now();
+    c0 = cycles();
+    for (r = 0; r < reps; r++)
+    {
+        // 입력 위치를 조금씩 바꾸어 같은 계산을 반복하지 않게 함
+        const unsigned char *p = buf + (r & 63);
+        acc += wy ? hash_bytes64(p, len, seed) : hash_bytes(p, len);
+    }
+    c0 = cycles() - c0;
+    t0 = now() - t0;
+    sink = acc;
+    printf("%-12s %6zu bytes  %6.2f bytes/cycle  %6.2f GB/s  %7.1f cycles/hash\n",
+           name, len, (double)len * reps / c0, len * reps / t0 / 1e9, (double)c0 / reps);
+}
+
+// 정수 해시 함수 묶음
+struct int_func
+{
+    const char *name;
+    uint64_t (*hash)(int);
+};
+
+static uint64_t f_hash_int(int k) { return hash_int(k); }
+static uint64_t f_old_hash_int_2(int k) { return old_hash_int_2(k); }
+static uint64_t f_hash_int_2(int k) { return hash_int_2(k); }
+static uint64_t f_hash_u64(int k) { return hash_u64((unsigned)k, seed); }
+// hash_init_seeded()로 만든 테이블이 버킷을 고르는 값
+static uint64_t f_seeded_table(int k) { return (unsigned)hash_u64(hash_int(k), seed); }
+
+static const struct int_func int_funcs[] = {
+    {"hash_int", f_hash_int},
+    {"hash_int_2(old)", f_old_hash_int_2},
+    {"hash_int_2", f_hash_int_2},
+    {"hash_u64", f_hash_u64},
+    {"hash_int+seed", f_seeded_table},
+};
+
+static void int_speed(const struct int_func *f, long reps)
+{
+    unsigned long long c0;
+    uint64_t acc = 0;
+    double t0;
+    long r;
+
+    t0 = now();
+    c0 = cycles();
+    for (r = 0; r < reps; r++)
+        acc += f->hash((int)r);
+    c0 = cycles() - c0;
+    t0 = now() - t0;
+    sink = acc;
+    printf("%-16s %6.1f cycles/hash  %6.2f ns/hash\n", f->name, (double)c0 / reps, t0 / reps * 1e9);
+}
+
+// N개의 해시 값을 struct hash와 같은 방식으로 버킷에 나누고 체인 길이 분포를 출력
+static void chains(const char *keys, const char *name, const uint64_t *hashes, size_t n)
+{
+    size_t bucket_cnt = 4, i, hist[9] = {0}, max = 0;
+    unsigned *len;
+    double search = 0, ideal;
+
+    while (bucket_cnt * 2 <= n / 2)
+        bucket_cnt *= 2;
+    len = calloc(bucket_cnt, sizeof *len);
+    if (len == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        len[(unsigned)hashes[i] & (bucket_cnt - 1)]++;
+    for (i = 0; i < bucket_cnt; i++)
+    {
+        hist[len[i] < 8 ? len[i] : 8]++;
+        if (len[i] > max)
+            max = len[i];
+        // 길이 c인 체인의 원소들을 찾을 때 비교 수: 1 + 2 + ... + c
+        search += (double)len[i] * (len[i] + 1) / 2;
+    }
+    ideal = 1 + (n - 1) / (2.0 * bucket_cnt);
+    printf("%-11s %-16s avg %8.2f (ideal %.2f) max %7zu  ", keys, name, search / n, ideal, max);
+    for (i = 0; i < 9; i++)
+        printf(" %s%zu:%5.1f%%", i == 8 ? ">=" : "", i, 100.0 * hist[i] / bucket_cnt);
+    printf("\n");
+    free(len);
+}
+
+// 정수 키 집합 하나를 모든 정수 해시로 나누어 봄
+static void int_keys(const char *keys, const int *k, size_t n, uint64_t *hashes)
+{
+    size_t f, i;
+
+    for (f = 0; f < sizeof int_funcs / sizeof int_funcs[0]; f++)
+    {
+        for (i = 0; i < n; i++)
+            hashes[i] = int_funcs[f].hash(k[i]);
+        chains(keys, int_funcs[f].name, hashes, n);
+    }
+}
+
+// 문자열 키 집합 하나를 FNV(hash_string)와 hash_string64로 나누어 봄
+static void string_keys(const char *keys, char **s, size_t n, uint64_t *hashes)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        hashes[i] = hash_string(s[i]);
+    chains(keys, "hash_string", hashes, n);
+    for (i = 0; i < n; i++)
+        hashes[i] = hash_string64(s[i], seed);
+    chains(keys, "hash_string64", hashes, n);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t lens[] = {4, 8, 16, 32, 64, 256, 1024, 4096, 65536};
+    size_t n = 1 << 20, i, l;
+    unsigned long rs = 1;
+    unsigned char *buf;
+    uint64_t *hashes;
+    char **s, *text;
+    int *k, c;
+
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        if (c == 'n')
+            n = atol(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n keys]\n", argv[0]);
+            exit(1);
+        }
+    }
+    seed = hash_random_seed();
+
+    // 1. 바이트 해시 속도: 입력마다 약 64MB를 해시
+    buf = malloc(65536 + 64);
+    for (i = 0; i < 65536 + 64; i++)
+        buf[i] = xorshift(&rs);
+    for (l = 0; l < sizeof lens / sizeof lens[0]; l++)
+    {
+        long reps = (64 << 20) / lens[l];
+        bytes_speed("hash_bytes", 0, buf, lens[l], reps);
+        bytes_speed("hash_bytes64", 1, buf, lens[l], reps);
+    }
+    printf("\n");
+
+    // 2. 정수 해시 속도
+    for (i = 0; i < sizeof int_funcs / sizeof int_funcs[0]; i++)
+        int_speed(&int_funcs[i], 1 << 24);
+    printf("\n");
+
+    // 3. 키 집합별 체인 길이 분포
+    k = calloc(n, sizeof *k);
+    hashes = malloc(n * sizeof *hashes);
+    s = malloc(n * sizeof *s);
+    text = malloc(n * 64);
+    if (k == NULL || hashes == NULL || s == NULL || text == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        k[i] = i;
+    int_keys("sequential", k, n, hashes);
+    for (i = 0; i < n; i++)
+        k[i] = i * 4096;            // 하위 비트가 모두 0인 키 (주소, 페이지 번호 등)
+    int_keys("stride-4096", k, n, hashes);
+    for (i = 0; i < n; i++)
+        k[i] = xorshift(&rs);
+    int_keys("random", k, n, hashes);
+
+    for (i = 0; i < n; i++)
+    {
+        s[i] = text + i * 64;
+        snprintf(s[i], 64, "user%zu", i);
+    }
+    string_keys("identifiers", s, n, hashes);
+    for (i = 0; i < n; i++)
+        snprintf(s[i], 64, "/usr/lib/x86_64-linux-gnu/lib%zu.so.%zu", i / 8, i % 8);
+    string_keys("paths", s, n, hashes);
+    for (i = 0; i < n; i++)
+        snprintf(s[i], 64, "10.%zu.%zu.%zu", i >> 16 & 255, i >> 8 & 255, i & 255);
+    string_keys("ip-addrs", s, n, hashes);
+
+    free(text);
+    free(s);
+    free(hashes);
+    free(k);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,517 @@
+#include "hbitmap.h"
+#include <assert.h>
+#include "limits.h" // 		#include <limits.h>
+#include "round.h"  // 		#include <round.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Element type, as in bitmap.c. */
+typedef unsigned long elem_type;
+
+/* Number of bits in an element. */
+#define ELEM_BITS (sizeof(elem_type) * CHAR_BIT)
+
+/* Most summary levels: enough for 64^6 words. */
+#define MAX_LEVELS 6
+
+/* Bits in a region, the unit of the run hints: the bits under one
+   level-1 summary word. */
+#define REGION_BITS (ELEM_BITS * ELEM_BITS)
+
+/* Summary kinds: words with a 0 bit, words with a 1 bit.  A
+   search for VALUE follows summary HAS(VALUE). */
+#define HAS_CLEAR 0
+#define HAS_SET 1
+#define HAS(VALUE) ((VALUE) ? HAS_SET : HAS_CLEAR)
+
+/* Runs of 0 bits in a range of regions. */
+struct run_hint
+{
+  size_t len; /* Bits in the range. */
+  size_t pre; /* 0 bits at its start. */
+  size_t suf; /* 0 bits at its end. */
+  size_t max; /* Longest run of 0 bits in it. */
+};
+
+struct hbitmap
+{
+  size_t bit_cnt;                           /* Number of bits. */
+  size_t word_cnt;                          /* Elements in bits. */
+  elem_type *bits;                          /* The bits themselves. */
+  int levels;                               /* Summary levels. */
+  size_t sum_cnt[MAX_LEVELS + 1];           /* Words in each level. */
+  elem_type *sum[2][MAX_LEVELS + 1];        /* Summaries, by kind and level. */
+  size_t region_cnt;                        /* Regions (level-1 words). */
+  size_t leaf_base;                         /* First leaf of hints. */
+  struct run_hint *hints;                   /* Tree of hints, or NULL. */
+};
+
+static void update_words(struct hbitmap *, size_t first, size_t last);
+static void update_hints(struct hbitmap *, size_t first, size_t last);
+static size_t next_word(const struct hbitmap *, int kind, size_t w);
+
+/* Returns a mask of the valid bits of word W of H. */
+static inline elem_type
+valid_mask(const struct hbitmap *h, size_t w)
+{
+  size_t last_bits = h->bit_cnt % ELEM_BITS;
+
+  if (w == h->word_cnt - 1 && last_bits)
+    return ((elem_type)1 << last_bits) - 1;
+  return (elem_type)-1;
+}
+
+/* Returns the valid bits of word W of H that are VALUE, as 1s. */
+static inline elem_type
+match(const struct hbitmap *h, size_t w, bool value)
+{
+  return (value ? h->bits[w] : ~h->bits[w]) & valid_mask(h, w);
+}
+
+/* Creation and destruction. */
+
+/* Creates a bitmap of BIT_CNT bits, all set to false.  With
+   RUN_HINTS, it also keeps the run hints that speed up searches
+   for runs of 0 bits.  Returns a null pointer if memory
+   allocation fails. */
+struct hbitmap *
+hbitmap_create(size_t bit_cnt, bool run_hints)
+{
+  struct hbitmap *h = calloc(1, sizeof *h);
+  size_t n;
+  int k, l;
+
+  if (h == NULL)
+    return NULL;
+  h->bit_cnt = bit_cnt;
+  h->word_cnt = DIV_ROUND_UP(bit_cnt, ELEM_BITS);
+  h->bits = calloc(h->word_cnt + 1, sizeof(elem_type));
+  if (h->bits == NULL)
+    goto fail;
+
+  /* One level per factor of 64, until a level fits in a word. */
+  h->sum_cnt[0] = h->word_cnt;
+  for (n = h->word_cnt, l = 1; l == 1 || n > 1; l++)
+  {
+    if (l > MAX_LEVELS)
+      goto fail;
+    n = DIV_ROUND_UP(n, ELEM_BITS);
+    h->sum_cnt[l] = n;
+    for (k = 0; k < 2; k++)
+      if ((h->sum[k][l] = calloc(n + 1, sizeof(elem_type))) == NULL)
+        goto fail;
+  }
+  h->levels = l - 1;
+
+  if (run_hints)
+  {
+    h->region_cnt = h->sum_cnt[1];
+    for (h->leaf_base = 1; h->leaf_base < h->region_cnt; h->leaf_base *= 2)
+      continue;
+    h->hints = calloc(2 * h->leaf_base, sizeof *h->hints);
+    if (h->hints == NULL)
+      goto fail;
+  }
+
+  if (h->word_cnt > 0)
+  {
+    update_words(h, 0, h->word_cnt - 1);
+    update_hints(h, 0, h->word_cnt - 1);
+  }
+  return h;
+
+fail:
+  hbitmap_destroy(h);
+  return NULL;
+}
+
+/* Destroys H, freeing its storage. */
+void hbitmap_destroy(struct hbitmap *h)
+{
+  int k, l;
+
+  if (h == NULL)
+    return;
+  for (k = 0; k < 2; k++)
+    for (l = 1; l <= MAX_LEVELS; l++)
+      free(h->sum[k][l]);
+  free(h->hints);
+  free(h->bits);
+  free(h);
+}
+
+/* Returns the number of bits in H. */
+size_t
+hbitmap_size(const struct hbitmap *h)
+{
+  return h->bit_cnt;
+}
+
+/* Setting and testing bits. */
+
+/* Sets the bit numbered IDX in H to VALUE. */
+void hbitmap_set(struct hbitmap *h, size_t idx, bool value)
+{
+  hbitmap_set_multiple(h, idx, 1, value);
+}
+
+/* Returns the value of the bit numbered IDX in H. */
+bool hbitmap_test(const struct hbitmap *h, size_t idx)
+{
+  ASSERT(h != NULL);
+  ASSERT(idx < h->bit_cnt);
+  return (h->bits[idx / ELEM_BITS] >> (idx % ELEM_BITS)) & 1;
+}
+
+/* Sets all bits in H to VALUE. */
+void hbitmap_set_all(struct hbitmap *h, bool value)
+{
+  hbitmap_set_multiple(h, 0, h->bit_cnt, value);
+}
+
+/* Sets the CNT bits starting at START in H to VALUE, and brings
+   the summaries and hints over them up to date. */
+void hbitmap_set_multiple(struct hbitmap *h, size_t start, size_t cnt, bool value)
+{
+  size_t end = start + cnt, first, last, w;
+
+  ASSERT(h != NULL);
+  ASSERT(start <= h->bit_cnt);
+  ASSERT(start + cnt <= h->bit_cnt);
+
+  if (cnt == 0)
+    return;
+  first = start / ELEM_BITS;
+  last = (end - 1) / ELEM_BITS;
+  for (w = first; w <= last; w++)
+  {
+    elem_type mask = (elem_type)-1;
+
+    if (w == first)
+      mask &= (elem_type)-1 << (start % ELEM_BITS);
+    if (w == last && end % ELEM_BITS)
+      mask &= ((elem_type)1 << (end % ELEM_BITS)) - 1;
+    if (value)
+      h->bits[w] |= mask;
+    else
+      h->bits[w] &= ~mask;
+  }
+  update_words(h, first, last);
+  update_hints(h, first, last);
+}
+
+/* Summaries. */
+
+/* Sets or clears bit I of summary word array S. */
+static inline bool
+put_bit(elem_type *s, size_t i, bool on)
+{
+  elem_type old = s[i / ELEM_BITS];
+  elem_type bit = (elem_type)1 << (i % ELEM_BITS);
+
+  s[i / ELEM_BITS] = on ? old | bit : old & ~bit;
+  return s[i / ELEM_BITS] != old;
+}
+
+/* Recomputes the summary bits above words FIRST...LAST of H.  Each
+   level only needs the words under the ones that changed below. */
+static void
+update_words(struct hbitmap *h, size_t first, size_t last)
+{
+  size_t i;
+  int k, l;
+
+  for (k = 0; k < 2; k++)
+  {
+    size_t lo = first, hi = last;
+
+    for (i = lo; i <= hi; i++)
+      put_bit(h->sum[k][1], i, match(h, i, k == HAS_SET) != 0);
+    for (l = 2; l <= h->levels; l++)
+    {
+      lo /= ELEM_BITS;
+      hi /= ELEM_BITS;
+      for (i = lo; i <= hi; i++)
+        put_bit(h->sum[k][l], i, h->sum[k][l - 1][i] != 0);
+    }
+  }
+}
+
+/* Returns the index of the first word of H at or after W that has
+   a bit summarized by KIND (a 0 bit for HAS_CLEAR, a 1 bit for
+   HAS_SET), or HBITMAP_ERROR if there is none.  Climbs the levels
+   until some word has such a bit at or after the position, then
+   follows the lowest set bit back down: two words per level. */
+static size_t
+next_word(const struct hbitmap *h, int kind, size_t w)
+{
+  size_t i = w;
+  int l;
+
+  for (l = 1; l <= h->levels; l++)
+  {
+    elem_type m;
+
+    if (i / ELEM_BITS >= h->sum_cnt[l])
+      return HBITMAP_ERROR;
+    m = h->sum[kind][l][i / ELEM_BITS] & ((elem_type)-1 << (i % ELEM_BITS));
+    if (m)
+    {
+      i = i / ELEM_BITS * ELEM_BITS + __builtin_ctzl(m);
+      break;
+    }
+    i = i / ELEM_BITS + 1;
+  }
+  if (l > h->levels)
+    return HBITMAP_ERROR;
+  for (l--; l >= 1; l--)
+    i = i * ELEM_BITS + __builtin_ctzl(h->sum[kind][l][i]);
+  return i;
+}
+
+/* Run hints. */
+
+/* Returns the hint for the pair of adjacent ranges A and B. */
+static struct run_hint
+combine(struct run_hint a, struct run_hint b)
+{
+  struct run_hint r;
+
+  r.len = a.len + b.len;
+  r.pre = a.pre == a.len ? a.len + b.pre : a.pre;
+  r.suf = b.suf == b.len ? b.len + a.suf : b.suf;
+  r.max = a.max > b.max ? a.max : b.max;
+  if (a.suf + b.pre > r.max)
+    r.max = a.suf + b.pre;
+  return r;
+}
+
+/* Returns the length of the longest run of 1 bits in X. */
+static inline size_t
+longest_ones(elem_type x)
+{
+  size_t n;
+
+  for (n = 0; x != 0; n++)
+    x &= x << 1;
+  return n;
+}
+
+/* Computes the hint for region R of H from its words. */
+static struct run_hint
+region_hint(const struct hbitmap *h, size_t r)
+{
+  struct run_hint rh = {0, 0, 0, 0};
+  size_t w, end = (r + 1) * ELEM_BITS, cur = 0;
+  bool in_pre = true;
+
+  if (end > h->word_cnt)
+    end = h->word_cnt;
+  for (w = r * ELEM_BITS; w < end; w++)
+  {
+    elem_type c = match(h, w, false), v = valid_mask(h, w);
+    size_t bits = __builtin_popcountl(v), lead;
+
+    rh.len += bits;
+    if (c == v)
+    {
+      cur += bits; /* Whole word is free. */
+      continue;
+    }
+
+    /* The run carried in ends at the word's first 1 bit, and a new
+       one starts after its last.  Runs in between matter only if
+       there are enough 0 bits to beat the longest so far. */
+    lead = __builtin_ctzl(~c);
+    if (in_pre)
+      rh.pre = cur + lead;
+    in_pre = false;
+    if (cur + lead > rh.max)
+      rh.max = cur + lead;
+    if ((size_t)__builtin_popcountl(c) > rh.max && longest_ones(c) > rh.max)
+      rh.max = longest_ones(c);
+    cur = __builtin_clzl(~(c << (ELEM_BITS - bits)));
+  }
+  if (in_pre)
+    rh.pre = cur;
+  rh.suf = cur;
+  if (cur > rh.max)
+    rh.max = cur;
+  return rh;
+}
+
+/* Recomputes the hints for the regions over words FIRST...LAST of H
+   and the tree nodes above them. */
+static void
+update_hints(struct hbitmap *h, size_t first, size_t last)
+{
+  size_t lo, hi, i;
+
+  if (h->hints == NULL)
+    return;
+  lo = first / ELEM_BITS + h->leaf_base;
+  hi = last / ELEM_BITS + h->leaf_base;
+  for (i = lo; i <= hi; i++)
+    h->hints[i] = region_hint(h, i - h->leaf_base);
+  while (lo > 1)
+  {
+    lo /= 2;
+    hi /= 2;
+    for (i = lo; i <= hi; i++)
+      h->hints[i] = combine(h->hints[2 * i], h->hints[2 * i + 1]);
+  }
+}
+
+/* Searching. */
+
+/* The search state carried from word to word: the run of VALUE bits
+   reaching the end of what has been looked at so far. */
+struct run
+{
+  size_t start;
+  size_t len;
+};
+
+/* Continues run RUN through words W...W_END-1 of H, ignoring bits
+   below START, until it is CNT bits of VALUE long.  Returns its start
+   then, or HBITMAP_ERROR if the words run out first, with RUN
+   describing the run reaching their end.  With no run in progress,
+   words without a VALUE bit are skipped using the summaries. */
+static size_t
+scan_words(const struct hbitmap *h, bool value, size_t w, size_t w_end,
+           size_t start, size_t cnt, struct run *run)
+{
+  while (w < w_end)
+  {
+    elem_type m;
+    size_t pos = 0;
+
+    if (run->len == 0 && (w = next_word(h, HAS(value), w)) >= w_end)
+      return HBITMAP_ERROR;
+
+    m = match(h, w, value);
+    if (w == start / ELEM_BITS)
+      m &= (elem_type)-1 << (start % ELEM_BITS);
+
+    if (m == (elem_type)-1)
+    {
+      if (run->len == 0)
+        run->start = w * ELEM_BITS;
+      run->len += ELEM_BITS;
+    }
+    else
+      while (pos < ELEM_BITS)
+      {
+        elem_type rest = m >> pos;
+        size_t ones = rest == (elem_type)-1 >> pos ? ELEM_BITS - pos
+                                                   : (size_t)__builtin_ctzl(~rest);
+
+        if (ones > 0)
+        {
+          if (run->len == 0)
+            run->start = w * ELEM_BITS + pos;
+          run->len += ones;
+          if (run->len >= cnt)
+            return run->start;
+          pos += ones;
+          if (pos == ELEM_BITS)
+            break;
+        }
+        run->len = 0;
+        if ((rest = m >> pos) == 0)
+          break;
+        pos += __builtin_ctzl(rest);
+      }
+    if (run->len >= cnt)
+      return run->start;
+    w++;
+  }
+  return HBITMAP_ERROR;
+}
+
+/* First-fit search for CNT 0 bits at or after START in the regions
+   LO...HI-1 under hint tree node NODE, continuing RUN.  Nodes wholly
+   at or after START are judged by their hints alone unless the run
+   ends inside them; the rest are split. */
+static size_t
+find_free(const struct hbitmap *h, size_t node, size_t lo, size_t hi,
+          size_t start, size_t cnt, struct run *run)
+{
+  size_t first_bit = lo * REGION_BITS, mid, idx, w, w_end;
+  const struct run_hint *t = &h->hints[node];
+
+  if (lo >= h->region_cnt || hi * REGION_BITS <= start)
+    return HBITMAP_ERROR;
+  if (first_bit >= start)
+  {
+    if (run->len + t->pre >= cnt)
+      return run->len ? run->start : first_bit;
+    if (t->max < cnt)
+    {
+      if (t->pre == t->len)
+      {
+        if (run->len == 0)
+          run->start = first_bit;
+        run->len += t->len;
+      }
+      else
+      {
+        run->start = first_bit + t->len - t->suf;
+        run->len = t->suf;
+      }
+      return HBITMAP_ERROR;
+    }
+  }
+  if (hi - lo == 1)
+  {
+    w = lo * ELEM_BITS > start / ELEM_BITS ? lo * ELEM_BITS : start / ELEM_BITS;
+    w_end = (lo + 1) * ELEM_BITS;
+    if (w_end > h->word_cnt)
+      w_end = h->word_cnt;
+    return scan_words(h, false, w, w_end, start, cnt, run);
+  }
+  mid = lo + (hi - lo) / 2;
+  idx = find_free(h, 2 * node, lo, mid, start, cnt, run);
+  if (idx == HBITMAP_ERROR)
+    idx = find_free(h, 2 * node + 1, mid, hi, start, cnt, run);
+  return idx;
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in H at or after START that are all set to
+   VALUE, or HBITMAP_ERROR if there is none.  If CNT is zero,
+   returns START. */
+size_t
+hbitmap_scan(const struct hbitmap *h, size_t start, size_t cnt, bool value)
+{
+  struct run run = {0, 0};
+
+  ASSERT(h != NULL);
+  ASSERT(start <= h->bit_cnt);
+
+  if (cnt > h->bit_cnt || start > h->bit_cnt - cnt)
+    return HBITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+  /* A single bit is just the next word with one: the summaries
+     find it faster than the hints would. */
+  if (!value && h->hints != NULL && cnt > 1)
+    return find_free(h, 1, 0, h->leaf_base, start, cnt, &run);
+  return scan_words(h, value, start / ELEM_BITS, h->word_cnt, start, cnt, &run);
+}
+
+/* Finds the first group of CNT consecutive bits in H at or after
+   START that are all set to VALUE, flips them all to !VALUE,
+   and returns the index of the first bit in the group.
+   If there is no such group, returns HBITMAP_ERROR. */
+size_t
+hbitmap_scan_and_flip(struct hbitmap *h, size_t start, size_t cnt, bool value)
+{
+  size_t idx = hbitmap_scan(h, start, cnt, value);
+
+  if (idx != HBITMAP_ERROR)
+    hbitmap_set_multiple(h, idx, cnt, !value);
+  return idx;
+}
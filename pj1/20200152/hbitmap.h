@@ -0,0 +1,51 @@
+#ifndef __MYLIB_HBITMAP_H
+#define __MYLIB_HBITMAP_H
+
+/* Hierarchical bitmap.
+
+   An array of bits like struct bitmap (see bitmap.h), plus summary
+   levels that make searching it cheap when it is nearly full or
+   nearly empty, as a block-allocation map usually is.
+
+   Above the bits, level 1 has two bits per 64-bit word of bits:
+   one saying the word has a 0 bit in it and one saying it has a 1
+   bit, so a word is full, empty, or mixed.  Each higher level
+   summarizes the words of the level below the same way, up to a
+   single word.  Finding the next word with a 0 (or 1) bit after
+   any position then reads one word per level.
+
+   Optionally, each region of 4096 bits (the words under one level-1
+   word) also keeps the lengths of its longest run of 0 bits and of
+   the runs of 0 bits at its two ends, combined over the regions in
+   a tree.  A first-fit search for CNT 0 bits then descends the
+   tree to the first region that can hold the run, or to the first
+   pair of neighbors it can straddle, and touches O(log n) words
+   plus the words of one region.
+
+   The summaries are kept up to date incrementally by every
+   function that changes bits. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HBITMAP_ERROR SIZE_MAX
+
+/* Creation and destruction. */
+struct hbitmap *hbitmap_create(size_t bit_cnt, bool run_hints);
+void hbitmap_destroy(struct hbitmap *);
+
+/* Bitmap size. */
+size_t hbitmap_size(const struct hbitmap *);
+
+/* Setting and testing bits. */
+void hbitmap_set(struct hbitmap *, size_t idx, bool);
+bool hbitmap_test(const struct hbitmap *, size_t idx);
+void hbitmap_set_all(struct hbitmap *, bool);
+void hbitmap_set_multiple(struct hbitmap *, size_t start, size_t cnt, bool);
+
+/* Finding set or unset bits. */
+size_t hbitmap_scan(const struct hbitmap *, size_t start, size_t cnt, bool);
+size_t hbitmap_scan_and_flip(struct hbitmap *, size_t start, size_t cnt, bool);
+
+#endif /* hbitmap.h */
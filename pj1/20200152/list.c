@@ -2,7 +2,9 @@
 #include <assert.h>
 #define ASSERT(CONDITION) assert(CONDITION)
 
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 /* Our doubly linked lists have two header elements: the "head"
@@ -441,6 +443,265 @@ void list_sort(struct list *list, list_less_func *less, void *aux)
   ASSERT(is_sorted(list_begin(list), list_end(list), less, aux));
 }
 
+/* Sorting through an array.
+
+   list_sort() has to chase the links of every element on each of
+   its ~lg n passes, which for a long list whose elements are
+   scattered through memory means a cache miss per element per
+   pass.  list_sort_array() instead walks the list once to gather
+   pointers to its elements into an array, merge sorts the array,
+   whose passes read and write memory sequentially, and walks it
+   once to relink the elements in order. */
+
+/* Runs this long are sorted by insertion before being merged. */
+#define SORT_RUN 32
+
+/* Fewest elements worth handing to another thread. */
+#define SORT_MIN_PER_THREAD 65536
+
+/* Most threads list_sort_array() uses. */
+#define SORT_MAX_THREADS 64
+
+/* Sorts the N pointers in A by insertion, stably. */
+static void
+insertion_sort(struct list_elem **a, size_t n,
+               list_less_func *less, void *aux)
+{
+  size_t i, j;
+
+  for (i = 1; i < n; i++)
+  {
+    struct list_elem *e = a[i];
+
+    for (j = i; j > 0 && less(e, a[j - 1], aux); j--)
+      a[j] = a[j - 1];
+    a[j] = e;
+  }
+}
+
+/* Merges the NA sorted pointers in A with the NB in B into DST,
+   taking from A first among equal elements. */
+static void
+merge(struct list_elem **a, size_t na, struct list_elem **b, size_t nb,
+      struct list_elem **dst, list_less_func *less, void *aux)
+{
+  struct list_elem **a_end = a + na, **b_end = b + nb;
+
+  /* Already in order, as when sorting a sorted list: just copy. */
+  if (na == 0 || nb == 0 || !less(b[0], a_end[-1], aux))
+  {
+    memcpy(dst, a, na * sizeof *a);
+    memcpy(dst + na, b, nb * sizeof *b);
+    return;
+  }
+  while (a < a_end && b < b_end)
+    *dst++ = less(*b, *a, aux) ? *b++ : *a++;
+  memcpy(dst, a, (a_end - a) * sizeof *a);
+  memcpy(dst + (a_end - a), b, (b_end - b) * sizeof *b);
+}
+
+/* Returns how many of the first P pointers output by merging A
+   (NA pointers) with B (NB pointers) as merge() does come from A.
+   Lets several threads each produce a part of one merge. */
+static size_t
+merge_split(struct list_elem **a, size_t na, struct list_elem **b, size_t nb,
+            size_t p, list_less_func *less, void *aux)
+{
+  size_t lo = p > nb ? p - nb : 0;
+  size_t hi = p < na ? p : na;
+
+  /* Find the fewest taken from A such that the last one taken
+     from B goes before the first one not taken from A. */
+  while (lo < hi)
+  {
+    size_t i = lo + (hi - lo) / 2, j = p - i;
+    if (j > 0 && !less(b[j - 1], a[i], aux))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+/* Sorts the N pointers in A stably, using TMP, which has room for
+   N more, as scratch space. */
+static void
+sort_pointers(struct list_elem **a, struct list_elem **tmp, size_t n,
+              list_less_func *less, void *aux)
+{
+  struct list_elem **src = a, **dst = tmp, **t;
+  size_t width, i;
+
+  for (i = 0; i < n; i += SORT_RUN)
+    insertion_sort(a + i, n - i < SORT_RUN ? n - i : SORT_RUN, less, aux);
+  for (width = SORT_RUN; width < n; width *= 2)
+  {
+    for (i = 0; i < n; i += 2 * width)
+    {
+      size_t na = n - i < width ? n - i : width;
+      size_t nb = n - i - na < width ? n - i - na : width;
+      merge(src + i, na, src + i + na, nb, dst + i, less, aux);
+    }
+    t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != a)
+    memcpy(a, src, n * sizeof *a);
+}
+
+/* One thread's share of list_sort_array(): either sorting
+   SRC[LO...HI) in place, using DST as scratch space, or producing
+   DST[LO + OUT_LO...LO + OUT_HI), part of the merge of SRC[LO...MID)
+   with SRC[MID...HI) into DST[LO...HI). */
+struct sort_job
+{
+  pthread_t thread;
+  bool started; /* Whether THREAD was created. */
+  struct list_elem **src, **dst;
+  size_t lo, mid, hi;
+  size_t out_lo, out_hi;
+  list_less_func *less;
+  void *aux;
+};
+
+static void *
+sort_job(void *job_)
+{
+  struct sort_job *job = job_;
+  struct list_elem **a = job->src + job->lo, **b = job->src + job->mid;
+  size_t na = job->mid - job->lo, nb = job->hi - job->mid, i0, i1;
+
+  if (job->out_hi == 0)
+  {
+    sort_pointers(a, job->dst + job->lo, job->hi - job->lo,
+                  job->less, job->aux);
+    return NULL;
+  }
+  i0 = merge_split(a, na, b, nb, job->out_lo, job->less, job->aux);
+  i1 = merge_split(a, na, b, nb, job->out_hi, job->less, job->aux);
+  merge(a + i0, i1 - i0, b + (job->out_lo - i0),
+        (job->out_hi - i1) - (job->out_lo - i0),
+        job->dst + job->lo + job->out_lo, job->less, job->aux);
+  return NULL;
+}
+
+/* Runs the CNT jobs in JOBS, the first in this thread and the
+   others in threads of their own, or in this thread too if no
+   thread can be created, and waits for all of them. */
+static void
+run_sort_jobs(struct sort_job *jobs, size_t cnt)
+{
+  size_t i;
+
+  for (i = 1; i < cnt; i++)
+  {
+    jobs[i].started =
+        pthread_create(&jobs[i].thread, NULL, sort_job, &jobs[i]) == 0;
+    if (!jobs[i].started)
+      sort_job(&jobs[i]);
+  }
+  sort_job(&jobs[0]);
+  for (i = 1; i < cnt; i++)
+    if (jobs[i].started)
+      pthread_join(jobs[i].thread, NULL);
+}
+
+/* Sorts LIST according to LESS given auxiliary data AUX, like
+   list_sort(), and also stably, but by sorting an array of
+   pointers to its elements and relinking them.  Up to THREADS
+   threads share the work, fewer for short lists.  Takes O(n lg n)
+   time and O(n) extra space in the number of elements in LIST,
+   and falls back to list_sort() if that space cannot be
+   allocated.  LESS must be safe to call from several threads at
+   once if THREADS is greater than 1. */
+void list_sort_array(struct list *list, list_less_func *less, void *aux,
+                     int threads)
+{
+  struct sort_job jobs[SORT_MAX_THREADS];
+  struct list_elem **a, **tmp, **src, *e, *prev;
+  size_t n = list_size(list), cnt, width, i;
+  bool sorted;
+
+  ASSERT(list != NULL);
+  ASSERT(less != NULL);
+
+  if (n < 2)
+    return;
+  a = malloc(2 * n * sizeof *a);
+  if (a == NULL)
+  {
+    list_sort(list, less, aux);
+    return;
+  }
+  tmp = a + n;
+
+  /* Gather the elements, noting whether they are already in
+     order, in which case there is nothing more to do. */
+  sorted = true;
+  for (i = 0, e = list_begin(list); e != list_end(list); e = list_next(e))
+  {
+    if (i > 0 && sorted && less(e, a[i - 1], aux))
+      sorted = false;
+    a[i++] = e;
+  }
+  if (sorted)
+  {
+    free(a);
+    return;
+  }
+
+  /* Use a power of 2 of threads, so that their sorted parts pair
+     up evenly to be merged. */
+  for (cnt = 1; cnt * 2 <= (size_t)threads && cnt * 2 <= SORT_MAX_THREADS
+                && n / (cnt * 2) >= SORT_MIN_PER_THREAD;
+       cnt *= 2)
+    continue;
+
+  /* Each thread sorts one part; then the parts are merged in
+     pairs, every thread taking an equal share of each level. */
+  for (i = 0; i < cnt; i++)
+    jobs[i] = (struct sort_job){.src = a, .dst = tmp, .lo = i * n / cnt,
+                                .hi = (i + 1) * n / cnt, .less = less,
+                                .aux = aux};
+  run_sort_jobs(jobs, cnt);
+  src = a;
+  for (width = 1; width < cnt; width *= 2)
+  {
+    struct list_elem **dst = src == a ? tmp : a;
+
+    for (i = 0; i < cnt; i++)
+    {
+      size_t pair = i / (2 * width), part = i % (2 * width);
+      size_t lo = pair * 2 * width * n / cnt;
+      size_t hi = (pair + 1) * 2 * width * n / cnt;
+
+      jobs[i] = (struct sort_job){
+          .src = src, .dst = dst, .lo = lo,
+          .mid = (pair * 2 + 1) * width * n / cnt, .hi = hi,
+          .out_lo = part * (hi - lo) / (2 * width),
+          .out_hi = (part + 1) * (hi - lo) / (2 * width),
+          .less = less, .aux = aux};
+    }
+    run_sort_jobs(jobs, cnt);
+    src = dst;
+  }
+
+  /* Relink the elements in sorted order. */
+  prev = list_head(list);
+  for (i = 0; i < n; i++)
+  {
+    src[i]->prev = prev;
+    prev->next = src[i];
+    prev = src[i];
+  }
+  prev->next = list_tail(list);
+  list_tail(list)->prev = prev;
+  free(a);
+
+  ASSERT(is_sorted(list_begin(list), list_end(list), less, aux));
+}
+
 /* Inserts ELEM in the proper position in LIST, which must be
    sorted according to LESS given auxiliary data AUX.
    Runs in O(n) average case in the number of elements in LIST. */
@@ -151,6 +151,8 @@ typedef bool list_less_func(const struct list_elem *a,
 /* Operations on lists with ordered elements. */
 void list_sort(struct list *,
                list_less_func *, void *aux);
+void list_sort_array(struct list *,
+                     list_less_func *, void *aux, int threads);
 void list_insert_ordered(struct list *, struct list_elem *,
                          list_less_func *, void *aux);
 void list_unique(struct list *, struct list *duplicates,
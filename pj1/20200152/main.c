@@ -1,6 +1,7 @@
 #include "list.h"
 #include "hash.h"
 #include "bitmap.h"
+#include "pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,11 +29,16 @@ typedef struct ListContainer_
 } ListContainer;
 ListContainer listContainers[10]; // 리스트 컨테이너 배열 선언
 
+// 모든 리스트의 list_item을 할당하는 풀
+// (list_splice 등으로 항목이 다른 리스트로 옮겨갈 수 있으므로 리스트마다 두지 않음)
+struct pool listItemPool;
+
 // 해시 컨테이너 구조체 정의
 typedef struct HashContainer_
 {
     char name[20];     // 해시의 이름
     struct hash *link; // 실제 해시 테이블 구조체에 대한 포인터
+    struct pool items; // 이 해시 테이블의 hash_item을 할당하는 풀
 } HashContainer;
 HashContainer hashContainers[10]; // 해시 컨테이너 배열 선언
 
@@ -137,14 +143,6 @@ void triple(struct hash_elem *e, void *sub)
     temp->data *= (temp->data) * (temp->data); // 데이터 값을 세제곱
 }
 
-// 해시 요소를 소멸하는 함수
-void destructor(struct hash_elem *e, void *sub)
-{
-    struct hash_item *temp;
-    temp = hash_entry(e, struct hash_item, elem); // hash_elem으로부터 hash_item 구조체로 변환
-    free(temp);                                   // 할당된 메모리를 해제
-}
-
 int main()
 {
 
@@ -157,6 +155,8 @@ int main()
     int h_cnt = 0, h_idx = -1;
     size_t b_cnt = 0, b_idx = -1;
 
+    pool_init(&listItemPool, sizeof(struct list_item)); // 리스트 항목 풀 초기화
+
     while (1) // 무한 반복
     {
         fgets(input, sizeof(input), stdin);
@@ -193,6 +193,7 @@ int main()
                 hashContainers[h_cnt].link = (struct hash *)malloc(sizeof(struct hash)); // 해시 메모리 할당
                 struct hash_elem *e;
                 hash_init(hashContainers[h_cnt].link, hashItemData, compareHashItems, sub); // 해시 초기화
+                pool_init(&hashContainers[h_cnt].items, sizeof(struct hash_item));          // 해시 항목 풀 초기화
                 strcpy(tmp2, strtok(NULL, " "));                                            // 해시 이름
                 strcpy(hashContainers[h_cnt].name, tmp2);                                   // 해시 컨테이너에 이름 저장
                 h_cnt++;                                                                    // 해시 개수 증가
@@ -221,7 +222,8 @@ int main()
                 }
                 else if (!strcmp(tmp1, hashContainers[i].name))
                 {
-                    hash_destroy(hashContainers[i].link, destructor);
+                    hash_destroy(hashContainers[i].link, NULL); // 항목들은 풀을 통째로 해제하여 한 번에 해제
+                    pool_release(&hashContainers[i].items);
                     break;
                 }
             }
@@ -315,7 +317,7 @@ int main()
                 insert_point = list_next(insert_point); // 지정된 위치까지 이동
             }
 
-            struct list_item *new_item = (struct list_item *)malloc(sizeof(struct list_item)); // 새로운 항목을 위한 메모리 할당
+            struct list_item *new_item = (struct list_item *)pool_alloc(&listItemPool); // 새로운 항목을 위한 메모리 할당
             if (!new_item)
             {
                 printf("Memory allocation failed.\n");
@@ -337,7 +339,7 @@ int main()
                 printf("List '%s' not found.\n", list_name); // 에러 메시지를 출력
                 continue;                                    // 다음 명령어로 넘어감
             }
-            struct list_item *item = (struct list_item *)malloc(sizeof(struct list_item)); // 새로운 리스트 아이템을 할당
+            struct list_item *item = (struct list_item *)pool_alloc(&listItemPool); // 새로운 리스트 아이템을 할당
             if (!item)                                                                     // 메모리 할당 실패 시
             {
                 printf("Memory allocation failed.\n"); // 할당 실패 메시지를 출력
@@ -360,7 +362,7 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
-            struct list_item *new_item = (struct list_item *)malloc(sizeof(struct list_item)); // 새 항목을 위한 메모리 할당
+            struct list_item *new_item = (struct list_item *)pool_alloc(&listItemPool); // 새 항목을 위한 메모리 할당
             if (!new_item)                                                                     // 메모리 할당 실패 시
             {
                 printf("Memory allocation failed.\n"); // 메모리 할당 실패 메시지 출력
@@ -383,7 +385,7 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
-            struct list_item *new_item = (struct list_item *)malloc(sizeof(struct list_item)); // 새 항목을 위한 메모리 할당
+            struct list_item *new_item = (struct list_item *)pool_alloc(&listItemPool); // 새 항목을 위한 메모리 할당
             if (!new_item)                                                                     // 메모리 할당 실패 시
             {
                 printf("Memory allocation failed.\n"); // 메모리 할당 실패 메시지 출력
@@ -406,7 +408,8 @@ int main()
             }
             if (!list_empty(listContainers[list_index].link)) // 리스트가 비어있지 않은 경우
             {
-                list_pop_front(listContainers[list_index].link); // 리스트의 첫 번째 요소를 제거
+                struct list_elem *e = list_pop_front(listContainers[list_index].link); // 리스트의 첫 번째 요소를 제거
+                pool_free(&listItemPool, list_entry(e, struct list_item, elem));     // 제거한 항목을 풀에 반환
             }
             else // 리스트가 이미 비어있는 경우
             {
@@ -427,7 +430,8 @@ int main()
             }
             if (!list_empty(listContainers[list_index].link)) // 리스트가 비어있지 않은 경우
             {
-                list_pop_back(listContainers[list_index].link); // 리스트의 마지막 요소를 제거
+                struct list_elem *e = list_pop_back(listContainers[list_index].link); // 리스트의 마지막 요소를 제거
+                pool_free(&listItemPool, list_entry(e, struct list_item, elem));    // 제거한 항목을 풀에 반환
             }
             else // 리스트가 이미 비어있는 경우
             {
@@ -629,7 +633,8 @@ int main()
             }
             if (e != list_end(listContainers[list_index].link)) // 유효한 인덱스인 경우
             {
-                list_remove(e); // 해당 요소를 리스트에서 제거
+                list_remove(e);                                                  // 해당 요소를 리스트에서 제거
+                pool_free(&listItemPool, list_entry(e, struct list_item, elem)); // 제거한 항목을 풀에 반환
             }
             else // 유효하지 않은 인덱스인 경우
             {
@@ -650,6 +655,7 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
+            struct list dropped;                // 중복 리스트가 없을 때 제거된 요소를 모아 둘 리스트
             struct list *duplicate_list = NULL; // 중복 리스트 초기화
             if (duplicate_list_name != NULL)    // 다른 리스트 이름이 지정된 경우
             {
@@ -660,7 +666,15 @@ int main()
                 }
             }
 
-            list_unique(listContainers[list_index].link, duplicate_list, compareListItems, NULL); // 중복 요소 제거 실행
+            if (duplicate_list == NULL) // 중복 리스트가 없으면 제거된 요소를 모아서 풀에 반환
+            {
+                list_init(&dropped);
+                list_unique(listContainers[list_index].link, &dropped, compareListItems, NULL);
+                while (!list_empty(&dropped))
+                    pool_free(&listItemPool, list_entry(list_pop_front(&dropped), struct list_item, elem));
+            }
+            else
+                list_unique(listContainers[list_index].link, duplicate_list, compareListItems, NULL); // 중복 요소 제거 실행
         }
 
         // "list_swap" 지정된 리스트에서 두 요소의 위치를 교환
@@ -759,14 +773,15 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
-            struct hash_item *item = malloc(sizeof(struct hash_item)); // 새 해시 아이템 메모리 할당
+            struct hash_item *item = pool_alloc(&hashContainers[hash_index].items); // 새 해시 아이템 메모리 할당
             if (!item)                                                 // 메모리 할당 실패
             {
                 printf("Memory allocation failed.\n"); // 메모리 할당 실패 메시지 출력
                 continue;                              // 다음 명령어로 넘어감
             }
             item->data = data;                                         // 아이템 데이터 설정
-            hash_insert(hashContainers[hash_index].link, &item->elem); // 해시 테이블에 아이템 삽입
+            if (hash_insert(hashContainers[hash_index].link, &item->elem) != NULL) // 해시 테이블에 아이템 삽입
+                pool_free(&hashContainers[hash_index].items, item);                // 같은 값이 이미 있으면 새 아이템 반환
         }
 
         // "hash_find" 지정된 해시 테이블에서 특정 데이터 값을 가진 요소를 찾음
@@ -807,14 +822,16 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
-            struct hash_item *item = malloc(sizeof(struct hash_item)); // 새 해시 아이템 메모리 할당
+            struct hash_item *item = pool_alloc(&hashContainers[hash_index].items); // 새 해시 아이템 메모리 할당
             if (!item)                                                 // 메모리 할당 실패
             {
                 printf("Memory allocation failed.\n"); // 메모리 할당 실패 메시지 출력
                 continue;                              // 다음 명령어로 넘어감
             }
             item->data = data;                                          // 아이템 데이터 설정
-            hash_replace(hashContainers[hash_index].link, &item->elem); // 해시 테이블에서 아이템 교체
+            struct hash_elem *old = hash_replace(hashContainers[hash_index].link, &item->elem); // 해시 테이블에서 아이템 교체
+            if (old)                                                                              // 교체된 아이템이 있으면 풀에 반환
+                pool_free(&hashContainers[hash_index].items, hash_entry(old, struct hash_item, elem));
         }
 
         // "hash_delete" 지정된 해시 테이블에서 특정 데이터 값을 가진 요소를 삭제
@@ -837,7 +854,7 @@ int main()
             if (e) // 삭제된 요소가 있을 경우
             {
                 struct hash_item *item = hash_entry(e, struct hash_item, elem); // hash_elem을 hash_item으로 변환
-                free(item);                                                     // 메모리 해제
+                pool_free(&hashContainers[hash_index].items, item);             // 메모리 해제
             }
         }
 
@@ -911,7 +928,8 @@ int main()
                 continue;                                    // 다음 명령어로 넘어감
             }
 
-            hash_clear(hashContainers[hash_index].link, destructor); // 해시 테이블의 모든 요소를 제거
+            hash_clear(hashContainers[hash_index].link, NULL); // 해시 테이블의 모든 요소를 제거
+            pool_release(&hashContainers[hash_index].items);   // 항목들을 풀째로 한 번에 해제
         }
 
         //----------------------------bitmap--------------------------//
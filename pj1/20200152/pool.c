@@ -0,0 +1,140 @@
+/* Fixed-size object pool.
+
+   See pool.h for basic information. */
+
+#include "pool.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Size of a cache line.  Chunks are aligned to it, and their
+   objects start one line in, after the chunk header. */
+#define CACHE_LINE 64
+
+/* Usual size of a chunk.  Bigger objects get a chunk each. */
+#define CHUNK_SIZE (64 * 1024)
+
+/* Header at the start of each chunk. */
+struct pool_chunk
+{
+  struct pool_chunk *next; /* Next older chunk. */
+};
+
+/* A freed object, on the free list. */
+struct pool_free
+{
+  struct pool_free *next; /* Next freed object. */
+};
+
+/* Initializes P for allocating objects of OBJ_SIZE bytes.  No
+   memory is allocated until the first object is.
+
+   Objects are aligned to the largest power of 2 (up to a cache
+   line) that divides their rounded-up size, which is at least
+   the alignment any type of that size needs. */
+void pool_init(struct pool *p, size_t obj_size)
+{
+  ASSERT(p != NULL);
+  ASSERT(obj_size > 0);
+
+  /* Round up to hold a free list link, keeping pointer alignment. */
+  if (obj_size < sizeof(struct pool_free))
+    obj_size = sizeof(struct pool_free);
+  obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+  p->obj_size = obj_size;
+  p->chunk_size = CHUNK_SIZE;
+  if (p->chunk_size < CACHE_LINE + obj_size)
+    p->chunk_size = (CACHE_LINE + obj_size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+  p->chunks = NULL;
+  p->free_list = NULL;
+  p->next = p->end = NULL;
+  p->obj_cnt = 0;
+}
+
+/* Allocates a new chunk for P to carve objects out of.  Returns
+   false if memory allocation fails. */
+static bool
+new_chunk(struct pool *p)
+{
+  struct pool_chunk *c = aligned_alloc(CACHE_LINE, p->chunk_size);
+  size_t obj_cnt;
+
+  if (c == NULL)
+    return false;
+  c->next = p->chunks;
+  p->chunks = c;
+  obj_cnt = (p->chunk_size - CACHE_LINE) / p->obj_size;
+  p->next = (char *)c + CACHE_LINE;
+  p->end = p->next + obj_cnt * p->obj_size;
+  return true;
+}
+
+/* Returns a new object from P, or a null pointer if memory
+   allocation fails.  The object's contents are undefined. */
+void *
+pool_alloc(struct pool *p)
+{
+  void *obj;
+
+  ASSERT(p != NULL);
+
+  if (p->free_list != NULL)
+  {
+    obj = p->free_list;
+    p->free_list = p->free_list->next;
+  }
+  else
+  {
+    if (p->next == p->end && !new_chunk(p))
+      return NULL;
+    obj = p->next;
+    p->next += p->obj_size;
+  }
+  p->obj_cnt++;
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from P and not
+   freed since, to P.  Does nothing if OBJ is a null pointer. */
+void pool_free(struct pool *p, void *obj)
+{
+  struct pool_free *f = obj;
+
+  ASSERT(p != NULL);
+
+  if (f == NULL)
+    return;
+  f->next = p->free_list;
+  p->free_list = f;
+  p->obj_cnt--;
+}
+
+/* Frees every object allocated from P, and the memory behind
+   them, at once.  P can then be used again as if just
+   initialized. */
+void pool_release(struct pool *p)
+{
+  struct pool_chunk *c, *next;
+
+  ASSERT(p != NULL);
+
+  for (c = p->chunks; c != NULL; c = next)
+  {
+    next = c->next;
+    free(c);
+  }
+  p->chunks = NULL;
+  p->free_list = NULL;
+  p->next = p->end = NULL;
+  p->obj_cnt = 0;
+}
+
+/* Returns the number of objects allocated from P and not freed. */
+size_t
+pool_count(struct pool *p)
+{
+  return p->obj_cnt;
+}
@@ -0,0 +1,46 @@
+#ifndef __MYLIB_POOL_H
+#define __MYLIB_POOL_H
+
+/* Fixed-size object pool.
+
+   Allocates objects of one size, such as the structures that
+   embed a struct list_elem or struct hash_elem, much faster than
+   malloc() and with no per-object overhead.  Objects are carved
+   out of 64 kB chunks, aligned to a cache line, one after another,
+   so objects allocated in a row, say while loading a list or a
+   hash table, sit next to each other in memory and are walked in
+   memory order when the container is walked in that order.
+
+   pool_free() puts an object on a free list, from which
+   pool_alloc() takes it again before carving out a new one; both
+   run in constant time.  pool_release() frees every object in a
+   pool at once, by freeing its chunks, which is much faster than
+   freeing the objects in a container one by one: a container
+   whose elements all come from one pool can be destroyed by
+   emptying it without calling a destructor (with list_init(),
+   hash_clear() or hash_destroy()) and then releasing the pool.
+
+   A pool is not safe to use from several threads at once. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Object pool. */
+struct pool
+{
+  size_t obj_size;             /* Bytes per object. */
+  size_t chunk_size;           /* Bytes per chunk. */
+  struct pool_chunk *chunks;   /* All chunks, newest first. */
+  struct pool_free *free_list; /* Freed objects, last freed first. */
+  char *next;                  /* Next object to carve out of a chunk. */
+  char *end;                   /* End of the newest chunk's objects. */
+  size_t obj_cnt;              /* Number of objects allocated. */
+};
+
+void pool_init(struct pool *, size_t obj_size);
+void *pool_alloc(struct pool *);
+void pool_free(struct pool *, void *);
+void pool_release(struct pool *);
+size_t pool_count(struct pool *);
+
+#endif /* pool.h */
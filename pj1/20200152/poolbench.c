@@ -0,0 +1,240 @@
+// poolbench.c - list_item/hash_item를 malloc으로 할당할 때와 풀(struct pool)로 할당할 때 비교
+//
+// 사용법: poolbench [-n 최대 원소 수]
+//
+// 원소 수 10K, 100K, ..., 최대 원소 수까지, 리스트와 해시 테이블 각각에 대해
+// 원소 하나당 걸리는 시간(ns)을 출력한다.
+//   insert    원소를 할당하여 리스트 뒤(list_push_back) 또는 해시 테이블(hash_insert)에 넣기
+//   traverse  리스트를 앞에서부터, 해시 테이블을 hash_first/hash_next로 순회하며 값을 읽기
+//   find      (해시 테이블만) 모든 키를 무작위 순서로 찾기
+//   destroy   모두 해제: malloc은 원소마다 free, 풀은 컨테이너를 비우고 pool_release 한 번
+// 힙 상태는 두 가지로 잰다.
+//   clean       원소 말고는 할당하는 것이 없음
+//   interleaved 원소를 하나 할당할 때마다 16~256바이트짜리 다른 할당을 하나 함
+//               (실제 프로그램처럼 다른 데이터가 원소 사이사이에 할당됨; 두 방식 모두 똑같이 함)
+
+#include "list.h"
+#include "hash.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+struct list_item
+{
+    struct list_elem elem;
+    int data;
+};
+
+struct hash_item
+{
+    struct hash_elem elem;
+    int data;
+};
+
+static unsigned item_hash(const struct hash_elem *e, void *aux)
+{
+    return hash_int(hash_entry(e, struct hash_item, elem)->data);
+}
+
+static bool item_less(const struct hash_elem *a, const struct hash_elem *b, void *aux)
+{
+    return hash_entry(a, struct hash_item, elem)->data < hash_entry(b, struct hash_item, elem)->data;
+}
+
+// malloc으로 할당한 원소를 해제하는 destructor
+static void free_item(struct hash_elem *e, void *aux)
+{
+    free(hash_entry(e, struct hash_item, elem));
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void shuffle(int *a, size_t n)
+{
+    size_t i;
+
+    for (i = n - 1; i > 0; i--)
+    {
+        size_t j = random() % (i + 1);
+        int t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+}
+
+static void **others;           // interleaved에서 할당한 다른 데이터
+static size_t other_cnt;
+
+// interleaved이면 다른 데이터를 하나 할당
+static void other_alloc(bool interleaved)
+{
+    if (interleaved)
+        others[other_cnt++] = malloc(16 + random() % 241);
+}
+
+static void others_free(void)
+{
+    while (other_cnt > 0)
+        free(others[--other_cnt]);
+}
+
+// 결과를 한 줄로 출력; 시간은 원소 하나당 ns
+static void report(const char *kind, size_t n, bool interleaved, bool pool,
+                   double ins, double trav, double find, double destroy)
+{
+    printf("%9zu %-4s %-11s %-6s insert %6.1f  traverse %6.1f  ", n, kind,
+           interleaved ? "interleaved" : "clean", pool ? "pool" : "malloc",
+           ins / n * 1e9, trav / n * 1e9);
+    if (find >= 0)
+        printf("find %6.1f  ", find / n * 1e9);
+    printf("destroy %6.1f ns\n", destroy / n * 1e9);
+}
+
+static void list_bench(size_t n, bool interleaved, bool use_pool)
+{
+    struct pool pool;
+    struct list list;
+    struct list_elem *e;
+    double t0, ins, trav, destroy;
+    long sum = 0;
+    size_t i;
+
+    pool_init(&pool, sizeof(struct list_item));
+    list_init(&list);
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        struct list_item *it = use_pool ? pool_alloc(&pool) : malloc(sizeof *it);
+
+        it->data = i;
+        list_push_back(&list, &it->elem);
+        other_alloc(interleaved);
+    }
+    ins = now() - t0;
+
+    t0 = now();
+    for (e = list_begin(&list); e != list_end(&list); e = list_next(e))
+        sum += list_entry(e, struct list_item, elem)->data;
+    trav = now() - t0;
+    if (sum != (long)n * (n - 1) / 2)
+    {
+        fprintf(stderr, "list: wrong sum %ld\n", sum);
+        exit(1);
+    }
+
+    t0 = now();
+    if (use_pool)
+    {
+        list_init(&list);
+        pool_release(&pool);
+    }
+    else
+        while (!list_empty(&list))
+            free(list_entry(list_pop_front(&list), struct list_item, elem));
+    destroy = now() - t0;
+    others_free();
+    report("list", n, interleaved, use_pool, ins, trav, -1, destroy);
+}
+
+static void hash_bench(size_t n, bool interleaved, bool use_pool, int *keys)
+{
+    struct pool pool;
+    struct hash hash;
+    struct hash_iterator it;
+    struct hash_item probe;
+    double t0, ins, trav, find, destroy;
+    long sum = 0;
+    size_t i, found = 0;
+
+    pool_init(&pool, sizeof(struct hash_item));
+    hash_init(&hash, item_hash, item_less, NULL);
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        struct hash_item *h = use_pool ? pool_alloc(&pool) : malloc(sizeof *h);
+
+        h->data = i;
+        hash_insert(&hash, &h->elem);
+        other_alloc(interleaved);
+    }
+    ins = now() - t0;
+
+    t0 = now();
+    for (hash_first(&it, &hash); hash_next(&it);)
+        sum += hash_entry(hash_cur(&it), struct hash_item, elem)->data;
+    trav = now() - t0;
+
+    t0 = now();
+    for (i = 0; i < n; i++)
+    {
+        probe.data = keys[i];
+        found += hash_find(&hash, &probe.elem) != NULL;
+    }
+    find = now() - t0;
+    if (sum != (long)n * (n - 1) / 2 || found != n)
+    {
+        fprintf(stderr, "hash: wrong sum %ld or %zu found\n", sum, found);
+        exit(1);
+    }
+
+    t0 = now();
+    if (use_pool)
+    {
+        hash_destroy(&hash, NULL);
+        pool_release(&pool);
+    }
+    else
+        hash_destroy(&hash, free_item);
+    destroy = now() - t0;
+    others_free();
+    report("hash", n, interleaved, use_pool, ins, trav, find, destroy);
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = 10000000, n, i;
+    int c, interleaved, use_pool;
+    int *keys;
+
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        if (c == 'n')
+            max = atol(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n max elements]\n", argv[0]);
+            exit(1);
+        }
+    }
+    srandom(1);
+    others = malloc(max * sizeof *others);
+    keys = malloc(max * sizeof *keys);
+    if (others == NULL || keys == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (n = 10000; n <= max; n *= 10)
+    {
+        for (i = 0; i < n; i++)
+            keys[i] = i;
+        shuffle(keys, n);
+        for (interleaved = 0; interleaved <= 1; interleaved++)
+            for (use_pool = 0; use_pool <= 1; use_pool++)
+                list_bench(n, interleaved, use_pool);
+        for (interleaved = 0; interleaved <= 1; interleaved++)
+            for (use_pool = 0; use_pool <= 1; use_pool++)
+                hash_bench(n, interleaved, use_pool, keys);
+    }
+    free(keys);
+    free(others);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/* Open-addressing hash table.
+
+   See shash.h for basic information. */
+
+#include "shash.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ASSERT(CONDITION) assert(CONDITION)
+
+/* Control bytes.  A full slot's control byte is the low 7 bits of
+   its element's hash, so it is never negative. */
+#define CTRL_EMPTY ((int8_t)-128) /* Never used. */
+#define CTRL_DELETED ((int8_t)-2) /* Emptied by a deletion. */
+
+/* Slot number returned when there is none. */
+#define NO_SLOT ((size_t)-1)
+
+/* One bit per slot of a group, bit I for slot I. */
+typedef unsigned group_mask;
+
+static size_t find_slot(struct shash *, struct hash_elem *, unsigned hash);
+static size_t free_slot(struct shash *, unsigned hash);
+static bool resize(struct shash *, size_t group_cnt);
+
+/* Returns the number of slots in S. */
+static inline size_t
+capacity(const struct shash *s)
+{
+  return s->group_cnt * SHASH_GROUP;
+}
+
+/* Returns the group where the probe sequence for HASH starts.
+   Multiplying spreads every bit of HASH into the high half, of
+   which the low bits pick the group. */
+static inline size_t
+first_group(const struct shash *s, unsigned hash)
+{
+  return ((uint64_t)hash * 0x9e3779b97f4a7c15ULL >> 32) & (s->group_cnt - 1);
+}
+
+/* Returns the control byte for an element with hash HASH. */
+static inline int8_t
+hash_ctrl(unsigned hash)
+{
+  return hash & 0x7f;
+}
+
+/* Returns the group after G in a probe sequence whose STEP'th
+   group G is.  Stepping by 1, 2, 3, ... groups visits every group
+   once when the group count is a power of 2. */
+static inline size_t
+next_group(const struct shash *s, size_t g, size_t step)
+{
+  return (g + step) & (s->group_cnt - 1);
+}
+
+/* Returns the slots of group G in S whose control byte is C. */
+static inline group_mask
+match_ctrl(const struct shash *s, size_t g, int8_t c)
+{
+  const int8_t *ctrl = s->ctrl + g * SHASH_GROUP;
+#ifdef __SSE2__
+  __m128i group = _mm_load_si128((const __m128i *)ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(c)));
+#else
+  group_mask m = 0;
+  int i;
+
+  for (i = 0; i < SHASH_GROUP; i++)
+    if (ctrl[i] == c)
+      m |= 1u << i;
+  return m;
+#endif
+}
+
+/* Returns the slots of group G in S that are empty or deleted:
+   those whose control byte has its sign bit set. */
+static inline group_mask
+match_free(const struct shash *s, size_t g)
+{
+  const int8_t *ctrl = s->ctrl + g * SHASH_GROUP;
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)ctrl));
+#else
+  group_mask m = 0;
+  int i;
+
+  for (i = 0; i < SHASH_GROUP; i++)
+    if (ctrl[i] < 0)
+      m |= 1u << i;
+  return m;
+#endif
+}
+
+/* Points S at new slot and control arrays for GROUP_CNT groups,
+   all empty, without freeing the old ones.  The control bytes
+   follow the slots in the same block, so both are 16-byte
+   aligned.  Returns false, leaving S as it was, if memory
+   allocation fails. */
+static bool
+alloc_table(struct shash *s, size_t group_cnt)
+{
+  size_t cap = group_cnt * SHASH_GROUP;
+  struct hash_elem **slots = malloc(cap * (sizeof *slots + 1));
+
+  if (slots == NULL)
+    return false;
+  s->group_cnt = group_cnt;
+  s->slots = slots;
+  s->ctrl = (int8_t *)(slots + cap);
+  memset(s->ctrl, CTRL_EMPTY, cap);
+  s->empty_cnt = cap;
+  return true;
+}
+
+/* Initializes hash table S to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool shash_init(struct shash *s,
+                hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  s->elem_cnt = 0;
+  s->hash = hash;
+  s->less = less;
+  s->aux = aux;
+  return alloc_table(s, 1);
+}
+
+/* Removes all the elements from S, keeping its size.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash, as in hash_clear(). */
+void shash_clear(struct shash *s, hash_action_func *destructor)
+{
+  size_t i;
+
+  if (destructor != NULL)
+    for (i = 0; i < capacity(s); i++)
+      if (s->ctrl[i] >= 0)
+        destructor(s->slots[i], s->aux);
+  memset(s->ctrl, CTRL_EMPTY, capacity(s));
+  s->empty_cnt = capacity(s);
+  s->elem_cnt = 0;
+}
+
+/* Destroys hash table S.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as in hash_destroy(). */
+void shash_destroy(struct shash *s, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    shash_clear(s, destructor);
+  free(s->slots);
+}
+
+/* Puts NEW, whose hash is HASH and which is not in S, into S,
+   growing S first if it is 7/8 full.  Returns false if S has no
+   empty slot left and cannot grow. */
+static bool
+insert_new(struct shash *s, struct hash_elem *new, unsigned hash)
+{
+  size_t i;
+
+  if (s->empty_cnt <= capacity(s) / 8)
+  {
+    /* Double, unless deletions have left enough room that clearing
+       them out is enough. */
+    size_t group_cnt = s->group_cnt;
+    if (s->elem_cnt >= capacity(s) * 7 / 16)
+      group_cnt *= 2;
+    if (!resize(s, group_cnt) && s->empty_cnt <= 1)
+      return false;
+  }
+  i = free_slot(s, hash);
+  if (s->ctrl[i] == CTRL_EMPTY)
+    s->empty_cnt--;
+  s->ctrl[i] = hash_ctrl(hash);
+  s->slots[i] = new;
+  s->elem_cnt++;
+  return true;
+}
+
+/* Inserts NEW into hash table S and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW.  If there is no room for NEW and the
+   table cannot grow, returns NEW without inserting it. */
+struct hash_elem *
+shash_insert(struct shash *s, struct hash_elem *new)
+{
+  unsigned hash = s->hash(new, s->aux);
+  size_t i = find_slot(s, new, hash);
+
+  if (i != NO_SLOT)
+    return s->slots[i];
+  return insert_new(s, new, hash) ? NULL : new;
+}
+
+/* Inserts NEW into hash table S, replacing any equal element
+   already in the table, which is returned.  If there is no equal
+   element, no room for NEW and the table cannot grow, returns
+   NEW without inserting it. */
+struct hash_elem *
+shash_replace(struct shash *s, struct hash_elem *new)
+{
+  unsigned hash = s->hash(new, s->aux);
+  size_t i = find_slot(s, new, hash);
+  struct hash_elem *old;
+
+  if (i == NO_SLOT)
+    return insert_new(s, new, hash) ? NULL : new;
+  old = s->slots[i];
+  s->slots[i] = new;
+  return old;
+}
+
+/* Finds and returns an element equal to E in hash table S, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+shash_find(struct shash *s, struct hash_elem *e)
+{
+  size_t i = find_slot(s, e, s->hash(e, s->aux));
+
+  return i != NO_SLOT ? s->slots[i] : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table S.  Returns a null pointer if no equal element existed
+   in the table. */
+struct hash_elem *
+shash_delete(struct shash *s, struct hash_elem *e)
+{
+  size_t i = find_slot(s, e, s->hash(e, s->aux));
+
+  if (i == NO_SLOT)
+    return NULL;
+
+  /* A probe only moves past a group that was full.  If this group
+     still has an empty slot, it never was, so no probe depends on
+     this slot staying occupied and it can become empty again. */
+  if (match_ctrl(s, i / SHASH_GROUP, CTRL_EMPTY))
+  {
+    s->ctrl[i] = CTRL_EMPTY;
+    s->empty_cnt++;
+  }
+  else
+    s->ctrl[i] = CTRL_DELETED;
+  s->elem_cnt--;
+  return s->slots[i];
+}
+
+/* Calls ACTION for each element in hash table S in arbitrary
+   order.  Modifying S while shash_apply() is running yields
+   undefined behavior. */
+void shash_apply(struct shash *s, hash_action_func *action)
+{
+  size_t i;
+
+  ASSERT(action != NULL);
+
+  for (i = 0; i < capacity(s); i++)
+    if (s->ctrl[i] >= 0)
+      action(s->slots[i], s->aux);
+}
+
+/* Initializes I for iterating hash table S, with the same idiom
+   as hash_first().  Modifying S during iteration invalidates all
+   iterators. */
+void shash_first(struct shash_iterator *i, struct shash *s)
+{
+  ASSERT(i != NULL);
+  ASSERT(s != NULL);
+
+  i->hash = s;
+  i->slot = 0;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct hash_elem *
+shash_next(struct shash_iterator *i)
+{
+  struct shash *s = i->hash;
+
+  ASSERT(i != NULL);
+
+  while (i->slot < capacity(s) && s->ctrl[i->slot] < 0)
+    i->slot++;
+  i->elem = i->slot < capacity(s) ? s->slots[i->slot++] : NULL;
+  return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling shash_first() but before shash_next(). */
+struct hash_elem *
+shash_cur(struct shash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in S. */
+size_t
+shash_size(struct shash *s)
+{
+  return s->elem_cnt;
+}
+
+/* Returns true if S contains no elements, false otherwise. */
+bool shash_empty(struct shash *s)
+{
+  return s->elem_cnt == 0;
+}
+
+/* Returns the slot of S holding an element equal to E, whose
+   hash is HASH, or NO_SLOT.  Only elements whose control byte
+   matches HASH are compared, E itself without calling LESS. */
+static size_t
+find_slot(struct shash *s, struct hash_elem *e, unsigned hash)
+{
+  size_t g = first_group(s, hash), step = 0;
+  int8_t c = hash_ctrl(hash);
+
+  for (;;)
+  {
+    group_mask m;
+
+    for (m = match_ctrl(s, g, c); m != 0; m &= m - 1)
+    {
+      size_t i = g * SHASH_GROUP + __builtin_ctz(m);
+      struct hash_elem *hi = s->slots[i];
+      if (hi == e || (!s->less(hi, e, s->aux) && !s->less(e, hi, s->aux)))
+        return i;
+    }
+    if (match_ctrl(s, g, CTRL_EMPTY))
+      return NO_SLOT;
+    g = next_group(s, g, ++step);
+  }
+}
+
+/* Returns the first empty or deleted slot in the probe sequence
+   for HASH in S.  There must be one. */
+static size_t
+free_slot(struct shash *s, unsigned hash)
+{
+  size_t g = first_group(s, hash), step = 0;
+  group_mask m;
+
+  while ((m = match_free(s, g)) == 0)
+    g = next_group(s, g, ++step);
+  return g * SHASH_GROUP + __builtin_ctz(m);
+}
+
+/* Moves the elements of S into new arrays of GROUP_CNT groups,
+   dropping deleted slots.  Returns false, leaving S as it was, if
+   memory allocation fails. */
+static bool
+resize(struct shash *s, size_t group_cnt)
+{
+  struct hash_elem **old_slots = s->slots;
+  int8_t *old_ctrl = s->ctrl;
+  size_t old_cap = capacity(s), i;
+
+  if (!alloc_table(s, group_cnt))
+    return false;
+  for (i = 0; i < old_cap; i++)
+    if (old_ctrl[i] >= 0)
+    {
+      struct hash_elem *e = old_slots[i];
+      unsigned hash = s->hash(e, s->aux);
+      size_t j = free_slot(s, hash);
+
+      s->ctrl[j] = hash_ctrl(hash);
+      s->slots[j] = e;
+    }
+  s->empty_cnt -= s->elem_cnt;
+  free(old_slots);
+  return true;
+}
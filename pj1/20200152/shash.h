@@ -0,0 +1,81 @@
+#ifndef __MYLIB_SHASH_H
+#define __MYLIB_SHASH_H
+
+/* Open-addressing hash table.
+
+   A table of the same elements as struct hash (see hash.h),
+   with the same hash and comparison functions, laid out for
+   fewer cache misses per lookup.
+
+   Instead of a list per bucket, the table is a flat array of
+   slots, each holding a pointer to a struct hash_elem or nothing,
+   divided into groups of 16.  Alongside it is an array of control
+   bytes, one per slot, that says whether the slot is empty, was
+   emptied by a deletion, or is full, and for a full slot holds 7
+   bits of the element's hash.  A lookup computes the hash once,
+   picks a group from it, and compares all 16 control bytes of the
+   group against the hash bits at once, so that it only calls the
+   comparison function for slots whose hash bits match: almost
+   always just the element it is looking for.  Groups are probed
+   in a fixed sequence until one with an empty slot is seen.
+
+   The table doubles when it gets 7/8 full, counting slots emptied
+   by deletions, which are reclaimed at the same time.  If it
+   cannot grow for lack of memory, it keeps filling its last empty
+   slots, and shash_insert() fails only when none are left.
+
+   An element in a struct shash does not use its hash_elem's list
+   link, so the same structure can be put in either kind of table,
+   but not in both at once. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "hash.h"
+
+/* Slots in a group. */
+#define SHASH_GROUP 16
+
+/* Open-addressing hash table. */
+struct shash
+{
+  size_t elem_cnt;            /* Number of elements in table. */
+  size_t group_cnt;           /* Number of groups, a power of 2. */
+  size_t empty_cnt;           /* Slots that are empty, not deleted. */
+  int8_t *ctrl;               /* Control byte of each slot. */
+  struct hash_elem **slots;   /* Element in each slot. */
+  hash_hash_func *hash;       /* Hash function. */
+  hash_less_func *less;       /* Comparison function. */
+  void *aux;                  /* Auxiliary data for `hash' and `less'. */
+};
+
+/* An open-addressing hash table iterator. */
+struct shash_iterator
+{
+  struct shash *hash;         /* The hash table. */
+  size_t slot;                /* Current slot. */
+  struct hash_elem *elem;     /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool shash_init(struct shash *, hash_hash_func *, hash_less_func *, void *aux);
+void shash_clear(struct shash *, hash_action_func *);
+void shash_destroy(struct shash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *shash_insert(struct shash *, struct hash_elem *);
+struct hash_elem *shash_replace(struct shash *, struct hash_elem *);
+struct hash_elem *shash_find(struct shash *, struct hash_elem *);
+struct hash_elem *shash_delete(struct shash *, struct hash_elem *);
+
+/* Iteration. */
+void shash_apply(struct shash *, hash_action_func *);
+void shash_first(struct shash_iterator *, struct shash *);
+struct hash_elem *shash_next(struct shash_iterator *);
+struct hash_elem *shash_cur(struct shash_iterator *);
+
+/* Information. */
+size_t shash_size(struct shash *);
+bool shash_empty(struct shash *);
+
+#endif /* shash.h */
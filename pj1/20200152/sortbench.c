@@ -0,0 +1,155 @@
+// sortbench.c - list_sort(제자리 병합)와 list_sort_array(배열로 모아 정렬) 비교
+//
+// 사용법: sortbench [-n 최대 원소 수] [-t 스레드 수]
+//
+// 원소 수 10K, 100K, ..., 최대 원소 수까지, 메모리 곳곳에 흩어진 순서로 연결된 리스트를
+// list_sort, list_sort_array(스레드 1개), list_sort_array(스레드 여러 개)로 정렬한
+// 시간(ms)을 출력한다. 키가 무작위인 리스트와 이미 정렬된 리스트를 각각 잰다.
+// 키는 겹치는 값이 많도록 원소 수의 1/4 범위에서 뽑고,
+// 정렬이 끝날 때마다 순서와 안정성(같은 키는 원래 순서 유지)을 확인한다.
+
+#include "list.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+struct item
+{
+    struct list_elem elem;
+    int key;
+    int seq;                    // 정렬 전 리스트에서의 위치
+};
+
+static bool item_less(const struct list_elem *a, const struct list_elem *b, void *aux)
+{
+    return list_entry(a, struct item, elem)->key < list_entry(b, struct item, elem)->key;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void shuffle(size_t *a, size_t n)
+{
+    size_t i;
+
+    for (i = n - 1; i > 0; i--)
+    {
+        size_t j = random() % (i + 1), t = a[i];
+        a[i] = a[j];
+        a[j] = t;
+    }
+}
+
+// items[order[0]], items[order[1]], ... 순서로 리스트를 만듦
+// SORTED이면 키가 리스트 순서대로 커지고, 아니면 무작위
+static void build(struct list *list, struct item *items, const size_t *order, size_t n, bool sorted)
+{
+    size_t i;
+
+    list_init(list);
+    for (i = 0; i < n; i++)
+    {
+        struct item *it = &items[order[i]];
+
+        it->key = sorted ? (int)(i / 4) : (int)(random() % (n / 4 + 1));
+        it->seq = i;
+        list_push_back(list, &it->elem);
+    }
+}
+
+// 정렬되었는지, 같은 키끼리 원래 순서가 유지되었는지, 원소 수가 맞는지 확인
+static void check(struct list *list, size_t n, const char *name)
+{
+    struct list_elem *e;
+    struct item *prev = NULL;
+    size_t cnt = 0;
+
+    for (e = list_begin(list); e != list_end(list); e = list_next(e), cnt++)
+    {
+        struct item *it = list_entry(e, struct item, elem);
+
+        if (list_prev(e) != (prev != NULL ? &prev->elem : list_head(list))
+            || (prev != NULL && (prev->key > it->key
+                                 || (prev->key == it->key && prev->seq > it->seq))))
+        {
+            fprintf(stderr, "%s: not sorted stably at element %zu\n", name, cnt);
+            exit(1);
+        }
+        prev = it;
+    }
+    if (cnt != n || list_back(list) != &prev->elem)
+    {
+        fprintf(stderr, "%s: %zu elements, expected %zu\n", name, cnt, n);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t max = 10000000, n, i;
+    int c, t, threads = 4, sorted;
+    struct item *items;
+    size_t *order;
+    struct list list;
+
+    while ((c = getopt(argc, argv, "n:t:")) != -1)
+    {
+        if (c == 'n')
+            max = atol(optarg);
+        else if (c == 't')
+            threads = atoi(optarg);
+        else
+        {
+            fprintf(stderr, "usage: %s [-n max elements] [-t threads]\n", argv[0]);
+            exit(1);
+        }
+    }
+    srandom(1);
+    items = malloc(max * sizeof *items);
+    order = malloc(max * sizeof *order);
+    if (items == NULL || order == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (n = 10000; n <= max; n *= 10)
+    {
+        // 리스트를 따라가면 메모리를 무작위로 건너뛰도록 연결 순서를 섞음
+        for (i = 0; i < n; i++)
+            order[i] = i;
+        shuffle(order, n);
+        for (sorted = 0; sorted <= 1; sorted++)
+        {
+            const char *input = sorted ? "sorted" : "random";
+            double t0;
+
+            printf("%9zu %-6s", n, input);
+            build(&list, items, order, n, sorted);
+            t0 = now();
+            list_sort(&list, item_less, NULL);
+            printf("  list_sort %9.1f", (now() - t0) * 1e3);
+            check(&list, n, "list_sort");
+
+            // 스레드 1개, 그리고 -t로 준 수만큼
+            for (t = 1; t <= threads; t = t == 1 && threads > 1 ? threads : threads + 1)
+            {
+                build(&list, items, order, n, sorted);
+                t0 = now();
+                list_sort_array(&list, item_less, NULL, t);
+                printf("  array/%d %9.1f", t, (now() - t0) * 1e3);
+                check(&list, n, "list_sort_array");
+            }
+            printf(" ms\n");
+        }
+    }
+    free(order);
+    free(items);
+    return 0;
+}
@@ -779,19 +779,13 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 /* $end rio_writen */
 
 
-/* 
- * rio_read - This is a wrapper for the Unix read() function that
- *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
- *    buffer, where n is the number of bytes requested by the user and
- *    rio_cnt is the number of unread bytes in the internal buffer. On
- *    entry, rio_read() refills the internal buffer via a call to
- *    read() if the internal buffer is empty.
+/*
+ * rio_fill - Refill an empty internal buffer with a single read(),
+ *     retrying if interrupted; return the number of bytes now buffered,
+ *     0 on EOF, or -1 on error
  */
-/* $begin rio_read */
-static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
+static ssize_t rio_fill(rio_t *rp)
 {
-    int cnt;
-
     while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
 	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
 			   sizeof(rp->rio_buf));
@@ -804,6 +798,24 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
 	else 
 	    rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
     }
+    return rp->rio_cnt;
+}
+
+/* 
+ * rio_read - This is a wrapper for the Unix read() function that
+ *    transfers min(n, rio_cnt) bytes from an internal buffer to a user
+ *    buffer, where n is the number of bytes requested by the user and
+ *    rio_cnt is the number of unread bytes in the internal buffer. On
+ *    entry, rio_read() refills the internal buffer via a call to
+ *    read() if the internal buffer is empty.
+ */
+/* $begin rio_read */
+static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
+{
+    int cnt;
+
+    if (rp->rio_cnt <= 0 && (cnt = rio_fill(rp)) <= 0)
+	return cnt;     /* EOF or error */
 
     /* Copy min(n, rp->rio_cnt) bytes from internal buf to user buf */
     cnt = n;          
@@ -852,33 +864,194 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 
 /* 
  * rio_readlineb - Robustly read a text line (buffered)
+ *
+ * Finds the end of the line with memchr() and copies it out of the
+ * internal buffer in one piece, instead of going through rio_read()
+ * a byte at a time.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
-
-    for (n = 1; n < maxlen; n++) { 
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-	    *bufp++ = c;
-	    if (c == '\n') {
-                n++;
-     		break;
-            }
-	} else if (rc == 0) {
-	    if (n == 1)
-		return 0; /* EOF, no data read */
-	    else
-		break;    /* EOF, some data was read */
-	} else
-	    return -1;	  /* Error */
+    size_t n = 0, cnt;
+    ssize_t rc;
+    char *bufp = usrbuf, *nl = NULL;
+
+    while (!nl && n + 1 < maxlen) {
+	if (rp->rio_cnt <= 0 && (rc = rio_fill(rp)) <= 0) {
+	    if (rc < 0)
+		return -1;	  /* Error */
+	    if (n == 0)
+		return 0;     /* EOF, no data read */
+	    break;            /* EOF, some data was read */
+	}
+
+	/* Take everything up to and including the newline, if it is
+	   buffered, else everything that fits */
+	cnt = maxlen - 1 - n;
+	if (rp->rio_cnt < cnt)
+	    cnt = rp->rio_cnt;
+	if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+	    cnt = nl - rp->rio_bufptr + 1;
+	memcpy(bufp + n, rp->rio_bufptr, cnt);
+	rp->rio_bufptr += cnt;
+	rp->rio_cnt -= cnt;
+	n += cnt;
     }
-    *bufp = 0;
-    return n-1;
+    bufp[n] = 0;
+    return n;
 }
 /* $end rio_readlineb */
 
+/*
+ * rio_writev - Robustly write the iovcnt buffers in iov (unbuffered).
+ *    Short writes are resumed where they stopped, which updates iov in
+ *    place; returns the total number of bytes written, or -1 on error.
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0) {
+	if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+	    if (errno == EINTR)  /* Interrupted by sig handler return */
+		nwritten = 0;    /* and call writev() again */
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	total += nwritten;
+
+	/* Step over the buffers that went out completely */
+	while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+	    nwritten -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt > 0) {
+	    iov->iov_base = (char *)iov->iov_base + nwritten;
+	    iov->iov_len -= nwritten;
+	}
+    }
+    return total;
+}
+
+/*
+ * rio_writeinitb - Associate a descriptor with a write buffer
+ */
+void rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    wp->rio_fd = fd;
+    wp->rio_corked = 0;
+    wp->rio_cnt = 0;
+}
+
+/*
+ * rio_writenb - Robustly write n bytes (buffered). Bytes are held in
+ *    the internal buffer until it fills or rio_flushb() is called; data
+ *    that does not fit goes out along with the buffered bytes in one
+ *    writev().
+ */
+ssize_t rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    struct iovec iov[2];
+
+    if (n <= sizeof(wp->rio_buf) - wp->rio_cnt) {
+	memcpy(wp->rio_buf + wp->rio_cnt, usrbuf, n);
+	wp->rio_cnt += n;
+	return n;
+    }
+    iov[0].iov_base = wp->rio_buf;
+    iov[0].iov_len = wp->rio_cnt;
+    iov[1].iov_base = usrbuf;
+    iov[1].iov_len = n;
+    if (rio_writev(wp->rio_fd, iov, 2) < 0)
+	return -1;
+    wp->rio_cnt = 0;
+    return n;
+}
+
+/*
+ * rio_vprintfb - vprintf() into a write buffer; returns the number of
+ *    bytes added, or -1 on error
+ */
+static ssize_t rio_vprintfb(rio_writer_t *wp, const char *fmt, va_list ap)
+{
+    va_list aq;
+    size_t room = sizeof(wp->rio_buf) - wp->rio_cnt;
+    ssize_t rc;
+    char *big;
+    int n;
+
+    va_copy(aq, ap);
+    n = vsnprintf(wp->rio_buf + wp->rio_cnt, room, fmt, aq);
+    va_end(aq);
+    if (n < 0)
+	return -1;
+    if (n < room) {
+	wp->rio_cnt += n;
+	return n;
+    }
+
+    /* Didn't fit. Make room and format again, or if it would not fit
+       in an empty buffer either, format it on the side. */
+    if (n < sizeof(wp->rio_buf)) {
+	if (rio_flushb(wp) < 0)
+	    return -1;
+	wp->rio_cnt = vsnprintf(wp->rio_buf, sizeof(wp->rio_buf), fmt, ap);
+	return n;
+    }
+    if ((big = malloc(n + 1)) == NULL)
+	return -1;
+    vsnprintf(big, n + 1, fmt, ap);
+    rc = rio_writenb(wp, big, n);
+    free(big);
+    return rc;
+}
+
+/*
+ * rio_printfb - printf() into a write buffer
+ */
+ssize_t rio_printfb(rio_writer_t *wp, const char *fmt, ...)
+{
+    va_list ap;
+    ssize_t rc;
+
+    va_start(ap, fmt);
+    rc = rio_vprintfb(wp, fmt, ap);
+    va_end(ap);
+    return rc;
+}
+
+/*
+ * rio_flushb - Write out everything held in a write buffer
+ */
+int rio_flushb(rio_writer_t *wp)
+{
+    if (wp->rio_cnt > 0 && rio_writen(wp->rio_fd, wp->rio_buf, wp->rio_cnt) < 0)
+	return -1;
+    wp->rio_cnt = 0;
+    return 0;
+}
+
+/*
+ * rio_corkb - Turn cork mode on or off for a writer on a TCP socket.
+ *    While corked, the kernel sends only full segments, so buffer
+ *    flushes and anything else written to the descriptor (say, a
+ *    rio_sendfile() body after buffered headers) are packed together.
+ *    Uncorking flushes the buffer and pushes out any partial segment.
+ */
+int rio_corkb(rio_writer_t *wp, int on)
+{
+    if (!on && rio_flushb(wp) < 0)
+	return -1;
+    if (on == wp->rio_corked)
+	return 0;
+    if (setsockopt(wp->rio_fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) < 0)
+	return -1;
+    wp->rio_corked = on;
+    return 0;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -920,6 +1093,48 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+void Rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    if (rio_writev(fd, iov, iovcnt) < 0)
+	unix_error("Rio_writev error");
+}
+
+void Rio_writeinitb(rio_writer_t *wp, int fd)
+{
+    rio_writeinitb(wp, fd);
+}
+
+void Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n)
+{
+    if (rio_writenb(wp, usrbuf, n) != n)
+	unix_error("Rio_writenb error");
+}
+
+ssize_t Rio_printfb(rio_writer_t *wp, const char *fmt, ...)
+{
+    va_list ap;
+    ssize_t rc;
+
+    va_start(ap, fmt);
+    rc = rio_vprintfb(wp, fmt, ap);
+    va_end(ap);
+    if (rc < 0)
+	unix_error("Rio_printfb error");
+    return rc;
+}
+
+void Rio_flushb(rio_writer_t *wp)
+{
+    if (rio_flushb(wp) < 0)
+	unix_error("Rio_flushb error");
+}
+
+void Rio_corkb(rio_writer_t *wp, int on)
+{
+    if (rio_corkb(wp, on) < 0)
+	unix_error("Rio_corkb error");
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
@@ -28,6 +29,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 /* $begin createmasks */
@@ -51,6 +53,14 @@ typedef struct {
 } rio_t;
 /* $end rio_t */
 
+/* Persistent state for buffered Rio output */
+typedef struct {
+    int rio_fd;                /* Descriptor for this internal buf */
+    int rio_corked;            /* TCP_CORK is set on rio_fd */
+    size_t rio_cnt;            /* Unwritten bytes in internal buf */
+    char rio_buf[RIO_BUFSIZE]; /* Internal buffer */
+} rio_writer_t;
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -178,6 +188,12 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
+void rio_writeinitb(rio_writer_t *wp, int fd);
+ssize_t	rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t	rio_printfb(rio_writer_t *wp, const char *fmt, ...);
+int rio_flushb(rio_writer_t *wp);
+int rio_corkb(rio_writer_t *wp, int on);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -185,6 +201,12 @@ void Rio_writen(int fd, void *usrbuf, size_t n);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+void Rio_writev(int fd, struct iovec *iov, int iovcnt);
+void Rio_writeinitb(rio_writer_t *wp, int fd);
+void Rio_writenb(rio_writer_t *wp, void *usrbuf, size_t n);
+ssize_t Rio_printfb(rio_writer_t *wp, const char *fmt, ...);
+void Rio_flushb(rio_writer_t *wp);
+void Rio_corkb(rio_writer_t *wp, int on);
 
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
@@ -46,6 +46,8 @@ void init_stock_data();
 void free_stock_tree(Stock *node);
 
 // 명령어 처리 함수
+void send_reply(int connfd, char *msg);
+void flush_reply(rio_writer_t *wp);
 void show_stock(int connfd);
 void buy_stock(int connfd, int target_id, int quantity);
 void sell_stock(int connfd, int target_id, int quantity);
@@ -188,8 +190,7 @@ void check_client(ClientPool *p)
                     close_client_connection(connfd, i, p); // 클라이언트 연결 종료
                 else
                 {
-                    char str[] = "Invalid Command\n";
-                    Rio_writen(connfd, str, MAXLINE); // 잘못된 명령어 처리
+                    send_reply(connfd, "Invalid Command\n"); // 잘못된 명령어 처리
                 }
             }
             else
@@ -337,6 +338,29 @@ Stock *find_stock(int id)
     return NULL; // 찾지 못하면 NULL 반환
 }
 
+// 클라이언트는 응답을 MAXLINE 바이트 단위로 읽으므로 뒤를 0으로 채워 보낸다
+char reply_pad[MAXLINE];
+
+// 짧은 메시지와 패딩을 writev 한 번으로 전송
+void send_reply(int connfd, char *msg)
+{
+    struct iovec iov[2];
+    size_t len = strlen(msg);
+
+    iov[0].iov_base = msg;
+    iov[0].iov_len = len;
+    iov[1].iov_base = reply_pad;
+    iov[1].iov_len = MAXLINE - len;
+    Rio_writev(connfd, iov, 2);
+}
+
+// 버퍼에 모은 응답을 MAXLINE 바이트로 채운 뒤 write 한 번으로 전송
+void flush_reply(rio_writer_t *wp)
+{
+    Rio_writenb(wp, reply_pad, MAXLINE - wp->rio_cnt);
+    Rio_flushb(wp);
+}
+
 void show_stock(int connfd)
 {
     if (root == NULL)
@@ -346,13 +370,12 @@ void show_stock(int connfd)
     int top = -1;
     stack[++top] = root;
 
-    char str[MAXLINE] = {0};
+    rio_writer_t w;
+    Rio_writeinitb(&w, connfd);
     while (top != -1)
     {
         Stock *iter = stack[top--];
-        char buf[RIO_BUFSIZE];
-        sprintf(buf, "%d %d %d\n", iter->id, iter->left_stock, iter->price);
-        strcat(str, buf);
+        Rio_printfb(&w, "%d %d %d\n", iter->id, iter->left_stock, iter->price);
 
         if (iter->left != NULL)
             stack[++top] = iter->left;
@@ -361,7 +384,7 @@ void show_stock(int connfd)
             stack[++top] = iter->right;
     }
 
-    Rio_writen(connfd, str, MAXLINE); // 주식 정보를 클라이언트에 전송
+    flush_reply(&w); // 주식 정보를 클라이언트에 전송
 }
 
 void buy_stock(int connfd, int target_id, int quantity)
@@ -369,8 +392,7 @@ void buy_stock(int connfd, int target_id, int quantity)
     Stock *stock = find_stock(target_id);
     if (stock == NULL)
     {
-        char str[] = "Stock not found\n";
-        Rio_writen(connfd, str, MAXLINE); // 주식이 없으면 에러 메시지 전송
+        send_reply(connfd, "Stock not found\n"); // 주식이 없으면 에러 메시지 전송
         return;
     }
 
@@ -378,13 +400,11 @@ void buy_stock(int connfd, int target_id, int quantity)
     if (stock->left_stock >= quantity)
     {
         stock->left_stock -= quantity; // 주식 구매 처리
-        char str[] = "[buy] success\n";
-        Rio_writen(connfd, str, MAXLINE); // 성공 메시지 전송
+        send_reply(connfd, "[buy] success\n"); // 성공 메시지 전송
     }
     else
     {
-        char str[] = "Not enough left stock\n";
-        Rio_writen(connfd, str, MAXLINE); // 남은 주식이 부족하면 에러 메시지 전송
+        send_reply(connfd, "Not enough left stock\n"); // 남은 주식이 부족하면 에러 메시지 전송
     }
     pthread_mutex_unlock(&stock->lock);
     update_stock_data(); // 주식 데이터 업데이트
@@ -395,15 +415,13 @@ void sell_stock(int connfd, int target_id, int quantity)
     Stock *stock = find_stock(target_id);
     if (stock == NULL)
     {
-        char str[] = "Stock not found\n";
-        Rio_writen(connfd, str, MAXLINE); // 주식이 없으면 에러 메시지 전송
+        send_reply(connfd, "Stock not found\n"); // 주식이 없으면 에러 메시지 전송
         return;
     }
 
     pthread_mutex_lock(&stock->lock);
     stock->left_stock += quantity; // 주식 판매 처리
-    char str[] = "[sell] success\n";
-    Rio_writen(connfd, str, MAXLINE); // 성공 메시지 전송
+    send_reply(connfd, "[sell] success\n"); // 성공 메시지 전송
     pthread_mutex_unlock(&stock->lock);
     update_stock_data(); // 주식 데이터 업데이트
 }
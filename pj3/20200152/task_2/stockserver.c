@@ -52,6 +52,8 @@ pthread_mutex_t file_mutex; // 파일 잠금용 mutex
 
 void insert_stock(Stock *new_stock);                      // 재고 삽입 함수 선언
 Stock *find_stock(int id);                                // 재고 찾기 함수 선언
+void send_reply(int connfd, char *msg);                   // 응답 전송 함수 선언
+void flush_reply(rio_writer_t *wp);                       // 버퍼된 응답 전송 함수 선언
 void show_stock(int connfd);                              // 재고 표시 함수 선언
 void buy_stock(int connfd, int target_id, int quantity);  // 재고 구매 함수 선언
 void sell_stock(int connfd, int target_id, int quantity); // 재고 판매 함수 선언
@@ -192,8 +194,7 @@ void handle_client(int connfd)
         }
         else
         {                                     // 잘못된 명령어 처리
-            char str[] = "Invalid Command\n"; // 오류 메시지
-            Rio_writen(connfd, str, MAXLINE); // 클라이언트에 오류 메시지 전송
+            send_reply(connfd, "Invalid Command\n"); // 클라이언트에 오류 메시지 전송
         }
     }
 }
@@ -331,6 +332,29 @@ Stock *find_stock(int id)
     return NULL; // 찾는 재고가 없으면 NULL 반환
 }
 
+// 클라이언트는 응답을 MAXLINE 바이트 단위로 읽으므로 뒤를 0으로 채워 보낸다
+char reply_pad[MAXLINE];
+
+// 짧은 메시지와 패딩을 writev 한 번으로 전송
+void send_reply(int connfd, char *msg)
+{
+    struct iovec iov[2];
+    size_t len = strlen(msg);
+
+    iov[0].iov_base = msg;
+    iov[0].iov_len = len;
+    iov[1].iov_base = reply_pad;
+    iov[1].iov_len = MAXLINE - len;
+    Rio_writev(connfd, iov, 2);
+}
+
+// 버퍼에 모은 응답을 MAXLINE 바이트로 채운 뒤 write 한 번으로 전송
+void flush_reply(rio_writer_t *wp)
+{
+    Rio_writenb(wp, reply_pad, MAXLINE - wp->rio_cnt);
+    Rio_flushb(wp);
+}
+
 void show_stock(int connfd)
 { // 재고 표시 함수
     if (root == NULL)
@@ -340,7 +364,8 @@ void show_stock(int connfd)
     int top = -1;        // 스택 탑 초기화
     stack[++top] = root; // 루트 노드를 스택에 추가
 
-    char str[MAXLINE] = {0}; // 문자열 버퍼 초기화
+    rio_writer_t w; // 응답 버퍼 초기화
+    Rio_writeinitb(&w, connfd);
     while (top != -1)
     {
         Stock *iter = stack[top--]; // 스택에서 노드 꺼내기
@@ -351,9 +376,7 @@ void show_stock(int connfd)
             P(&iter->write); // 첫 번째 읽기 시 쓰기 잠금
         V(&iter->mutex);     // mutex 해제
 
-        char buf[RIO_BUFSIZE];                                               // 버퍼
-        sprintf(buf, "%d %d %d\n", iter->id, iter->left_stock, iter->price); // 재고 정보 포맷팅
-        strcat(str, buf);                                                    // 문자열에 추가
+        Rio_printfb(&w, "%d %d %d\n", iter->id, iter->left_stock, iter->price); // 재고 정보 포맷팅
 
         P(&iter->mutex);    // mutex 잠금
         iter->read_count--; // 읽기 카운트 감소
@@ -368,7 +391,7 @@ void show_stock(int connfd)
             stack[++top] = iter->right; // 오른쪽 자식 노드 스택에 추가
     }
 
-    Rio_writen(connfd, str, MAXLINE); // 클라이언트에 재고 정보 전송
+    flush_reply(&w); // 클라이언트에 재고 정보 전송
 }
 
 void buy_stock(int connfd, int target_id, int quantity)
@@ -376,8 +399,7 @@ void buy_stock(int connfd, int target_id, int quantity)
     Stock *stock = find_stock(target_id); // 재고 찾기
     if (stock == NULL)
     {
-        char str[] = "Stock not found\n"; // 재고를 찾을 수 없는 경우
-        Rio_writen(connfd, str, MAXLINE); // 클라이언트에 메시지 전송
+        send_reply(connfd, "Stock not found\n"); // 클라이언트에 메시지 전송
         return;
     }
 
@@ -385,14 +407,12 @@ void buy_stock(int connfd, int target_id, int quantity)
     if (stock->left_stock >= quantity)
     {
         stock->left_stock -= quantity;    // 남은 재고 감소
-        char str[] = "[buy] success\n";   // 성공 메시지
-        Rio_writen(connfd, str, MAXLINE); // 클라이언트에 메시지 전송
+        send_reply(connfd, "[buy] success\n"); // 클라이언트에 메시지 전송
         update_stock_data();              // 재고 데이터 업데이트
     }
     else
     {
-        char str[] = "Not enough left stock\n"; // 재고가 부족한 경우
-        Rio_writen(connfd, str, MAXLINE);       // 클라이언트에 메시지 전송
+        send_reply(connfd, "Not enough left stock\n"); // 클라이언트에 메시지 전송
     }
     V(&stock->write); // 쓰기 잠금 해제
 }
@@ -402,15 +422,13 @@ void sell_stock(int connfd, int target_id, int quantity)
     Stock *stock = find_stock(target_id); // 재고 찾기
     if (stock == NULL)
     {
-        char str[] = "Stock not found\n"; // 재고를 찾을 수 없는 경우
-        Rio_writen(connfd, str, MAXLINE); // 클라이언트에 메시지 전송
+        send_reply(connfd, "Stock not found\n"); // 클라이언트에 메시지 전송
         return;
     }
 
     P(&stock->write);                 // 쓰기 잠금
     stock->left_stock += quantity;    // 남은 재고 증가
-    char str[] = "[sell] success\n";  // 성공 메시지
-    Rio_writen(connfd, str, MAXLINE); // 클라이언트에 메시지 전송
+    send_reply(connfd, "[sell] success\n"); // 클라이언트에 메시지 전송
     update_stock_data();              // 재고 데이터 업데이트
     V(&stock->write);                 // 쓰기 잠금 해제
 }